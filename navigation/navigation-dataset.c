@@ -0,0 +1,788 @@
+/*
+ * navigation-dataset.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "navigation-dataset.h"
+
+/* mean earth radius in meters, the same as the provider uses */
+#define METERS_PER_DEGREE (6371008.8 * G_PI / 180.0)
+
+/* weight of a query token matching in the field it was given for, matches
+ * in other fields weigh 1 */
+#define WEIGHT_STREET 4
+#define WEIGHT_TOWN 2
+#define WEIGHT_POSTAL_CODE 3
+
+#define MAX_QUERY_TOKENS 16
+/* a prefix matching more tokens than this only looks at the first ones */
+#define MAX_PREFIX_TOKENS 32
+
+G_STATIC_ASSERT(sizeof(NavigationDatasetHeader) == 56);
+G_STATIC_ASSERT(sizeof(NavigationDatasetRecord) == 52);
+
+struct _NavigationDataset
+{
+  GMappedFile *file;
+  const NavigationDatasetRecord *records;
+  guint32 n_records;
+  const gchar *strings;
+  guint32 strings_size;
+  double max_distance;
+  /* token index, n_tokens is 0 for version 1 files */
+  guint32 n_tokens;
+  const guint32 *blocks;
+  const guint8 *tokens;
+  guint32 tokens_size;
+  const guint32 *postings;
+  guint32 n_postings;
+};
+
+struct _NavigationDatasetPostings
+{
+  guint32 start;
+  guint32 count;
+};
+
+typedef struct _NavigationDatasetPostings NavigationDatasetPostings;
+
+struct _NavigationDatasetQueryToken
+{
+  NavigationDatasetField field;
+  /* fields the matching tokens occur in */
+  guint fields;
+  guint n_lists;
+  guint32 n_postings;
+  NavigationDatasetPostings lists[MAX_PREFIX_TOKENS];
+};
+
+typedef struct _NavigationDatasetQueryToken NavigationDatasetQueryToken;
+
+struct _NavigationDatasetTokenCursor
+{
+  const guint8 *p;
+  const guint8 *end;
+  gchar token[NAVIGATION_DATASET_MAX_TOKEN + 1];
+  gsize len;
+  guint fields;
+  NavigationDatasetPostings postings;
+};
+
+typedef struct _NavigationDatasetTokenCursor NavigationDatasetTokenCursor;
+
+struct _NavigationDatasetQuery
+{
+  const NavigationDatasetRecord *records;
+  double latitude;
+  double longitude;
+  /* shrinks longitude differences to the length of a latitude degree */
+  double scale;
+  guint32 best;
+  double best_distance;
+};
+
+typedef struct _NavigationDatasetQuery NavigationDatasetQuery;
+
+static guint32
+n_blocks(NavigationDataset *dataset)
+{
+  return (dataset->n_tokens + NAVIGATION_DATASET_BLOCK_SIZE - 1) /
+    NAVIGATION_DATASET_BLOCK_SIZE;
+}
+
+static gboolean
+open_index(NavigationDataset *dataset, const NavigationDatasetHeader *header,
+           const gchar *data, gsize size)
+{
+  guint32 blocks_offset = GUINT32_FROM_LE(header->blocks_offset);
+  guint32 tokens_offset = GUINT32_FROM_LE(header->tokens_offset);
+  guint32 postings_offset = GUINT32_FROM_LE(header->postings_offset);
+  guint32 last = 0;
+  guint32 i;
+
+  if (size < sizeof(*header))
+    return FALSE;
+
+  dataset->n_tokens = GUINT32_FROM_LE(header->n_tokens);
+  dataset->tokens_size = GUINT32_FROM_LE(header->tokens_size);
+  dataset->n_postings = GUINT32_FROM_LE(header->n_postings);
+
+  if (blocks_offset % sizeof(guint32) || blocks_offset > size ||
+      n_blocks(dataset) > (size - blocks_offset) / sizeof(guint32) ||
+      tokens_offset > size || dataset->tokens_size > size - tokens_offset ||
+      postings_offset % sizeof(guint32) || postings_offset > size ||
+      dataset->n_postings > (size - postings_offset) / sizeof(guint32))
+  {
+    dataset->n_tokens = 0;
+    return FALSE;
+  }
+
+  dataset->blocks = (const guint32 *)(data + blocks_offset);
+  dataset->tokens = (const guint8 *)data + tokens_offset;
+  dataset->postings = (const guint32 *)(data + postings_offset);
+
+  /* entries are bounds checked while decoding, block offsets only here */
+  for (i = 0; i < n_blocks(dataset); i++)
+  {
+    guint32 offset = GUINT32_FROM_LE(dataset->blocks[i]);
+
+    if (offset < last || offset >= dataset->tokens_size)
+    {
+      dataset->n_tokens = 0;
+      return FALSE;
+    }
+
+    last = offset;
+  }
+
+  return TRUE;
+}
+
+NavigationDataset *
+navigation_dataset_open(const char *path, GError **error)
+{
+  const NavigationDatasetHeader *header;
+  NavigationDataset *dataset;
+  GMappedFile *file;
+  const gchar *data;
+  gsize size;
+
+  file = g_mapped_file_new(path, FALSE, error);
+
+  if (!file)
+    return NULL;
+
+  data = g_mapped_file_get_contents(file);
+  size = g_mapped_file_get_length(file);
+  header = (const NavigationDatasetHeader *)data;
+
+  if (size < NAVIGATION_DATASET_HEADER_V1_SIZE ||
+      memcmp(header->magic, NAVIGATION_DATASET_MAGIC,
+             sizeof(NAVIGATION_DATASET_MAGIC)) ||
+      GUINT32_FROM_LE(header->version) < 1 ||
+      GUINT32_FROM_LE(header->version) > NAVIGATION_DATASET_VERSION)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                "%s is not a navigation dataset of version %d or older",
+                path, NAVIGATION_DATASET_VERSION);
+    g_mapped_file_unref(file);
+
+    return NULL;
+  }
+
+  dataset = g_new0(NavigationDataset, 1);
+  dataset->file = file;
+  dataset->n_records = GUINT32_FROM_LE(header->n_records);
+  dataset->strings_size = GUINT32_FROM_LE(header->strings_size);
+  dataset->max_distance = GUINT32_FROM_LE(header->max_distance);
+
+  if (GUINT32_FROM_LE(header->records_offset) % sizeof(guint32) ||
+      GUINT32_FROM_LE(header->records_offset) > size ||
+      dataset->n_records > (size - GUINT32_FROM_LE(header->records_offset)) /
+      sizeof(NavigationDatasetRecord) ||
+      GUINT32_FROM_LE(header->strings_offset) > size ||
+      !dataset->strings_size ||
+      dataset->strings_size > size - GUINT32_FROM_LE(header->strings_offset) ||
+      data[GUINT32_FROM_LE(header->strings_offset) +
+           dataset->strings_size - 1])
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                "%s is truncated or corrupt", path);
+    navigation_dataset_free(dataset);
+
+    return NULL;
+  }
+
+  dataset->records = (const NavigationDatasetRecord *)
+    (data + GUINT32_FROM_LE(header->records_offset));
+  dataset->strings = data + GUINT32_FROM_LE(header->strings_offset);
+
+  if (GUINT32_FROM_LE(header->version) >= 2 &&
+      !open_index(dataset, header, data, size))
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                "%s has a corrupt token index", path);
+    navigation_dataset_free(dataset);
+
+    return NULL;
+  }
+
+  return dataset;
+}
+
+void
+navigation_dataset_free(NavigationDataset *dataset)
+{
+  if (dataset)
+  {
+    g_mapped_file_unref(dataset->file);
+    g_free(dataset);
+  }
+}
+
+static double
+record_distance(NavigationDatasetQuery *query,
+                const NavigationDatasetRecord *record)
+{
+  double dlat = query->latitude - (gint32)GUINT32_FROM_LE(record->latitude);
+  double dlon = (query->longitude - (gint32)GUINT32_FROM_LE(record->longitude)) *
+    query->scale;
+
+  return dlat * dlat + dlon * dlon;
+}
+
+static void
+kd_tree_nearest(NavigationDatasetQuery *query, guint32 lo, guint32 hi,
+                guint depth)
+{
+  while (lo < hi)
+  {
+    guint32 mid = lo + (hi - lo) / 2;
+    const NavigationDatasetRecord *record = &query->records[mid];
+    double distance = record_distance(query, record);
+    double diff;
+
+    if (distance < query->best_distance)
+    {
+      query->best_distance = distance;
+      query->best = mid;
+    }
+
+    if (depth & 1)
+    {
+      diff = (query->longitude - (gint32)GUINT32_FROM_LE(record->longitude)) *
+        query->scale;
+    }
+    else
+      diff = query->latitude - (gint32)GUINT32_FROM_LE(record->latitude);
+
+    depth++;
+
+    /* descend into the near half, the far one only if it can be closer */
+    if (diff < 0)
+    {
+      if (diff * diff < query->best_distance)
+        kd_tree_nearest(query, mid + 1, hi, depth);
+
+      hi = mid;
+    }
+    else
+    {
+      if (diff * diff < query->best_distance)
+        kd_tree_nearest(query, lo, mid, depth);
+
+      lo = mid + 1;
+    }
+  }
+}
+
+static char *
+get_field(NavigationDataset *dataset, guint32 offset)
+{
+  offset = GUINT32_FROM_LE(offset);
+
+  if (!offset || offset >= dataset->strings_size)
+    return NULL;
+
+  return g_strdup(dataset->strings + offset);
+}
+
+NavigationAddress *
+navigation_dataset_lookup(NavigationDataset *dataset,
+                          const NavigationLocation *location,
+                          double max_distance)
+{
+  NavigationDatasetQuery query;
+  double limit;
+
+  g_return_val_if_fail(dataset != NULL, NULL);
+
+  if (max_distance < 0)
+    max_distance = dataset->max_distance;
+
+  limit = max_distance / METERS_PER_DEGREE * NAVIGATION_DATASET_PRECISION;
+
+  query.records = dataset->records;
+  query.latitude = location->latitude * NAVIGATION_DATASET_PRECISION;
+  query.longitude = location->longitude * NAVIGATION_DATASET_PRECISION;
+  query.scale = cos(location->latitude * G_PI / 180.0);
+  query.best = G_MAXUINT32;
+  query.best_distance = limit * limit;
+
+  kd_tree_nearest(&query, 0, dataset->n_records, 0);
+
+  if (query.best == G_MAXUINT32)
+    return NULL;
+
+  return navigation_dataset_get_address(dataset, query.best);
+}
+
+NavigationAddress *
+navigation_dataset_get_address(NavigationDataset *dataset, guint32 record_idx)
+{
+  const NavigationDatasetRecord *record;
+  NavigationAddress *address;
+
+  g_return_val_if_fail(dataset != NULL, NULL);
+  g_return_val_if_fail(record_idx < dataset->n_records, NULL);
+
+  record = &dataset->records[record_idx];
+  address = g_new0(NavigationAddress, 1);
+  address->house_num = get_field(dataset, record->fields[0]);
+  address->house_name = get_field(dataset, record->fields[1]);
+  address->street = get_field(dataset, record->fields[2]);
+  address->suburb = get_field(dataset, record->fields[3]);
+  address->town = get_field(dataset, record->fields[4]);
+  address->municipality = get_field(dataset, record->fields[5]);
+  address->province = get_field(dataset, record->fields[6]);
+  address->postal_code = get_field(dataset, record->fields[7]);
+  address->country = get_field(dataset, record->fields[8]);
+  address->country_code = get_field(dataset, record->fields[9]);
+  address->time_zone = get_field(dataset, record->fields[10]);
+
+  return address;
+}
+
+void
+navigation_dataset_get_location(NavigationDataset *dataset, guint32 record,
+                                NavigationLocation *location)
+{
+  g_return_if_fail(dataset != NULL);
+  g_return_if_fail(record < dataset->n_records);
+
+  location->latitude = (double)(gint32)GUINT32_FROM_LE(
+      dataset->records[record].latitude) / NAVIGATION_DATASET_PRECISION;
+  location->longitude = (double)(gint32)GUINT32_FROM_LE(
+      dataset->records[record].longitude) / NAVIGATION_DATASET_PRECISION;
+}
+
+gsize
+navigation_dataset_next_token(const gchar **text, gchar *token)
+{
+  const gchar *p = *text;
+  gsize len = 0;
+
+  while (*p && !g_unichar_isalnum(g_utf8_get_char(p)))
+    p = g_utf8_next_char(p);
+
+  while (*p)
+  {
+    gunichar c = g_utf8_get_char(p);
+    gunichar decomposition[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+
+    if (!g_unichar_isalnum(c))
+      break;
+
+    p = g_utf8_next_char(p);
+
+    /* drop accents and case, so "Élysée" matches "elysee" */
+    g_unichar_fully_decompose(c, FALSE, decomposition,
+                              G_N_ELEMENTS(decomposition));
+    c = g_unichar_tolower(decomposition[0]);
+
+    /* overlong tokens are cut, the same way on both sides */
+    if (len + 6 <= NAVIGATION_DATASET_MAX_TOKEN)
+      len += g_unichar_to_utf8(c, token + len);
+  }
+
+  token[len] = 0;
+  *text = p;
+
+  return len;
+}
+
+static gboolean
+read_varint(const guint8 **p, const guint8 *end, guint32 *v)
+{
+  guint shift = 0;
+
+  *v = 0;
+
+  while (*p < end && shift <= 28)
+  {
+    guint8 b = *(*p)++;
+
+    *v |= (guint32)(b & 0x7f) << shift;
+
+    if (!(b & 0x80))
+      return TRUE;
+
+    shift += 7;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+cursor_next(NavigationDataset *dataset, NavigationDatasetTokenCursor *cursor)
+{
+  guint prefix;
+  guint suffix;
+  guint32 start;
+  guint32 count;
+
+  if (cursor->end - cursor->p < 3)
+    return FALSE;
+
+  prefix = cursor->p[0];
+  suffix = cursor->p[1];
+  cursor->fields = cursor->p[2];
+  cursor->p += 3;
+
+  if (prefix > cursor->len || prefix + suffix > NAVIGATION_DATASET_MAX_TOKEN ||
+      (gsize)(cursor->end - cursor->p) < suffix)
+  {
+    return FALSE;
+  }
+
+  memcpy(cursor->token + prefix, cursor->p, suffix);
+  cursor->p += suffix;
+  cursor->len = prefix + suffix;
+  cursor->token[cursor->len] = 0;
+
+  if (!read_varint(&cursor->p, cursor->end, &start) ||
+      !read_varint(&cursor->p, cursor->end, &count) ||
+      start > dataset->n_postings || count > dataset->n_postings - start)
+  {
+    return FALSE;
+  }
+
+  cursor->postings.start = start;
+  cursor->postings.count = count;
+
+  return TRUE;
+}
+
+static gboolean
+cursor_seek(NavigationDataset *dataset, NavigationDatasetTokenCursor *cursor,
+            guint32 block)
+{
+  cursor->p = dataset->tokens + GUINT32_FROM_LE(dataset->blocks[block]);
+  cursor->end = dataset->tokens + dataset->tokens_size;
+  cursor->len = 0;
+
+  return cursor_next(dataset, cursor);
+}
+
+/* fills the posting lists of token, all tokens starting with it if prefix */
+static gboolean
+find_token(NavigationDataset *dataset, const gchar *token, gsize len,
+           gboolean prefix, NavigationDatasetQueryToken *qt)
+{
+  NavigationDatasetTokenCursor cursor;
+  guint32 lo = 0;
+  guint32 hi = n_blocks(dataset);
+
+  qt->fields = 0;
+  qt->n_lists = 0;
+  qt->n_postings = 0;
+
+  if (!hi)
+    return FALSE;
+
+  /* the last block starting before token, the first one if none does */
+  while (hi - lo > 1)
+  {
+    guint32 mid = lo + (hi - lo) / 2;
+
+    if (!cursor_seek(dataset, &cursor, mid))
+      return FALSE;
+
+    if (strcmp(cursor.token, token) < 0)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  if (!cursor_seek(dataset, &cursor, lo))
+    return FALSE;
+
+  do
+  {
+    int cmp = strcmp(cursor.token, token);
+
+    if (cmp < 0)
+      continue;
+
+    if (prefix ? strncmp(cursor.token, token, len) : cmp)
+      break;
+
+    qt->fields |= cursor.fields;
+    qt->lists[qt->n_lists++] = cursor.postings;
+    qt->n_postings += cursor.postings.count;
+
+    if (!prefix || qt->n_lists == MAX_PREFIX_TOKENS)
+      break;
+  }
+  while (cursor_next(dataset, &cursor));
+
+  return qt->n_lists != 0;
+}
+
+static guint
+field_weight(NavigationDatasetField field)
+{
+  switch (field)
+  {
+    case NAVIGATION_DATASET_FIELD_STREET:
+      return WEIGHT_STREET;
+    case NAVIGATION_DATASET_FIELD_TOWN:
+      return WEIGHT_TOWN;
+    case NAVIGATION_DATASET_FIELD_POSTAL_CODE:
+      return WEIGHT_POSTAL_CODE;
+    default:
+      return 1;
+  }
+}
+
+static guint
+match_weight(const NavigationDatasetQueryToken *qt,
+             NavigationDatasetField field)
+{
+  if (qt->field == NAVIGATION_DATASET_FIELD_ANY || qt->field == field)
+    return field_weight(field);
+
+  return 1;
+}
+
+/* the highest token_score() qt can have for any record */
+static guint
+max_token_score(const NavigationDatasetQueryToken *qt)
+{
+  guint score = 0;
+  NavigationDatasetField field;
+
+  for (field = 0; field < NAVIGATION_DATASET_FIELD_ANY; field++)
+  {
+    if (qt->fields & (1 << field) && match_weight(qt, field) > score)
+      score = match_weight(qt, field);
+  }
+
+  return score;
+}
+
+/* best weight of qt in any field of record, 0 if it does not match at all */
+static guint
+token_score(NavigationDataset *dataset, const NavigationDatasetQueryToken *qt,
+            guint32 record)
+{
+  guint32 key = record << 2;
+  guint score = 0;
+  guint i;
+
+  for (i = 0; i < qt->n_lists; i++)
+  {
+    const guint32 *postings = dataset->postings + qt->lists[i].start;
+    guint32 lo = 0;
+    guint32 hi = qt->lists[i].count;
+
+    while (lo < hi)
+    {
+      guint32 mid = lo + (hi - lo) / 2;
+
+      if (GUINT32_FROM_LE(postings[mid]) < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    for (; lo < qt->lists[i].count &&
+         GUINT32_FROM_LE(postings[lo]) >> 2 == record; lo++)
+    {
+      guint weight = match_weight(qt, GUINT32_FROM_LE(postings[lo]) & 3);
+
+      if (weight > score)
+        score = weight;
+    }
+  }
+
+  return score;
+}
+
+/* keeps matches sorted by descending score, a record at most once */
+static guint
+add_match(NavigationDatasetMatch *matches, guint n, guint max,
+          guint32 record, guint score)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+  {
+    if (matches[i].record == record)
+      return n;
+  }
+
+  if (n < max)
+    i = n++;
+  else if (score > matches[n - 1].score)
+    i = n - 1;
+  else
+    return n;
+
+  for (; i > 0 && matches[i - 1].score < score; i--)
+    matches[i] = matches[i - 1];
+
+  matches[i].record = record;
+  matches[i].score = score;
+
+  return n;
+}
+
+/* records matching all of tokens, ranked by the sum of their weights */
+static guint
+search(NavigationDataset *dataset, const NavigationDatasetQueryToken *tokens,
+       guint n_tokens, NavigationDatasetMatch *matches, guint n_matches)
+{
+  const NavigationDatasetQueryToken *driver = &tokens[0];
+  guint max_score = 0;
+  guint n = 0;
+  guint i;
+
+  if (!n_tokens || !n_matches)
+    return 0;
+
+  /* walk the shortest posting lists, look the others up */
+  for (i = 0; i < n_tokens; i++)
+  {
+    if (tokens[i].n_postings < driver->n_postings)
+      driver = &tokens[i];
+
+    max_score += max_token_score(&tokens[i]);
+  }
+
+  for (i = 0; i < driver->n_lists; i++)
+  {
+    const guint32 *postings = dataset->postings + driver->lists[i].start;
+    guint32 last = G_MAXUINT32;
+    guint32 j;
+
+    for (j = 0; j < driver->lists[i].count; j++)
+    {
+      guint32 record = GUINT32_FROM_LE(postings[j]) >> 2;
+      guint score = 0;
+      guint k;
+
+      /* a record is listed once per field it has the token in */
+      if (record == last || record >= dataset->n_records)
+        continue;
+
+      last = record;
+
+      for (k = 0; k < n_tokens; k++)
+      {
+        guint weight = token_score(dataset, &tokens[k], record);
+
+        if (!weight)
+          break;
+
+        score += weight;
+      }
+
+      if (k == n_tokens)
+      {
+        n = add_match(matches, n, n_matches, record, score);
+
+        /* nothing can rank higher, common prefixes stop early */
+        if (n == n_matches && matches[n - 1].score == max_score)
+          return n;
+      }
+    }
+  }
+
+  return n;
+}
+
+static gboolean
+add_field_tokens(NavigationDataset *dataset, const gchar *text,
+                 NavigationDatasetField field,
+                 NavigationDatasetQueryToken *tokens, guint *n_tokens)
+{
+  gchar token[NAVIGATION_DATASET_MAX_TOKEN + 1];
+  gsize len;
+
+  if (!text || !g_utf8_validate(text, -1, NULL))
+    return TRUE;
+
+  while (*n_tokens < MAX_QUERY_TOKENS &&
+         (len = navigation_dataset_next_token(&text, token)))
+  {
+    NavigationDatasetQueryToken *qt = &tokens[*n_tokens];
+
+    qt->field = field;
+
+    /* autocomplete, the last word of free text may still be typed */
+    if (!find_token(dataset, token, len,
+                    field == NAVIGATION_DATASET_FIELD_ANY && !*text, qt))
+    {
+      return FALSE;
+    }
+
+    (*n_tokens)++;
+  }
+
+  return TRUE;
+}
+
+guint
+navigation_dataset_search_address(NavigationDataset *dataset,
+                                  const NavigationAddress *address,
+                                  NavigationDatasetMatch *matches,
+                                  guint n_matches)
+{
+  NavigationDatasetQueryToken tokens[MAX_QUERY_TOKENS];
+  guint n_tokens = 0;
+
+  g_return_val_if_fail(dataset != NULL, 0);
+  g_return_val_if_fail(address != NULL, 0);
+
+  if (!add_field_tokens(dataset, address->street,
+                        NAVIGATION_DATASET_FIELD_STREET, tokens, &n_tokens) ||
+      !add_field_tokens(dataset, address->town,
+                        NAVIGATION_DATASET_FIELD_TOWN, tokens, &n_tokens) ||
+      !add_field_tokens(dataset, address->postal_code,
+                        NAVIGATION_DATASET_FIELD_POSTAL_CODE, tokens,
+                        &n_tokens))
+  {
+    return 0;
+  }
+
+  return search(dataset, tokens, n_tokens, matches, n_matches);
+}
+
+guint
+navigation_dataset_search_text(NavigationDataset *dataset, const gchar *text,
+                               NavigationDatasetMatch *matches,
+                               guint n_matches)
+{
+  NavigationDatasetQueryToken tokens[MAX_QUERY_TOKENS];
+  guint n_tokens = 0;
+
+  g_return_val_if_fail(dataset != NULL, 0);
+
+  if (!add_field_tokens(dataset, text, NAVIGATION_DATASET_FIELD_ANY, tokens,
+                        &n_tokens))
+  {
+    return 0;
+  }
+
+  return search(dataset, tokens, n_tokens, matches, n_matches);
+}
@@ -0,0 +1,145 @@
+/*
+ * navigation-dataset.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __NAVIGATION_DATASET_H__
+#define __NAVIGATION_DATASET_H__
+
+#include "navigation-provider.h"
+
+G_BEGIN_DECLS
+
+/*
+ * On-disk layout of an offline address dataset, all integers little endian:
+ *
+ *   NavigationDatasetHeader
+ *   NavigationDatasetRecord[n_records] at records_offset
+ *   NUL terminated strings at strings_offset, starting with an empty one
+ *
+ * Records form an implicit static k-d tree: the record in the middle of a
+ * range splits it, by latitude at even depth and by longitude at odd depth.
+ *
+ * Version 2 adds a token index for forward lookups:
+ *
+ *   guint32[(n_tokens + 15) / 16] at blocks_offset, the offset of every
+ *   block of 16 tokens relative to tokens_offset
+ *   tokens_size bytes of token entries at tokens_offset
+ *   guint32[n_postings] at postings_offset
+ *
+ * Tokens are normalized with navigation_dataset_next_token() and sorted
+ * bytewise. Each entry is
+ *
+ *   guint8 prefix length, guint8 suffix length, guint8 field mask, suffix,
+ *   varint first posting, varint number of postings
+ *
+ * where the prefix is shared with the previous token, 0 for the first token
+ * of a block, and bit 1 << field of the mask is set if any posting is in that
+ * field. Postings are sorted record index << 2 | field.
+ */
+
+#define NAVIGATION_DATASET_MAGIC "NAVDSET"
+#define NAVIGATION_DATASET_VERSION 2
+#define NAVIGATION_DATASET_N_FIELDS 11
+/* units of record coordinates per degree */
+#define NAVIGATION_DATASET_PRECISION 1000000
+#define NAVIGATION_DATASET_BLOCK_SIZE 16
+#define NAVIGATION_DATASET_MAX_TOKEN 255
+
+/* indexed fields, as stored in the low bits of postings */
+typedef enum {
+	NAVIGATION_DATASET_FIELD_STREET,
+	NAVIGATION_DATASET_FIELD_TOWN,
+	NAVIGATION_DATASET_FIELD_POSTAL_CODE,
+	NAVIGATION_DATASET_FIELD_ANY
+} NavigationDatasetField;
+
+typedef struct _NavigationDatasetHeader {
+	char    magic[8];
+	guint32 version;
+	guint32 n_records;
+	guint32 records_offset;
+	guint32 strings_offset;
+	guint32 strings_size;
+	/* lookups farther than this many meters from any record fail */
+	guint32 max_distance;
+	/* version 2 */
+	guint32 n_tokens;
+	guint32 blocks_offset;
+	guint32 tokens_offset;
+	guint32 tokens_size;
+	guint32 postings_offset;
+	guint32 n_postings;
+} NavigationDatasetHeader;
+
+/* version 1 files end the header after max_distance */
+#define NAVIGATION_DATASET_HEADER_V1_SIZE 32
+
+typedef struct _NavigationDatasetRecord {
+	gint32  latitude;
+	gint32  longitude;
+	/* string offsets in address_to_array() order, 0 means not set */
+	guint32 fields[NAVIGATION_DATASET_N_FIELDS];
+} NavigationDatasetRecord;
+
+typedef struct _NavigationDatasetMatch {
+	guint32 record;
+	guint   score;
+} NavigationDatasetMatch;
+
+typedef struct _NavigationDataset NavigationDataset;
+
+G_GNUC_INTERNAL
+NavigationDataset *navigation_dataset_open (const char *path,
+                                            GError    **error);
+
+G_GNUC_INTERNAL
+void navigation_dataset_free (NavigationDataset *dataset);
+
+G_GNUC_INTERNAL
+NavigationAddress *navigation_dataset_lookup (NavigationDataset        *dataset,
+                                              const NavigationLocation *location,
+                                              double                    max_distance);
+
+G_GNUC_INTERNAL
+gsize navigation_dataset_next_token (const gchar **text,
+                                     gchar        *token);
+
+G_GNUC_INTERNAL
+guint navigation_dataset_search_address (NavigationDataset       *dataset,
+                                         const NavigationAddress *address,
+                                         NavigationDatasetMatch  *matches,
+                                         guint                    n_matches);
+
+G_GNUC_INTERNAL
+guint navigation_dataset_search_text (NavigationDataset      *dataset,
+                                      const gchar            *text,
+                                      NavigationDatasetMatch *matches,
+                                      guint                   n_matches);
+
+G_GNUC_INTERNAL
+NavigationAddress *navigation_dataset_get_address (NavigationDataset *dataset,
+                                                   guint32            record);
+
+G_GNUC_INTERNAL
+void navigation_dataset_get_location (NavigationDataset  *dataset,
+                                      guint32             record,
+                                      NavigationLocation *location);
+
+G_END_DECLS
+
+#endif
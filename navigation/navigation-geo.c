@@ -0,0 +1,661 @@
+/*
+ * navigation-geo.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Batch geometry over structure-of-arrays coordinates. The kernels work on
+ * LANES points at once with GCC vector extensions, which map to SSE2, AVX or
+ * NEON registers, and use branch-free polynomials instead of libm so the
+ * whole haversine stays in vector registers. On x86-64 every kernel is
+ * also built for AVX2 and picked at load time.
+ *
+ * Tile math follows the web mercator grid of slippy maps, a tile key packs a
+ * tile and the map options that select its look into 64 bits.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "navigation-provider.h"
+#include "navigation-util.h"
+
+#define LANES 4
+
+/* mean earth radius in meters, the same as the provider uses */
+#define EARTH_RADIUS 6371008.8
+#define DEG_TO_RAD (G_PI / 180.0)
+
+#if defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define GEO_KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+
+#ifndef GEO_KERNEL
+#define GEO_KERNEL
+#endif
+
+/* tile keys, from the least significant bit: x, y, zoom, map options */
+#define TILE_COORD_BITS 24
+#define TILE_COORD_MASK ((G_GINT64_CONSTANT(1) << TILE_COORD_BITS) - 1)
+#define TILE_ZOOM_SHIFT (2 * TILE_COORD_BITS)
+#define TILE_ZOOM_MASK 0x1f
+#define TILE_OPTIONS_SHIFT (TILE_ZOOM_SHIFT + 5)
+#define TILE_OPTIONS (NAVIGATION_MAP_COLOUR_MASK | NAVIGATION_MAP_TYPE_MASK | \
+                      NAVIGATION_MAP_FORMAT_MASK)
+
+struct _NavigationGeoOrigin
+{
+  double latitude;
+  double longitude;
+  double cos_latitude;
+};
+
+typedef struct _NavigationGeoOrigin NavigationGeoOrigin;
+
+/* the kernels, defined with the vector code at the end of the file */
+static void GEO_KERNEL
+distances_kernel(const NavigationGeoOrigin *origin, const double *latitudes,
+                 const double *longitudes, guint n, double *distances);
+static guint GEO_KERNEL
+nearest_kernel(const NavigationGeoOrigin *origin, const double *latitudes,
+               const double *longitudes, guint n, double *haversine_out);
+static guint GEO_KERNEL
+area_contains_kernel(const NavigationArea *area, const double *latitudes,
+                     const double *longitudes, guint n, guint8 *inside);
+static void GEO_KERNEL
+tile_keys_kernel(const double *latitudes, const double *longitudes, guint n,
+                 int zoom, guint64 high, guint64 *keys);
+
+static void
+origin_init(NavigationGeoOrigin *origin, const NavigationLocation *from)
+{
+  origin->latitude = from->latitude * DEG_TO_RAD;
+  origin->longitude = from->longitude * DEG_TO_RAD;
+  origin->cos_latitude = cos(origin->latitude);
+}
+
+static inline guint64
+tile_key_high(int zoom, unsigned int map_options)
+{
+  return (guint64)(map_options & TILE_OPTIONS) << TILE_OPTIONS_SHIFT |
+         (guint64)zoom << TILE_ZOOM_SHIFT;
+}
+
+/* positions on the grid in units of tiles */
+static double
+longitude_to_tile_x(double longitude, int zoom)
+{
+  return (longitude + 180.0) / 360.0 * (1 << zoom);
+}
+
+static double
+latitude_to_tile_y(double latitude, int zoom)
+{
+  double s;
+
+  latitude = CLAMP(latitude, -NAVIGATION_MAX_LATITUDE,
+                   NAVIGATION_MAX_LATITUDE);
+  s = sin(latitude * DEG_TO_RAD);
+
+  return (0.5 - log((1.0 + s) / (1.0 - s)) / (4.0 * G_PI)) * (1 << zoom);
+}
+
+static double
+tile_x_to_longitude(double x, int zoom)
+{
+  return x / (1 << zoom) * 360.0 - 180.0;
+}
+
+static double
+tile_y_to_latitude(double y, int zoom)
+{
+  return atan(sinh(G_PI - 2.0 * G_PI * y / (1 << zoom))) / DEG_TO_RAD;
+}
+
+void
+navigation_geo_distances(const NavigationLocation *from,
+                         const double *latitudes, const double *longitudes,
+                         guint n, double *distances)
+{
+  NavigationGeoOrigin origin;
+
+  g_return_if_fail(from != NULL);
+  g_return_if_fail(n == 0 || (latitudes && longitudes && distances));
+
+  origin_init(&origin, from);
+  distances_kernel(&origin, latitudes, longitudes, n, distances);
+}
+
+guint
+navigation_geo_nearest(const NavigationLocation *from,
+                       const double *latitudes, const double *longitudes,
+                       guint n, double *distance)
+{
+  NavigationGeoOrigin origin;
+  double a;
+  guint nearest;
+
+  g_return_val_if_fail(from != NULL, G_MAXUINT);
+  g_return_val_if_fail(n == 0 || (latitudes && longitudes), G_MAXUINT);
+
+  origin_init(&origin, from);
+  nearest = nearest_kernel(&origin, latitudes, longitudes, n, &a);
+
+  if (distance && nearest != G_MAXUINT)
+    *distance = 2 * EARTH_RADIUS * asin(sqrt(a));
+
+  return nearest;
+}
+
+guint
+navigation_geo_area_contains(const NavigationArea *area,
+                             const double *latitudes,
+                             const double *longitudes, guint n,
+                             guint8 *inside)
+{
+  g_return_val_if_fail(area != NULL, 0);
+  g_return_val_if_fail(n == 0 || (latitudes && longitudes), 0);
+
+  return area_contains_kernel(area, latitudes, longitudes, n, inside);
+}
+
+void
+navigation_tile_from_location(const NavigationLocation *location, int zoom,
+                              NavigationTile *tile)
+{
+  guint64 key;
+
+  g_return_if_fail(location != NULL && tile != NULL);
+  g_return_if_fail(zoom >= 0 && zoom <= NAVIGATION_TILE_MAX_ZOOM);
+
+  /* the same arithmetic as the batch, so both agree on tile edges */
+  tile_keys_kernel(&location->latitude, &location->longitude, 1, zoom, 0,
+                   &key);
+  tile->x = key & TILE_COORD_MASK;
+  tile->y = (key >> TILE_COORD_BITS) & TILE_COORD_MASK;
+  tile->zoom = zoom;
+}
+
+void
+navigation_tile_get_area(const NavigationTile *tile, NavigationArea *area)
+{
+  g_return_if_fail(tile != NULL && area != NULL);
+  g_return_if_fail(tile->zoom >= 0 && tile->zoom <= NAVIGATION_TILE_MAX_ZOOM);
+
+  area->nw.latitude = tile_y_to_latitude(tile->y, tile->zoom);
+  area->nw.longitude = tile_x_to_longitude(tile->x, tile->zoom);
+  area->se.latitude = tile_y_to_latitude(tile->y + 1.0, tile->zoom);
+  area->se.longitude = tile_x_to_longitude(tile->x + 1.0, tile->zoom);
+}
+
+void
+navigation_tile_get_center(const NavigationTile *tile,
+                           NavigationLocation *location)
+{
+  g_return_if_fail(tile != NULL && location != NULL);
+  g_return_if_fail(tile->zoom >= 0 && tile->zoom <= NAVIGATION_TILE_MAX_ZOOM);
+
+  location->latitude = tile_y_to_latitude(tile->y + 0.5, tile->zoom);
+  location->longitude = tile_x_to_longitude(tile->x + 0.5, tile->zoom);
+}
+
+guint64
+navigation_tile_get_key(const NavigationTile *tile, unsigned int map_options)
+{
+  g_return_val_if_fail(tile != NULL, 0);
+  g_return_val_if_fail(
+    tile->zoom >= 0 && tile->zoom <= NAVIGATION_TILE_MAX_ZOOM, 0);
+  g_return_val_if_fail(tile->x >> tile->zoom == 0, 0);
+  g_return_val_if_fail(tile->y >> tile->zoom == 0, 0);
+
+  return tile_key_high(tile->zoom, map_options) |
+         (guint64)tile->y << TILE_COORD_BITS | tile->x;
+}
+
+unsigned int
+navigation_tile_from_key(guint64 key, NavigationTile *tile)
+{
+  g_return_val_if_fail(tile != NULL, 0);
+
+  tile->x = key & TILE_COORD_MASK;
+  tile->y = (key >> TILE_COORD_BITS) & TILE_COORD_MASK;
+  tile->zoom = (key >> TILE_ZOOM_SHIFT) & TILE_ZOOM_MASK;
+
+  return (key >> TILE_OPTIONS_SHIFT) & TILE_OPTIONS;
+}
+
+void
+navigation_tile_keys(const double *latitudes, const double *longitudes,
+                     guint n, int zoom, unsigned int map_options,
+                     guint64 *keys)
+{
+  g_return_if_fail(n == 0 || (latitudes && longitudes && keys));
+  g_return_if_fail(zoom >= 0 && zoom <= NAVIGATION_TILE_MAX_ZOOM);
+
+  tile_keys_kernel(latitudes, longitudes, n, zoom,
+                   tile_key_high(zoom, map_options), keys);
+}
+
+void
+navigation_map_snap_location(const NavigationLocation *location, int zoom,
+                             int map_width, int map_height,
+                             NavigationLocation *snapped)
+{
+  double x, y;
+
+  g_return_if_fail(location != NULL && snapped != NULL);
+  g_return_if_fail(zoom >= 0 && zoom <= NAVIGATION_TILE_MAX_ZOOM);
+
+  /* the northwest corner, in tiles */
+  x = longitude_to_tile_x(location->longitude, zoom) -
+    map_width / (2.0 * NAVIGATION_TILE_SIZE);
+  y = latitude_to_tile_y(location->latitude, zoom) -
+    map_height / (2.0 * NAVIGATION_TILE_SIZE);
+
+  x = round(x) + map_width / (2.0 * NAVIGATION_TILE_SIZE);
+  y = round(y) + map_height / (2.0 * NAVIGATION_TILE_SIZE);
+
+  snapped->latitude = tile_y_to_latitude(y, zoom);
+  snapped->longitude = tile_x_to_longitude(x, zoom);
+}
+
+/* No vector crosses a function boundary, so the warning about their calling
+ * convention does not apply. GCC reports it at the end of the translation
+ * unit, where a pop would already have turned it back on, so the vector
+ * code comes last and the pragma holds from here to the end. */
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/* the helpers take and return vectors, they must be part of every kernel
+ * clone, not calls between code built for different targets */
+#define GEO_INLINE inline __attribute__((always_inline))
+
+typedef double v4d __attribute__((vector_size(LANES * sizeof(double))));
+typedef gint64 v4l __attribute__((vector_size(LANES * sizeof(gint64))));
+
+#define SIGN_MASK G_GINT64_CONSTANT(0x7fffffffffffffff)
+
+/* 2^52 + 2^51, adding it to a double leaves the nearest integer in the low
+ * mantissa bits */
+#define ROUND_MAGIC 6755399441055744.0
+#define ROUND_MAGIC_BITS G_GINT64_CONSTANT(0x4338000000000000)
+
+/* Taylor series of sin(x), (-1)^n / (2n + 1)!, below 1e-17 for |x| <= pi / 2 */
+static const double sin_coefficients[] =
+{
+  1.0, -1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800,
+  1.0 / 6227020800.0, -1.0 / 1307674368000.0, 1.0 / 355687428096000.0,
+  -1.0 / 121645100408832000.0, 1.0 / 51090942171709440000.0
+};
+
+/* Taylor series of asin(x), (2n - 1)!! / ((2n)!! (2n + 1)), below 1e-14 for
+ * |x| <= 0.5 */
+static const double asin_coefficients[] =
+{
+  1.0, 0.16666666666666666, 0.075, 0.044642857142857144,
+  0.030381944444444444, 0.022372159090909092, 0.017352764423076924,
+  0.01396484375, 0.011551800896139705, 0.009761609529194078,
+  0.008390335809616815, 0.0073125258735988454, 0.006447210311889649,
+  0.005740037670841924, 0.005153309682319905, 0.004660143486915096,
+  0.004240907093679363, 0.003880964558837669, 0.0035692053938259347
+};
+
+/* Taylor series of atanh(t) / t, 1 / (2n + 1), below 1e-17 for
+ * |t| <= 3 - 2 sqrt(2) */
+static const double atanh_coefficients[] =
+{
+  1.0, 1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11, 1.0 / 13, 1.0 / 15,
+  1.0 / 17, 1.0 / 19, 1.0 / 21
+};
+
+static GEO_INLINE v4d
+splat(double d)
+{
+  return (v4d){ d, d, d, d };
+}
+
+static GEO_INLINE v4d
+load(const double *p)
+{
+  v4d v;
+
+  memcpy(&v, p, sizeof(v));
+
+  return v;
+}
+
+/* the first n of LANES values from p, the rest pad */
+static GEO_INLINE v4d
+load_partial(const double *p, guint n, double pad)
+{
+  double v[LANES] = { pad, pad, pad, pad };
+
+  memcpy(v, p, n * sizeof(double));
+
+  return load(v);
+}
+
+static GEO_INLINE v4d
+blend(v4l mask, v4d a, v4d b)
+{
+  return (v4d)(((v4l)a & mask) | ((v4l)b & ~mask));
+}
+
+static GEO_INLINE v4d
+vabs(v4d x)
+{
+  return (v4d)((v4l)x & SIGN_MASK);
+}
+
+/* 1 / sqrt(x) from the classic bit level estimate and four Newton steps,
+ * which reach full double precision, so sqrt stays in vector registers */
+static GEO_INLINE v4d
+vsqrt(v4d x)
+{
+  v4d y = (v4d)(G_GINT64_CONSTANT(0x5fe6eb50c7b537a9) - ((v4l)x >> 1));
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i < 4; i++)
+    y = y * (1.5 - 0.5 * x * y * y);
+
+  return x * y;
+}
+
+/* evaluates the polynomial in z as four interleaved Horner chains in z^4,
+ * a single chain would be bound by the latency of every step */
+static GEO_INLINE v4d
+polynomial(v4d z, const double *coefficients, int n)
+{
+  v4d z2 = z * z;
+  v4d z4 = z2 * z2;
+  v4d p[4];
+  int i;
+  int k;
+
+#pragma GCC unroll 4
+  for (k = 0; k < 4; k++)
+  {
+    p[k] = splat(0.0);
+
+#pragma GCC unroll 8
+    for (i = k + (n - 1 - k) / 4 * 4; i >= k; i -= 4)
+      p[k] = p[k] * z4 + coefficients[i];
+  }
+
+  return p[0] + z * p[1] + z2 * (p[2] + z * p[3]);
+}
+
+/* |x| <= pi / 2 */
+static GEO_INLINE v4d
+sin_half_pi(v4d x)
+{
+  return x * polynomial(x * x, sin_coefficients,
+                    G_N_ELEMENTS(sin_coefficients));
+}
+
+/* |x| <= pi, reflected into the range above */
+static GEO_INLINE v4d
+sin_pi(v4d x)
+{
+  v4d pi = (v4d)(((v4l)x & ~SIGN_MASK) | (v4l)splat(G_PI));
+
+  return sin_half_pi(blend(vabs(x) > G_PI / 2, pi - x, x));
+}
+
+/* |x| <= pi / 2 */
+static GEO_INLINE v4d
+cos_half_pi(v4d x)
+{
+  return sin_half_pi(G_PI / 2 - vabs(x));
+}
+
+/* asin(sqrt(a)) for 0 <= a <= 1, larger arguments are folded with
+ * asin(s) = pi / 2 - 2 asin(sqrt((1 - s) / 2)) */
+static GEO_INLINE v4d
+asin_sqrt(v4d a)
+{
+  v4l big = a > 0.25;
+  v4d s = vsqrt(a);
+  v4d t = blend(big, vsqrt((1.0 - s) * 0.5), s);
+  v4d p = t * polynomial(t * t, asin_coefficients,
+                     G_N_ELEMENTS(asin_coefficients));
+
+  return blend(big, G_PI / 2 - 2.0 * p, p);
+}
+
+/* x > 0, split into 2^e m with sqrt(1/2) <= m < sqrt(2), where
+ * ln(m) = 2 atanh((m - 1) / (m + 1)) */
+static GEO_INLINE v4d
+vlog(v4d x)
+{
+  v4l bits = (v4l)x;
+  v4l e = (bits >> 52) - 1023;
+  v4d m = (v4d)((bits & G_GINT64_CONSTANT(0x000fffffffffffff)) |
+                G_GINT64_CONSTANT(0x3ff0000000000000));
+  v4l big = m > G_SQRT2;
+  v4d t;
+
+  m = blend(big, m * 0.5, m);
+  e -= big;
+  t = (m - 1.0) / (m + 1.0);
+
+  return ((v4d)(e + ROUND_MAGIC_BITS) - ROUND_MAGIC) * G_LN2 +
+    2.0 * t * polynomial(t * t, atanh_coefficients,
+                         G_N_ELEMENTS(atanh_coefficients));
+}
+
+/* 0 <= x < 2^51 */
+static GEO_INLINE v4l
+vfloor(v4d x)
+{
+  v4d r = x + ROUND_MAGIC;
+
+  /* one less where x was rounded up */
+  return ((v4l)r - ROUND_MAGIC_BITS) + ((r - ROUND_MAGIC) > x);
+}
+
+static GEO_INLINE v4d
+vclamp(v4d x, double min, double max)
+{
+  return blend(x < min, splat(min), blend(x > max, splat(max), x));
+}
+
+/* the haversine of the central angle between origin and the points, a
+ * dimensionless value in [0, 1], clamped to 1 against rounding */
+static GEO_INLINE v4d
+haversine(const NavigationGeoOrigin *origin, v4d latitude, v4d longitude)
+{
+  v4d lat = latitude * DEG_TO_RAD;
+  v4d lon = longitude * DEG_TO_RAD;
+  v4d s_lat = sin_half_pi((lat - origin->latitude) * 0.5);
+  v4d s_lon = sin_pi((lon - origin->longitude) * 0.5);
+  v4d a = s_lat * s_lat + origin->cos_latitude * cos_half_pi(lat) *
+    s_lon * s_lon;
+
+  return blend(a > 1.0, splat(1.0), a);
+}
+
+static void GEO_KERNEL
+distances_kernel(const NavigationGeoOrigin *origin, const double *latitudes,
+                 const double *longitudes, guint n, double *distances)
+{
+  double from_latitude = origin->latitude / DEG_TO_RAD;
+  double from_longitude = origin->longitude / DEG_TO_RAD;
+  guint i;
+  v4d d;
+
+  for (i = 0; i + LANES <= n; i += LANES)
+  {
+    d = asin_sqrt(haversine(origin, load(latitudes + i),
+                            load(longitudes + i))) * (2 * EARTH_RADIUS);
+    memcpy(distances + i, &d, sizeof(d));
+  }
+
+  if (i < n)
+  {
+    d = asin_sqrt(haversine(
+          origin, load_partial(latitudes + i, n - i, from_latitude),
+          load_partial(longitudes + i, n - i, from_longitude))) *
+      (2 * EARTH_RADIUS);
+    memcpy(distances + i, &d, (n - i) * sizeof(double));
+  }
+}
+
+/* the haversine is monotonic in the distance, so only the winner needs the
+ * inverse */
+static guint GEO_KERNEL
+nearest_kernel(const NavigationGeoOrigin *origin, const double *latitudes,
+               const double *longitudes, guint n, double *haversine_out)
+{
+  double from_latitude = origin->latitude / DEG_TO_RAD;
+  double from_longitude = origin->longitude / DEG_TO_RAD;
+  v4d best = splat(HUGE_VAL);
+  v4l best_index = { -1, -1, -1, -1 };
+  v4l index = { 0, 1, 2, 3 };
+  guint nearest = G_MAXUINT;
+  double nearest_a = HUGE_VAL;
+  guint i;
+  int j;
+
+  for (i = 0; i + LANES <= n; i += LANES)
+  {
+    v4d a = haversine(origin, load(latitudes + i), load(longitudes + i));
+    v4l closer = a < best;
+
+    best = blend(closer, a, best);
+    best_index = (index & closer) | (best_index & ~closer);
+    index += LANES;
+  }
+
+  if (i < n)
+  {
+    v4d a = haversine(origin,
+                      load_partial(latitudes + i, n - i, from_latitude),
+                      load_partial(longitudes + i, n - i, from_longitude));
+    v4l closer = (a < best) & (index < (gint64)n);
+
+    best = blend(closer, a, best);
+    best_index = (index & closer) | (best_index & ~closer);
+  }
+
+  /* lanes hold the first of equally near points, keep the lowest index */
+  for (j = 0; j < LANES; j++)
+  {
+    if (best_index[j] >= 0 &&
+        (best[j] < nearest_a ||
+         (best[j] == nearest_a && (guint)best_index[j] < nearest)))
+    {
+      nearest_a = best[j];
+      nearest = best_index[j];
+    }
+  }
+
+  *haversine_out = nearest_a;
+
+  return nearest;
+}
+
+/* an area crossing the antimeridian has its west edge east of the east, wrap
+ * is all ones then */
+static GEO_INLINE v4l
+area_contains(const NavigationArea *area, v4l wrap, v4d lat, v4d lon)
+{
+  v4l after_west = lon >= area->nw.longitude;
+  v4l before_east = lon <= area->se.longitude;
+
+  return (lat <= area->nw.latitude) & (lat >= area->se.latitude) &
+         (((after_west & before_east) & ~wrap) |
+          ((after_west | before_east) & wrap));
+}
+
+static guint GEO_KERNEL
+area_contains_kernel(const NavigationArea *area, const double *latitudes,
+                     const double *longitudes, guint n, guint8 *inside)
+{
+  v4l wrap = (v4l){ 0, 0, 0, 0 } -
+    (gint64)(area->nw.longitude > area->se.longitude);
+  v4l count = { 0, 0, 0, 0 };
+  guint rv = 0;
+  guint i;
+  int j;
+
+  for (i = 0; i + LANES <= n; i += LANES)
+  {
+    v4l in = area_contains(area, wrap, load(latitudes + i),
+                           load(longitudes + i));
+
+    count -= in;
+
+    if (inside)
+    {
+      for (j = 0; j < LANES; j++)
+        inside[i + j] = in[j] & 1;
+    }
+  }
+
+  if (i < n)
+  {
+    /* the padding is north of any area */
+    v4l in = area_contains(area, wrap,
+                           load_partial(latitudes + i, n - i, G_MAXDOUBLE),
+                           load_partial(longitudes + i, n - i, 0.0));
+
+    count -= in;
+
+    if (inside)
+    {
+      for (j = 0; j < (int)(n - i); j++)
+        inside[i + j] = in[j] & 1;
+    }
+  }
+
+  for (j = 0; j < LANES; j++)
+    rv += count[j];
+
+  return rv;
+}
+
+static void GEO_KERNEL
+tile_keys_kernel(const double *latitudes, const double *longitudes, guint n,
+                 int zoom, guint64 high, guint64 *keys)
+{
+  double scale = (double)(1 << zoom);
+  guint i;
+
+  for (i = 0; i < n; i += LANES)
+  {
+    guint len = MIN(n - i, LANES);
+    v4d lat = vclamp(load_partial(latitudes + i, len, 0.0),
+                     -NAVIGATION_MAX_LATITUDE, NAVIGATION_MAX_LATITUDE);
+    v4d lon = load_partial(longitudes + i, len, 0.0);
+    v4d s = sin_half_pi(lat * DEG_TO_RAD);
+    v4d x = (lon + 180.0) * (scale / 360.0);
+    v4d y = (0.5 - vlog((1.0 + s) / (1.0 - s)) * (0.25 / G_PI)) * scale;
+    v4l key;
+
+    /* the east and south edges belong to the last tile */
+    x = vclamp(x, 0.0, scale - 1.0);
+    y = vclamp(y, 0.0, scale - 1.0);
+    key = (gint64)high | ((vfloor(y) & TILE_COORD_MASK) << TILE_COORD_BITS) |
+      (vfloor(x) & TILE_COORD_MASK);
+    memcpy(keys + i, &key, len * sizeof(guint64));
+  }
+}
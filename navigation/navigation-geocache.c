@@ -0,0 +1,697 @@
+/*
+ * navigation-geocache.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "navigation-geocache.h"
+#include "navigation-util.h"
+
+G_STATIC_ASSERT(sizeof(NavigationGeocacheHeader) == 12);
+G_STATIC_ASSERT(sizeof(NavigationGeocacheRecord) == 24);
+
+/* the CRC starts after size and crc */
+#define CRC_OFFSET 8
+#define MAX_PAYLOAD_SIZE 65536
+
+/* newest record of a key, keyed by the hash of type and key */
+struct _NavigationGeocacheEntry
+{
+  guint64 hash;
+  guint64 offset;
+  gint64 expires;
+  guint32 size;
+};
+
+typedef struct _NavigationGeocacheEntry NavigationGeocacheEntry;
+
+struct _NavigationGeocache
+{
+  GMutex lock;
+  gchar *path;
+  int fd;
+  guint64 size;
+  gsize max_size;
+  GHashTable *index;
+};
+
+static guint32 crc_table[256];
+
+static gpointer
+init_crc_table(gpointer data)
+{
+  guint32 i;
+
+  for (i = 0; i < 256; i++)
+  {
+    guint32 c = i;
+    int k;
+
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+
+    crc_table[i] = c;
+  }
+
+  return NULL;
+}
+
+/* CRC-32 as used by zlib */
+static guint32
+crc32(const guint8 *data, gsize len)
+{
+  static GOnce once = G_ONCE_INIT;
+  guint32 crc = 0xffffffff;
+
+  g_once(&once, init_crc_table, NULL);
+
+  while (len--)
+    crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+  return crc ^ 0xffffffff;
+}
+
+/* 64 bit FNV-1a of type and key */
+static guint64
+hash_key(NavigationGeocacheType type, const gchar *key)
+{
+  guint64 hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+
+  hash = (hash ^ type) * G_GUINT64_CONSTANT(0x100000001b3);
+
+  for (; *key; key++)
+    hash = (hash ^ (guchar)*key) * G_GUINT64_CONSTANT(0x100000001b3);
+
+  return hash;
+}
+
+static gboolean
+read_all(int fd, gpointer buf, gsize len, guint64 offset)
+{
+  while (len)
+  {
+    gssize n = pread(fd, buf, len, offset);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return FALSE;
+
+    buf = (guint8 *)buf + n;
+    len -= n;
+    offset += n;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+write_all(int fd, gconstpointer buf, gsize len, guint64 offset)
+{
+  while (len)
+  {
+    gssize n = pwrite(fd, buf, len, offset);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return FALSE;
+
+    buf = (const guint8 *)buf + n;
+    len -= n;
+    offset += n;
+  }
+
+  return TRUE;
+}
+
+/* makes a rename into the directory of path durable */
+static gboolean
+sync_dir(const gchar *path)
+{
+  gchar *dir = g_path_get_dirname(path);
+  int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  gboolean rv = fd >= 0 && !fsync(fd);
+  int saved_errno = errno;
+
+  if (fd >= 0)
+    close(fd);
+
+  g_free(dir);
+  errno = saved_errno;
+
+  return rv;
+}
+
+/* Checks the record at data, which has len bytes left. Returns its total
+ * size, or 0 if it is cut short or corrupt. */
+static gsize
+check_record(const guint8 *data, gsize len)
+{
+  const NavigationGeocacheRecord *record =
+    (const NavigationGeocacheRecord *)data;
+  gsize size;
+
+  if (len < sizeof(*record))
+    return 0;
+
+  size = GUINT32_FROM_LE(record->size);
+
+  if (size > MAX_PAYLOAD_SIZE || size > len - sizeof(*record) ||
+      GUINT16_FROM_LE(record->key_size) > size ||
+      crc32(data + CRC_OFFSET, sizeof(*record) - CRC_OFFSET + size) !=
+      GUINT32_FROM_LE(record->crc))
+  {
+    return 0;
+  }
+
+  return sizeof(*record) + size;
+}
+
+static void
+index_add(NavigationGeocache *cache, guint64 hash, guint64 offset,
+          gint64 expires, gsize size)
+{
+  NavigationGeocacheEntry *entry = g_new(NavigationGeocacheEntry, 1);
+
+  entry->hash = hash;
+  entry->offset = offset;
+  entry->expires = expires;
+  entry->size = size;
+  g_hash_table_replace(cache->index, &entry->hash, entry);
+}
+
+/* Builds the index from the log and truncates it after the last intact
+ * record. */
+static gboolean
+scan_log(NavigationGeocache *cache, GError **error)
+{
+  GMappedFile *file = g_mapped_file_new_from_fd(cache->fd, FALSE, error);
+  const guint8 *data;
+  gsize len;
+  gsize offset = sizeof(NavigationGeocacheHeader);
+  NavigationGeocacheHeader header;
+
+  if (!file)
+    return FALSE;
+
+  data = (const guint8 *)g_mapped_file_get_contents(file);
+  len = g_mapped_file_get_length(file);
+
+  if (len < sizeof(header))
+  {
+    /* new, or the header itself was never completely written */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NAVIGATION_GEOCACHE_MAGIC,
+           sizeof(NAVIGATION_GEOCACHE_MAGIC));
+    header.version = GUINT32_TO_LE(NAVIGATION_GEOCACHE_VERSION);
+    g_mapped_file_unref(file);
+
+    if (ftruncate(cache->fd, 0) ||
+        !write_all(cache->fd, &header, sizeof(header), 0))
+    {
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                  "Unable to write %s: %s", cache->path, g_strerror(errno));
+      return FALSE;
+    }
+
+    cache->size = sizeof(header);
+
+    return TRUE;
+  }
+
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, NAVIGATION_GEOCACHE_MAGIC,
+             sizeof(NAVIGATION_GEOCACHE_MAGIC)) ||
+      GUINT32_FROM_LE(header.version) != NAVIGATION_GEOCACHE_VERSION)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                "%s is not a geocode cache of version %d", cache->path,
+                NAVIGATION_GEOCACHE_VERSION);
+    g_mapped_file_unref(file);
+
+    return FALSE;
+  }
+
+  while (offset < len)
+  {
+    const NavigationGeocacheRecord *record =
+      (const NavigationGeocacheRecord *)(data + offset);
+    gsize size = check_record(data + offset, len - offset);
+    gchar *key;
+
+    if (!size)
+    {
+      g_debug("Geocode cache %s truncated at %" G_GSIZE_FORMAT " of %"
+              G_GSIZE_FORMAT " bytes", cache->path, offset, len);
+      break;
+    }
+
+    key = g_strndup((const gchar *)(record + 1),
+                    GUINT16_FROM_LE(record->key_size));
+    index_add(cache, hash_key(record->type, key), offset,
+              GINT64_FROM_LE(record->expires), size);
+    g_free(key);
+    offset += size;
+  }
+
+  g_mapped_file_unref(file);
+
+  if (offset < len && ftruncate(cache->fd, offset))
+  {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Unable to truncate %s: %s", cache->path, g_strerror(errno));
+    return FALSE;
+  }
+
+  cache->size = offset;
+
+  return TRUE;
+}
+
+NavigationGeocache *
+navigation_geocache_open(const char *path, gsize max_size, GError **error)
+{
+  NavigationGeocache *cache;
+  gchar *tmp_path;
+
+  g_return_val_if_fail(path != NULL, NULL);
+
+  cache = g_new0(NavigationGeocache, 1);
+  g_mutex_init(&cache->lock);
+  cache->path = g_strdup(path);
+  cache->max_size = MAX(max_size, sizeof(NavigationGeocacheHeader));
+  cache->index = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                       g_free);
+  cache->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+  if (cache->fd < 0)
+  {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Unable to open %s: %s", path, g_strerror(errno));
+    navigation_geocache_free(cache);
+
+    return NULL;
+  }
+
+  /* a second writer would corrupt the index of the first one */
+  if (flock(cache->fd, LOCK_EX | LOCK_NB))
+  {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "%s is in use by another process", path);
+    navigation_geocache_free(cache);
+
+    return NULL;
+  }
+
+  /* left behind by a crash while compacting, the log is still intact */
+  tmp_path = g_strconcat(path, ".tmp", NULL);
+  g_unlink(tmp_path);
+  g_free(tmp_path);
+
+  if (!scan_log(cache, error))
+  {
+    navigation_geocache_free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+void
+navigation_geocache_free(NavigationGeocache *cache)
+{
+  if (cache)
+  {
+    if (cache->fd >= 0)
+      close(cache->fd);
+
+    g_hash_table_destroy(cache->index);
+    g_mutex_clear(&cache->lock);
+    g_free(cache->path);
+    g_free(cache);
+  }
+}
+
+static gchar *
+get_string(const gchar **p, const gchar *end)
+{
+  const gchar *s = *p;
+  gsize len;
+
+  if (s >= end)
+    return NULL;
+
+  len = strnlen(s, end - s);
+  *p = s + len + 1;
+
+  return len ? g_strndup(s, len) : NULL;
+}
+
+static gpointer
+parse_value(NavigationGeocacheType type, const gchar *value, gsize len)
+{
+  const gchar *end = value + len;
+
+  if (type == NAVIGATION_GEOCACHE_LOCATION)
+  {
+    NavigationLocation *location;
+    guint64 bits[2];
+
+    if (len != sizeof(bits))
+      return NULL;
+
+    memcpy(bits, value, sizeof(bits));
+    bits[0] = GUINT64_FROM_LE(bits[0]);
+    bits[1] = GUINT64_FROM_LE(bits[1]);
+    location = g_new(NavigationLocation, 1);
+    memcpy(&location->latitude, &bits[0], sizeof(double));
+    memcpy(&location->longitude, &bits[1], sizeof(double));
+
+    return location;
+  }
+  else
+  {
+    NavigationAddress *address = g_new0(NavigationAddress, 1);
+
+    address->house_num = get_string(&value, end);
+    address->house_name = get_string(&value, end);
+    address->street = get_string(&value, end);
+    address->suburb = get_string(&value, end);
+    address->town = get_string(&value, end);
+    address->municipality = get_string(&value, end);
+    address->province = get_string(&value, end);
+    address->postal_code = get_string(&value, end);
+    address->country = get_string(&value, end);
+    address->country_code = get_string(&value, end);
+    address->time_zone = get_string(&value, end);
+
+    return address;
+  }
+}
+
+gboolean
+navigation_geocache_lookup(NavigationGeocache *cache,
+                           NavigationGeocacheType type, const gchar *key,
+                           gpointer *result)
+{
+  NavigationGeocacheEntry *entry;
+  guint64 hash = hash_key(type, key);
+  NavigationGeocacheRecord record;
+  guint8 *data = NULL;
+  gsize key_size = strlen(key);
+  gsize size;
+  gboolean hit = FALSE;
+
+  g_return_val_if_fail(cache != NULL, FALSE);
+  g_return_val_if_fail(result != NULL, FALSE);
+
+  g_mutex_lock(&cache->lock);
+
+  entry = g_hash_table_lookup(cache->index, &hash);
+
+  if (!entry)
+    goto out;
+
+  if (g_get_real_time() >= entry->expires)
+  {
+    g_hash_table_remove(cache->index, &hash);
+    goto out;
+  }
+
+  /* checked again, the file may have been damaged since it was opened */
+  if (!read_all(cache->fd, &record, sizeof(record), entry->offset))
+    goto out;
+
+  size = GUINT32_FROM_LE(record.size);
+
+  if (size > MAX_PAYLOAD_SIZE)
+    goto out;
+
+  data = g_malloc(sizeof(record) + size);
+  memcpy(data, &record, sizeof(record));
+
+  if (!read_all(cache->fd, data + sizeof(record), size,
+                entry->offset + sizeof(record)) ||
+      !check_record(data, sizeof(record) + size) ||
+      record.type != type || GUINT16_FROM_LE(record.key_size) != key_size ||
+      memcmp(data + sizeof(record), key, key_size))
+  {
+    goto out;
+  }
+
+  *result = record.found ?
+    parse_value(type, (const gchar *)data + sizeof(record) + key_size,
+                size - key_size) : NULL;
+  hit = !record.found || *result;
+
+out:
+  g_mutex_unlock(&cache->lock);
+  g_free(data);
+
+  return hit;
+}
+
+static int
+compare_entries(gconstpointer a, gconstpointer b)
+{
+  const NavigationGeocacheEntry *x = *(NavigationGeocacheEntry * const *)a;
+  const NavigationGeocacheEntry *y = *(NavigationGeocacheEntry * const *)b;
+
+  return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/* Rewrites the log with the newest live records that fit in half the size
+ * limit, so that it is not compacted again right away. */
+static void
+compact_locked(NavigationGeocache *cache)
+{
+  NavigationGeocacheHeader header;
+  GHashTableIter iter;
+  NavigationGeocacheEntry *entry;
+  GPtrArray *entries = g_ptr_array_new();
+  gchar *tmp_path = g_strconcat(cache->path, ".tmp", NULL);
+  gint64 now = g_get_real_time();
+  guint64 size;
+  guint8 *buf = g_malloc(sizeof(NavigationGeocacheRecord) + MAX_PAYLOAD_SIZE);
+  int fd;
+  guint start;
+  guint i;
+
+  g_hash_table_iter_init(&iter, cache->index);
+
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry))
+  {
+    if (now < entry->expires)
+      g_ptr_array_add(entries, entry);
+    else
+      g_hash_table_iter_remove(&iter);
+  }
+
+  g_ptr_array_sort(entries, compare_entries);
+  fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+  if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB))
+    goto fail;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NAVIGATION_GEOCACHE_MAGIC,
+         sizeof(NAVIGATION_GEOCACHE_MAGIC));
+  header.version = GUINT32_TO_LE(NAVIGATION_GEOCACHE_VERSION);
+
+  if (!write_all(fd, &header, sizeof(header), 0))
+    goto fail;
+
+  size = sizeof(header);
+
+  /* records are appended in time order, keep the newest */
+  for (i = entries->len; i > 0; i--)
+  {
+    entry = g_ptr_array_index(entries, i - 1);
+
+    if (size + entry->size > cache->max_size / 2)
+      break;
+
+    size += entry->size;
+  }
+
+  size = sizeof(header);
+
+  for (start = i; i < entries->len; i++)
+  {
+    NavigationGeocacheRecord *record = (NavigationGeocacheRecord *)buf;
+
+    entry = g_ptr_array_index(entries, i);
+
+    if (entry->size > sizeof(*record) + MAX_PAYLOAD_SIZE ||
+        !read_all(cache->fd, buf, entry->size, entry->offset) ||
+        check_record(buf, entry->size) != entry->size)
+    {
+      g_hash_table_remove(cache->index, &entry->hash);
+      continue;
+    }
+
+    if (!write_all(fd, buf, entry->size, size))
+      goto fail;
+
+    entry->offset = size;
+    size += entry->size;
+  }
+
+  for (i = 0; i < start; i++)
+  {
+    entry = g_ptr_array_index(entries, i);
+    g_hash_table_remove(cache->index, &entry->hash);
+  }
+
+  /* the new log must be complete on disk before it replaces the old one */
+  if (fsync(fd) || g_rename(tmp_path, cache->path))
+    goto fail;
+
+  /* the new log is in place either way, only a crash could bring back the
+   * old one */
+  if (!sync_dir(cache->path))
+  {
+    g_warning("Unable to sync the directory of geocode cache %s: %s",
+              cache->path, g_strerror(errno));
+  }
+
+  close(cache->fd);
+  cache->fd = fd;
+  cache->size = size;
+  goto out;
+
+fail:
+  g_warning("Unable to compact geocode cache %s: %s", cache->path,
+            g_strerror(errno));
+
+  if (fd >= 0)
+  {
+    close(fd);
+    g_unlink(tmp_path);
+  }
+
+  /* the offsets of the entries written so far are wrong now */
+  g_hash_table_remove_all(cache->index);
+  cache->size = 0;
+  scan_log(cache, NULL);
+
+out:
+  g_ptr_array_free(entries, TRUE);
+  g_free(tmp_path);
+  g_free(buf);
+}
+
+void
+navigation_geocache_store(NavigationGeocache *cache,
+                          NavigationGeocacheType type, const gchar *key,
+                          gconstpointer result, gint64 ttl)
+{
+  NavigationGeocacheRecord record;
+  GByteArray *data;
+  gsize key_size = strlen(key);
+
+  g_return_if_fail(cache != NULL);
+
+  if (ttl <= 0 || key_size > G_MAXUINT16)
+    return;
+
+  data = g_byte_array_sized_new(sizeof(record) + key_size);
+  g_byte_array_set_size(data, sizeof(record));
+  g_byte_array_append(data, (const guint8 *)key, key_size);
+
+  if (result && type == NAVIGATION_GEOCACHE_LOCATION)
+  {
+    const NavigationLocation *location = result;
+    guint64 bits[2];
+
+    memcpy(&bits[0], &location->latitude, sizeof(double));
+    memcpy(&bits[1], &location->longitude, sizeof(double));
+    bits[0] = GUINT64_TO_LE(bits[0]);
+    bits[1] = GUINT64_TO_LE(bits[1]);
+    g_byte_array_append(data, (const guint8 *)bits, sizeof(bits));
+  }
+  else if (result)
+  {
+    gchar **array = address_to_array(result);
+    int i;
+
+    for (i = 0; i < NAVIGATION_N_ADDRESS_FIELDS; i++)
+    {
+      g_byte_array_append(data, (const guint8 *)array[i],
+                          strlen(array[i]) + 1);
+    }
+
+    g_strfreev(array);
+  }
+
+  if (data->len - sizeof(record) > MAX_PAYLOAD_SIZE)
+  {
+    g_byte_array_free(data, TRUE);
+    return;
+  }
+
+  memset(&record, 0, sizeof(record));
+  record.size = GUINT32_TO_LE(data->len - sizeof(record));
+  record.expires = GINT64_TO_LE(g_get_real_time() + ttl);
+  record.type = type;
+  record.found = result != NULL;
+  record.key_size = GUINT16_TO_LE(key_size);
+  memcpy(data->data, &record, sizeof(record));
+
+  record.crc = GUINT32_TO_LE(crc32(data->data + CRC_OFFSET,
+                                   data->len - CRC_OFFSET));
+  memcpy(data->data, &record, sizeof(record));
+
+  g_mutex_lock(&cache->lock);
+
+  if (write_all(cache->fd, data->data, data->len, cache->size))
+  {
+    index_add(cache, hash_key(type, key), cache->size,
+              GINT64_FROM_LE(record.expires), data->len);
+    cache->size += data->len;
+
+    if (cache->size > cache->max_size)
+      compact_locked(cache);
+  }
+  else
+  {
+    g_warning("Unable to write geocode cache %s: %s", cache->path,
+              g_strerror(errno));
+
+    /* drop whatever part made it, the next record goes in its place */
+    if (ftruncate(cache->fd, cache->size))
+      g_warning("Unable to truncate %s", cache->path);
+  }
+
+  g_mutex_unlock(&cache->lock);
+  g_byte_array_free(data, TRUE);
+}
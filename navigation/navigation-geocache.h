@@ -0,0 +1,96 @@
+/*
+ * navigation-geocache.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __NAVIGATION_GEOCACHE_H__
+#define __NAVIGATION_GEOCACHE_H__
+
+#include "navigation-provider.h"
+
+G_BEGIN_DECLS
+
+/*
+ * On-disk layout of the persistent geocode cache, an append-only log with all
+ * integers little endian:
+ *
+ *   NavigationGeocacheHeader
+ *   NavigationGeocacheRecord followed by size bytes of payload, repeated
+ *
+ * The payload is the key, then the value if the record is found: latitude
+ * and longitude as IEEE doubles for locations, or the address_to_array()
+ * fields up to the time zone as NUL terminated strings for addresses.
+ *
+ * The CRC covers the record from expires to the end of the payload. A record
+ * that is cut short or fails the check ends the log, it is truncated there
+ * when opened, so a crash while appending loses at most the last record.
+ * Later records of a key replace earlier ones. The log is rewritten with
+ * only the newest live records once it exceeds its size limit, into a new
+ * file renamed over the old one.
+ */
+
+#define NAVIGATION_GEOCACHE_MAGIC "NAVGEOC"
+#define NAVIGATION_GEOCACHE_VERSION 1
+
+typedef enum {
+	NAVIGATION_GEOCACHE_LOCATION,
+	NAVIGATION_GEOCACHE_ADDRESS
+} NavigationGeocacheType;
+
+typedef struct _NavigationGeocacheHeader {
+	char    magic[8];
+	guint32 version;
+} NavigationGeocacheHeader;
+
+typedef struct _NavigationGeocacheRecord {
+	guint32 size;
+	guint32 crc;
+	/* wall clock time in microseconds the record is valid until */
+	gint64  expires;
+	guint8  type;
+	/* 0 for addresses the provider found no location for */
+	guint8  found;
+	guint16 key_size;
+	guint32 reserved;
+} NavigationGeocacheRecord;
+
+typedef struct _NavigationGeocache NavigationGeocache;
+
+G_GNUC_INTERNAL
+NavigationGeocache *navigation_geocache_open (const char *path,
+                                              gsize       max_size,
+                                              GError    **error);
+
+G_GNUC_INTERNAL
+void navigation_geocache_free (NavigationGeocache *cache);
+
+G_GNUC_INTERNAL
+gboolean navigation_geocache_lookup (NavigationGeocache    *cache,
+                                     NavigationGeocacheType type,
+                                     const gchar           *key,
+                                     gpointer              *result);
+
+G_GNUC_INTERNAL
+void navigation_geocache_store (NavigationGeocache    *cache,
+                                NavigationGeocacheType type,
+                                const gchar           *key,
+                                gconstpointer          result,
+                                gint64                 ttl);
+
+G_END_DECLS
+
+#endif
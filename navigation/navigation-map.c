@@ -0,0 +1,524 @@
+/*
+ * navigation-map.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include "navigation-provider.h"
+#include "navigation-util.h"
+
+/* tiles follow the usual web mercator grid, so they can be reused between
+ * maps that overlap */
+#define TILE_SIZE NAVIGATION_TILE_SIZE
+#define MAX_ZOOM 20
+
+/* leave one slot of the provider request limit for everybody else */
+#define MAX_TILES_IN_FLIGHT 4
+#define TILE_CACHE_SIZE 64
+#define RETRY_INTERVAL 100
+
+#define TILE_CACHE_KEY "navigation-map-tile-cache"
+
+struct _NavigationMapCachedTile
+{
+  guint64 key;
+  GBytes *tile;
+  NavigationArea area;
+  GList *link;
+};
+
+typedef struct _NavigationMapCachedTile NavigationMapCachedTile;
+
+struct _NavigationMapTileCache
+{
+  GMutex lock;
+  GHashTable *tiles;
+  /* most recently used first */
+  GQueue lru;
+};
+
+typedef struct _NavigationMapTileCache NavigationMapTileCache;
+
+struct _NavigationMapRequest
+{
+  NavigationProvider *provider;
+  NavigationMapTileCache *cache;
+  GMainContext *context;
+  NavigationMap map;
+  int zoom;
+  unsigned int map_options;
+  /* tiles are requested from callbacks, with the class of the map */
+  NavigationPriority priority;
+  GdkPixbuf *pixbuf;
+  /* world pixel coordinates of the map nw corner and the scale to map
+   * pixels */
+  double x;
+  double y;
+  double scale_x;
+  double scale_y;
+  GQueue pending;
+  guint in_flight;
+  guint n_done;
+  guint n_total;
+  guint n_failed;
+  guint retry_id;
+  GError *error;
+  NavigationProviderMapProgressCallback progress_cb;
+  NavigationProviderMapCallback cb;
+  gpointer user_data;
+};
+
+typedef struct _NavigationMapRequest NavigationMapRequest;
+
+struct _NavigationMapTile
+{
+  NavigationMapRequest *request;
+  int x;
+  int y;
+};
+
+typedef struct _NavigationMapTile NavigationMapTile;
+
+static double
+longitude_to_x(double longitude, int zoom)
+{
+  return (longitude + 180.0) / 360.0 * ((double)TILE_SIZE * (1 << zoom));
+}
+
+static double
+latitude_to_y(double latitude, int zoom)
+{
+  double s;
+
+  latitude = CLAMP(latitude, -NAVIGATION_MAX_LATITUDE,
+                   NAVIGATION_MAX_LATITUDE);
+  s = sin(latitude * G_PI / 180.0);
+
+  return (0.5 - log((1.0 + s) / (1.0 - s)) / (4.0 * G_PI)) *
+         ((double)TILE_SIZE * (1 << zoom));
+}
+
+static void
+cached_tile_free(NavigationMapCachedTile *cached)
+{
+  g_bytes_unref(cached->tile);
+  g_free(cached);
+}
+
+static void
+tile_cache_free(NavigationMapTileCache *cache)
+{
+  g_hash_table_destroy(cache->tiles);
+  g_queue_clear(&cache->lru);
+  g_mutex_clear(&cache->lock);
+  g_free(cache);
+}
+
+static NavigationMapTileCache *
+tile_cache_get(NavigationProvider *provider)
+{
+  G_LOCK_DEFINE_STATIC(tile_cache);
+  NavigationMapTileCache *cache;
+
+  G_LOCK(tile_cache);
+
+  cache = g_object_get_data(G_OBJECT(provider), TILE_CACHE_KEY);
+
+  if (!cache)
+  {
+    cache = g_new0(NavigationMapTileCache, 1);
+    g_mutex_init(&cache->lock);
+    cache->tiles = g_hash_table_new_full(
+        (GHashFunc)&g_int64_hash, (GEqualFunc)&g_int64_equal, NULL,
+        (GDestroyNotify)&cached_tile_free);
+    g_queue_init(&cache->lru);
+    g_object_set_data_full(G_OBJECT(provider), TILE_CACHE_KEY, cache,
+                           (GDestroyNotify)tile_cache_free);
+  }
+
+  G_UNLOCK(tile_cache);
+
+  return cache;
+}
+
+static void
+tile_get(NavigationMapTile *tile, NavigationTile *t)
+{
+  t->x = tile->x;
+  t->y = tile->y;
+  t->zoom = tile->request->zoom;
+}
+
+static guint64
+tile_cache_key(NavigationMapTile *tile)
+{
+  NavigationTile t;
+
+  tile_get(tile, &t);
+
+  return navigation_tile_get_key(&t, tile->request->map_options);
+}
+
+static GBytes *
+tile_cache_lookup(NavigationMapTileCache *cache, NavigationMapTile *tile,
+                  NavigationArea *area)
+{
+  NavigationMapCachedTile *cached;
+  GBytes *rv = NULL;
+  guint64 key = tile_cache_key(tile);
+
+  g_mutex_lock(&cache->lock);
+
+  cached = g_hash_table_lookup(cache->tiles, &key);
+
+  if (cached)
+  {
+    g_queue_unlink(&cache->lru, cached->link);
+    g_queue_push_head_link(&cache->lru, cached->link);
+    *area = cached->area;
+    rv = g_bytes_ref(cached->tile);
+  }
+
+  g_mutex_unlock(&cache->lock);
+
+  return rv;
+}
+
+static void
+tile_cache_insert(NavigationMapTileCache *cache, NavigationMapTile *tile,
+                  GBytes *bytes, const NavigationArea *area)
+{
+  NavigationMapCachedTile *cached = g_new(NavigationMapCachedTile, 1);
+  NavigationMapCachedTile *old;
+
+  cached->key = tile_cache_key(tile);
+  cached->tile = g_bytes_ref(bytes);
+  cached->area = *area;
+
+  g_mutex_lock(&cache->lock);
+
+  if ((old = g_hash_table_lookup(cache->tiles, &cached->key)))
+  {
+    g_queue_delete_link(&cache->lru, old->link);
+    g_hash_table_remove(cache->tiles, &cached->key);
+  }
+
+  g_queue_push_head(&cache->lru, cached);
+  cached->link = cache->lru.head;
+  g_hash_table_insert(cache->tiles, &cached->key, cached);
+
+  while (g_queue_get_length(&cache->lru) > TILE_CACHE_SIZE)
+  {
+    NavigationMapCachedTile *last = g_queue_pop_tail(&cache->lru);
+
+    g_hash_table_remove(cache->tiles, &last->key);
+  }
+
+  g_mutex_unlock(&cache->lock);
+}
+
+static void
+navigation_map_request_blit(NavigationMapRequest *request, GBytes *bytes,
+                            const NavigationArea *area)
+{
+  GdkPixbuf *pixbuf = navigation_map_tile_decode(bytes, NULL);
+  double x0, y0, x1, y1;
+  int dest_x, dest_y, dest_w, dest_h;
+
+  if (!pixbuf)
+  {
+    request->n_failed++;
+    return;
+  }
+
+  /* where the tile lands on the map */
+  x0 = (longitude_to_x(area->nw.longitude, request->zoom) - request->x) *
+    request->scale_x;
+  y0 = (latitude_to_y(area->nw.latitude, request->zoom) - request->y) *
+    request->scale_y;
+  x1 = (longitude_to_x(area->se.longitude, request->zoom) - request->x) *
+    request->scale_x;
+  y1 = (latitude_to_y(area->se.latitude, request->zoom) - request->y) *
+    request->scale_y;
+
+  dest_x = CLAMP(floor(x0), 0, request->map.px_width);
+  dest_y = CLAMP(floor(y0), 0, request->map.px_height);
+  dest_w = CLAMP(ceil(x1), 0, request->map.px_width) - dest_x;
+  dest_h = CLAMP(ceil(y1), 0, request->map.px_height) - dest_y;
+
+  if (dest_w > 0 && dest_h > 0)
+  {
+    gdk_pixbuf_scale(pixbuf, request->pixbuf, dest_x, dest_y, dest_w, dest_h,
+                     x0, y0, (x1 - x0) / gdk_pixbuf_get_width(pixbuf),
+                     (y1 - y0) / gdk_pixbuf_get_height(pixbuf),
+                     GDK_INTERP_BILINEAR);
+
+    if (request->progress_cb)
+    {
+      request->progress_cb(request->provider, request->pixbuf, dest_x, dest_y,
+                           dest_w, dest_h, request->n_done + 1,
+                           request->n_total, request->user_data);
+    }
+  }
+
+  g_object_unref(pixbuf);
+}
+
+static void
+navigation_map_request_free(NavigationMapRequest *request)
+{
+  g_queue_clear_full(&request->pending, g_free);
+
+  if (request->pixbuf)
+    g_object_unref(request->pixbuf);
+
+  g_main_context_unref(request->context);
+  g_object_unref(request->provider);
+  g_free(request);
+}
+
+static void
+navigation_map_request_finish(NavigationMapRequest *request)
+{
+  GdkPixbuf *pixbuf = NULL;
+
+  if (!request->error && request->n_failed == request->n_total)
+  {
+    request->error = g_error_new(NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                                 "Provider did not return any map tile");
+  }
+
+  if (!request->error)
+  {
+    pixbuf = request->pixbuf;
+    request->pixbuf = NULL;
+  }
+
+  request->cb(request->provider, pixbuf, request->error, request->user_data);
+  navigation_map_request_free(request);
+}
+
+static void navigation_map_request_issue(NavigationMapRequest *request);
+
+static gboolean
+navigation_map_request_retry(gpointer user_data)
+{
+  NavigationMapRequest *request = user_data;
+
+  request->retry_id = 0;
+  navigation_map_request_issue(request);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+navigation_map_request_schedule(NavigationMapRequest *request, guint interval)
+{
+  GSource *source;
+
+  if (interval)
+    source = g_timeout_source_new(interval);
+  else
+    source = g_idle_source_new();
+
+  g_source_set_callback(source, navigation_map_request_retry, request, NULL);
+  request->retry_id = g_source_attach(source, request->context);
+  g_source_unref(source);
+}
+
+static void
+navigation_map_tile_cb(NavigationProvider *provider, GBytes *bytes,
+                       NavigationArea *area, gpointer userdata)
+{
+  NavigationMapTile *tile = userdata;
+  NavigationMapRequest *request = tile->request;
+
+  request->in_flight--;
+
+  if (bytes)
+  {
+    tile_cache_insert(request->cache, tile, bytes, area);
+    navigation_map_request_blit(request, bytes, area);
+    g_bytes_unref(bytes);
+  }
+  else
+    request->n_failed++;
+
+  request->n_done++;
+  g_free(area);
+  g_free(tile);
+
+  navigation_map_request_issue(request);
+}
+
+static void
+navigation_map_request_issue(NavigationMapRequest *request)
+{
+  NavigationMapTile *tile;
+
+  /* so tile callbacks get back to us, whatever context we are called from */
+  g_main_context_push_thread_default(request->context);
+  navigation_priority_push_thread_default(request->priority);
+
+  while (!request->error && request->in_flight < MAX_TILES_IN_FLIGHT &&
+         (tile = g_queue_pop_head(&request->pending)))
+  {
+    NavigationLocation location;
+    NavigationArea area;
+    NavigationTile t;
+    GBytes *bytes = tile_cache_lookup(request->cache, tile, &area);
+    GError *error = NULL;
+
+    if (bytes)
+    {
+      navigation_map_request_blit(request, bytes, &area);
+      g_bytes_unref(bytes);
+      request->n_done++;
+      g_free(tile);
+      continue;
+    }
+
+    tile_get(tile, &t);
+    navigation_tile_get_center(&t, &location);
+
+    if (navigation_provider_request_tile_bytes(
+          request->provider, &location, request->zoom, TILE_SIZE, TILE_SIZE,
+          request->map_options, navigation_map_tile_cb, tile, &error))
+    {
+      request->in_flight++;
+      continue;
+    }
+
+    g_queue_push_head(&request->pending, tile);
+
+    if (g_error_matches(error, NAVIGATION_ERROR,
+                        NAVIGATION_ERROR_TOO_MANY_REQUESTS))
+    {
+      /* somebody else holds the slots, try again once ours are back */
+      g_error_free(error);
+
+      if (!request->in_flight)
+        navigation_map_request_schedule(request, RETRY_INTERVAL);
+
+      break;
+    }
+
+    request->error = error;
+  }
+
+  navigation_priority_pop_thread_default();
+  g_main_context_pop_thread_default(request->context);
+
+  if (!request->in_flight && !request->retry_id &&
+      (request->error || g_queue_is_empty(&request->pending)))
+  {
+    navigation_map_request_finish(request);
+  }
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_request_map(
+  NavigationProvider *provider, const NavigationMap *map,
+  unsigned int map_options, NavigationProviderMapProgressCallback progress_cb,
+  NavigationProviderMapCallback cb, gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  NavigationMapRequest *request;
+  int x0, y0, x1, y1;
+  int x, y;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_val_if_fail(map != NULL && cb != NULL, FALSE);
+  g_return_val_if_fail(map->px_width > 0 && map->px_height > 0, FALSE);
+  g_return_val_if_fail(map->area.nw.longitude < map->area.se.longitude,
+                       FALSE);
+  g_return_val_if_fail(map->area.nw.latitude > map->area.se.latitude, FALSE);
+
+  request = g_new0(NavigationMapRequest, 1);
+  request->provider = g_object_ref(provider);
+  request->cache = tile_cache_get(provider);
+  request->context = g_main_context_ref_thread_default();
+  request->map = *map;
+  request->map_options = map_options;
+  request->priority = navigation_priority_get_thread_default();
+  request->progress_cb = progress_cb;
+  request->cb = cb;
+  request->user_data = userdata;
+  g_queue_init(&request->pending);
+
+  /* the zoom level whose resolution is closest to the requested one */
+  request->zoom = CLAMP(
+      round(log2(map->px_width /
+                 (longitude_to_x(map->area.se.longitude, 0) -
+                  longitude_to_x(map->area.nw.longitude, 0)))),
+      0, MAX_ZOOM);
+
+  request->x = longitude_to_x(map->area.nw.longitude, request->zoom);
+  request->y = latitude_to_y(map->area.nw.latitude, request->zoom);
+  request->scale_x =
+    map->px_width /
+    (longitude_to_x(map->area.se.longitude, request->zoom) - request->x);
+  request->scale_y =
+    map->px_height /
+    (latitude_to_y(map->area.se.latitude, request->zoom) - request->y);
+
+  request->pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8,
+                                   map->px_width, map->px_height);
+
+  if (!request->pixbuf)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                "Unable to allocate a %dx%d map", map->px_width,
+                map->px_height);
+    navigation_map_request_free(request);
+
+    return FALSE;
+  }
+
+  gdk_pixbuf_fill(request->pixbuf, 0);
+
+  x0 = MAX(floor(request->x / TILE_SIZE), 0);
+  y0 = MAX(floor(request->y / TILE_SIZE), 0);
+  x1 = MIN(ceil(longitude_to_x(map->area.se.longitude, request->zoom) /
+                TILE_SIZE), 1 << request->zoom);
+  y1 = MIN(ceil(latitude_to_y(map->area.se.latitude, request->zoom) /
+                TILE_SIZE), 1 << request->zoom);
+
+  for (y = y0; y < y1; y++)
+  {
+    for (x = x0; x < x1; x++)
+    {
+      NavigationMapTile *tile = g_new(NavigationMapTile, 1);
+
+      tile->request = request;
+      tile->x = x;
+      tile->y = y;
+      g_queue_push_tail(&request->pending, tile);
+    }
+  }
+
+  request->n_total = g_queue_get_length(&request->pending);
+
+  /* never call back before we return */
+  navigation_map_request_schedule(request, 0);
+
+  return TRUE;
+}
@@ -0,0 +1,192 @@
+/*
+ * navigation-polyline.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Encoded polylines are a sequence of varints, latitude and longitude
+ * alternating. Every coordinate is stored in units of
+ * 1 / NAVIGATION_POLYLINE_PRECISION degrees, as the zigzag encoded difference
+ * to the same coordinate of the previous vertex. The varints hold 7 bits per
+ * byte, least significant group first, with the high bit set on all but the
+ * last byte. Neighbouring vertices of a route are close, so most of them take
+ * two to four bytes.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "navigation-provider.h"
+#include "navigation-util.h"
+
+/* 5 bytes of 7 bits are enough for any 32 bit value */
+#define MAX_VARINT_SHIFT 28
+
+static inline guint32
+zigzag_encode(gint32 v)
+{
+  return ((guint32)v << 1) ^ (guint32)(v >> 31);
+}
+
+static inline gint32
+zigzag_decode(guint32 v)
+{
+  return (gint32)(v >> 1) ^ -(gint32)(v & 1);
+}
+
+static inline gint32
+to_fixed(double degrees)
+{
+  return (gint32)lround(degrees * NAVIGATION_POLYLINE_PRECISION);
+}
+
+GBytes *
+navigation_polyline_encode(const NavigationLocation *locations,
+                           guint n_locations)
+{
+  GByteArray *array = g_byte_array_sized_new(n_locations * 4);
+  gint32 latitude = 0;
+  gint32 longitude = 0;
+  guint i;
+
+  g_return_val_if_fail(locations != NULL || n_locations == 0, NULL);
+
+  for (i = 0; i < n_locations; i++)
+  {
+    gint32 v = to_fixed(locations[i].latitude);
+
+    navigation_put_varint(array, zigzag_encode(v - latitude));
+    latitude = v;
+
+    v = to_fixed(locations[i].longitude);
+    navigation_put_varint(array, zigzag_encode(v - longitude));
+    longitude = v;
+  }
+
+  return g_byte_array_free_to_bytes(array);
+}
+
+void
+navigation_polyline_decoder_init(NavigationPolylineDecoder *decoder)
+{
+  g_return_if_fail(decoder != NULL);
+
+  memset(decoder, 0, sizeof(*decoder));
+}
+
+gboolean
+navigation_polyline_decoder_feed(NavigationPolylineDecoder *decoder,
+                                 const guint8 *data, gsize len,
+                                 GArray *locations, GError **error)
+{
+  guint32 value = decoder->value;
+  guint shift = decoder->shift;
+  const guint8 *end = data + len;
+
+  g_return_val_if_fail(locations != NULL, FALSE);
+  g_return_val_if_fail(
+    g_array_get_element_size(locations) == sizeof(NavigationLocation), FALSE);
+
+  while (data < end)
+  {
+    guint8 b = *data++;
+
+    value |= (guint32)(b & 0x7f) << shift;
+
+    if (b & 0x80)
+    {
+      shift += 7;
+
+      if (shift > MAX_VARINT_SHIFT)
+      {
+        g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                    "Polyline varint too long");
+        return FALSE;
+      }
+
+      continue;
+    }
+
+    if (decoder->have_latitude)
+    {
+      NavigationLocation location;
+
+      decoder->longitude += zigzag_decode(value);
+      location.latitude =
+        (double)decoder->latitude / NAVIGATION_POLYLINE_PRECISION;
+      location.longitude =
+        (double)decoder->longitude / NAVIGATION_POLYLINE_PRECISION;
+      g_array_append_val(locations, location);
+    }
+    else
+      decoder->latitude += zigzag_decode(value);
+
+    decoder->have_latitude = !decoder->have_latitude;
+    value = 0;
+    shift = 0;
+  }
+
+  decoder->value = value;
+  decoder->shift = shift;
+
+  return TRUE;
+}
+
+gboolean
+navigation_polyline_decoder_finish(NavigationPolylineDecoder *decoder,
+                                   GError **error)
+{
+  if (decoder->shift || decoder->have_latitude)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                "Polyline truncated");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+NavigationLocation *
+navigation_polyline_decode(const guint8 *data, gsize len, guint *n_locations,
+                           GError **error)
+{
+  NavigationPolylineDecoder decoder;
+  GArray *locations;
+
+  g_return_val_if_fail(n_locations != NULL, NULL);
+
+  /* a vertex takes at least two bytes */
+  locations = g_array_sized_new(FALSE, FALSE, sizeof(NavigationLocation),
+                                len / 2);
+  navigation_polyline_decoder_init(&decoder);
+
+  if (!navigation_polyline_decoder_feed(&decoder, data, len, locations,
+                                        error) ||
+      !navigation_polyline_decoder_finish(&decoder, error))
+  {
+    *n_locations = 0;
+    g_array_free(locations, TRUE);
+
+    return NULL;
+  }
+
+  *n_locations = locations->len;
+
+  return (NavigationLocation *)g_array_free(locations, FALSE);
+}
@@ -76,7 +76,35 @@ enum {
 	NAVIGATION_MAP_TYPE_SATELLITE	= (2 << NAVIGATION_MAP_TYPE_SHIFT),
 	NAVIGATION_MAP_TYPE_HYBRID	= (3 << NAVIGATION_MAP_TYPE_SHIFT),
 	NAVIGATION_MAP_TYPE_TERRAIN	= (4 << NAVIGATION_MAP_TYPE_SHIFT),
-	NAVIGATION_MAP_TYPE_MASK	= (7 << NAVIGATION_MAP_TYPE_SHIFT)
+	NAVIGATION_MAP_TYPE_MASK	= (7 << NAVIGATION_MAP_TYPE_SHIFT),
+
+	/* offset 5 bits */
+	NAVIGATION_MAP_FORMAT_SHIFT	= 5,
+	/* 0--2, 2 bits */
+	NAVIGATION_MAP_FORMAT_PIXDATA	= (0 << NAVIGATION_MAP_FORMAT_SHIFT),
+	NAVIGATION_MAP_FORMAT_PNG	= (1 << NAVIGATION_MAP_FORMAT_SHIFT),
+	NAVIGATION_MAP_FORMAT_WEBP	= (2 << NAVIGATION_MAP_FORMAT_SHIFT),
+	NAVIGATION_MAP_FORMAT_MASK	= (3 << NAVIGATION_MAP_FORMAT_SHIFT)
+};
+
+/* Addresses are encoded as (qa{ys}), the version and the non-empty fields
+ * by id. Later versions only add ids, unknown ones are ignored. */
+enum {
+	NAVIGATION_ADDRESS_ENCODING_VERSION	= 1
+};
+
+enum {
+	NAVIGATION_ADDRESS_FIELD_HOUSE_NUM	= 0,
+	NAVIGATION_ADDRESS_FIELD_HOUSE_NAME	= 1,
+	NAVIGATION_ADDRESS_FIELD_STREET		= 2,
+	NAVIGATION_ADDRESS_FIELD_SUBURB		= 3,
+	NAVIGATION_ADDRESS_FIELD_TOWN		= 4,
+	NAVIGATION_ADDRESS_FIELD_MUNICIPALITY	= 5,
+	NAVIGATION_ADDRESS_FIELD_PROVINCE	= 6,
+	NAVIGATION_ADDRESS_FIELD_POSTAL_CODE	= 7,
+	NAVIGATION_ADDRESS_FIELD_COUNTRY	= 8,
+	NAVIGATION_ADDRESS_FIELD_COUNTRY_CODE	= 9,
+	NAVIGATION_ADDRESS_FIELD_TIME_ZONE	= 10
 };
 
 
@@ -22,10 +22,30 @@
  * @short_description: a representation of an navigation provider.
  *
  * An #NavigationProvider is an object which represents a navigation provider.
+ *
+ * A #NavigationProvider can be shared between threads. Requests may be issued
+ * from any thread and their callbacks are invoked in the #GMainContext that
+ * was the thread-default context of the issuing thread, so that context must
+ * be iterated for the callbacks to run.
+ *
+ * The default main context must be iterated as well, whatever context the
+ * callbacks run in. Provider replies are received there, since the shared
+ * session bus connection of dbus-glib is dispatched there, and so are the
+ * timers of the provider: the one that sends requests held back by the rate
+ * limit and the one that fails requests that got no reply. Without it,
+ * requests are never answered and those waiting in the queue are never sent.
+ *
+ * Only a few requests are in flight at a time, the others wait in a queue
+ * ordered by #NavigationPriority. A request that can not be sent later on
+ * fails through its callback, like a cancelled one.
  */
 
 #include "config.h"
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <dbus/dbus-glib-lowlevel.h>
 #include <dbus/dbus.h>
 #include <gconf/gconf-client.h>
@@ -34,22 +54,102 @@
 
 #include "navigation-provider-client-glue.h"
 
+#include "navigation-dataset.h"
+#include "navigation-geocache.h"
 #include "navigation-provider.h"
+#include "navigation-trace.h"
 
 #define ISO_CODES_DIR "/share/xml/iso-codes"
 #define ISO_3166_XML_PATH ISO_CODES_PREFIX ISO_CODES_DIR "/iso_3166.xml"
 
+#define MAP_PROVIDER_INTERFACE "com.nokia.Navigation.MapProvider"
+
+#define GCONF_SERVICE_KEY "/apps/osso/navigation/service"
+#define GCONF_DATASET_KEY "/apps/osso/navigation/dataset"
+#define GCONF_POI_CATEGORIES_TTL_KEY "/apps/osso/navigation/poi_categories_ttl"
+#define GCONF_RATE_LIMIT_KEY "/apps/osso/navigation/rate_limit"
+#define GCONF_RATE_BURST_KEY "/apps/osso/navigation/rate_burst"
+#define GCONF_GEOCODE_CACHE_TTL_KEY "/apps/osso/navigation/geocode_cache_ttl"
+#define GCONF_GEOCODE_CACHE_NEGATIVE_TTL_KEY \
+  "/apps/osso/navigation/geocode_cache_negative_ttl"
+#define GCONF_GEOCODE_CACHE_FILE_KEY "/apps/osso/navigation/geocode_cache_file"
+#define GCONF_GEOCODE_CACHE_MAX_SIZE_KEY \
+  "/apps/osso/navigation/geocode_cache_max_size"
+
+#define N_PRIORITIES (NAVIGATION_PRIORITY_BACKGROUND + 1)
+/* reverse geocoding latencies the hedging delay is computed from */
+#define HEDGE_SAMPLES 64
+
+/* Pending requests by id, open addressing with linear probing. size is a
+ * power of two and the table is kept at most half full. */
+struct _NavigationRequestSlot
+{
+  guint64 id;
+  struct _NavigationProviderRequest *request;
+};
+
+typedef struct _NavigationRequestSlot NavigationRequestSlot;
+
+struct _NavigationRequestTable
+{
+  NavigationRequestSlot *slots;
+  guint size;
+  guint n_requests;
+};
+
+typedef struct _NavigationRequestTable NavigationRequestTable;
+
 struct _NavigationProviderPrivate
 {
   gchar *service;
   DBusGConnection *gdbus;
   DBusGProxy *proxy;
   DBusConnection *dbus;
-  GHashTable *requests;
+  /* serializes navigation_provider_service_init() and dataset loading */
+  GMutex init_lock;
+  /* offline address dataset, loaded on first use */
+  NavigationDataset *dataset;
+  gboolean dataset_loaded;
+  /* protects requests, early_replies and issuing */
+  GMutex lock;
+  NavigationRequestTable requests;
+  /* replies that arrived before their request was registered */
+  GHashTable *early_replies;
+  /* number of method calls waiting for their object path */
+  guint issuing;
+  /* requests waiting for a slot, FIFO per NavigationPriority */
+  GQueue queued[N_PRIORITIES];
+  NavigationPriorityStats stats[N_PRIORITIES];
+  /* runs the scheduler again once the rate limit has a token */
+  GSource *throttle_source;
+  /* fails sent requests that got no reply for too long */
+  GSource *reply_timeout_source;
+  /* unique name of the owner of service, if known */
+  gchar *owner;
+  gchar *owner_match;
+  /* when the owner went away, queued requests wait for a new one */
+  gint64 owner_lost_at;
+  /* whether the provider takes and sends encoded addresses, found out by
+   * the first call and again for every new owner */
+  gint address_encoding;
+  /* secondary provider reverse geocoding is hedged to, protected by lock
+   * like the latencies of the primary and the hedging counters */
+  NavigationProvider *hedge;
+  gint64 hedge_latencies[HEDGE_SAMPLES];
+  guint n_hedge_latencies;
+  NavigationHedgeStats hedge_stats;
 };
 
 typedef struct _NavigationProviderPrivate NavigationProviderPrivate;
 
+enum
+{
+  POI_CATEGORIES_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
 G_DEFINE_TYPE_WITH_PRIVATE(
   NavigationProvider,
   navigation_provider,
@@ -61,15 +161,110 @@ G_DEFINE_TYPE_WITH_PRIVATE(
    navigation_provider_get_instance_private( \
      (NavigationProvider *)(provider)))
 
+typedef enum
+{
+  REQUEST_LOCATION_TO_ADDRESS,
+  REQUEST_ADDRESS_TO_LOCATION,
+  REQUEST_MAP_TILE,
+  REQUEST_MAP_TILE_BYTES,
+  REQUEST_LOCATION_FROM_MAP,
+  REQUEST_POI_CATEGORIES,
+  REQUEST_POI_CATEGORIES_SHARED,
+  REQUEST_ADDRESS_TO_LOCATIONS_STREAMED,
+  REQUEST_ROUTE,
+  REQUEST_ROUTE_MATRIX,
+  REQUEST_LOCATION_TO_ADDRESS_CACHED
+} NavigationProviderRequestType;
+
+/* calls the provider method of a request, args are the ones given to
+ * navigation_provider_request_submit() */
+typedef gboolean (*NavigationProviderIssueFunc)(NavigationProvider *provider,
+                                                GVariant *args,
+                                                char **object_path,
+                                                GError **error);
+
+/* builds the call of a provider method that replies with the result itself,
+ * rather than with the object path of the signals to come */
+typedef DBusMessage *(*NavigationProviderCallFunc)(
+  NavigationProvider *provider, GVariant *args);
+
+/* called for every tile of a route matrix, the arrays are owned by the
+ * reply */
+typedef void (*NavigationProviderRouteMatrixTileCallback)(
+  NavigationProvider *provider, const double *durations, const double *lengths,
+  guint n_cells, GError *error, gpointer userdata);
+
+/* the callback owns addresses, error is set if there are none */
+typedef void (*NavigationProviderAddressListCallback)(
+  NavigationProvider *provider, GSList *addresses, GError *error,
+  gpointer userdata);
+
 struct _NavigationProviderRequest
 {
+  gint ref_count;
+  NavigationProviderRequestType type;
   GCallback cb;
+  /* completion callback of streamed requests */
+  GCallback done_cb;
+  guint n_results;
   gboolean verbose;
   gpointer user_data;
+  GMainContext *context;
+  gchar *object_path;
+  /* the key in priv->requests, parsed from object_path */
+  guint64 id;
+  /* next free record while in the pool */
+  struct _NavigationProviderRequest *next_free;
+  NavigationProvider *provider;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  NavigationPriority priority;
+  NavigationProviderIssueFunc issue;
+  /* used instead of issue by requests answered in the method reply */
+  NavigationProviderCallFunc call;
+  GVariant *args;
+  /* the link in priv->queued while waiting for a slot */
+  GList *link;
+  gint64 queued_at;
+  gulong queued_cancelled_id;
+  /* when the rate limit first held back the request, 0 if it did not */
+  gint64 throttled_at;
+  /* why a queued request could not be sent */
+  GError *error;
+  /* when the provider method was called */
+  gint64 issued_at;
+  /* when the request was sent or last got a partial reply */
+  gint64 active_at;
+  /* whether the request probes a half open circuit */
+  gboolean probe;
+  /* forward geocoding results are cached under this key */
+  gchar *cache_key;
 };
 
 typedef struct _NavigationProviderRequest NavigationProviderRequest;
 
+/* message is NULL if the request was cancelled */
+struct _NavigationProviderReply
+{
+  NavigationProvider *provider;
+  NavigationProviderRequest *request;
+  DBusMessage *message;
+  /* next free record while in the pool */
+  struct _NavigationProviderReply *next_free;
+};
+
+typedef struct _NavigationProviderReply NavigationProviderReply;
+
+/* a method call waiting for its reply, handled is set by whoever handles it */
+struct _NavigationProviderCall
+{
+  NavigationProvider *provider;
+  NavigationProviderRequest *request;
+  gint handled;
+};
+
+typedef struct _NavigationProviderCall NavigationProviderCall;
+
 static GHashTable *a3_2_country = NULL;
 
 static void
@@ -234,968 +429,5904 @@ array_to_address(NavigationAddress **address, int idx, const gchar *val)
   }
 }
 
-static NavigationLocation *
-get_location(DBusMessageIter *iter)
+/* NavigationAddress fields by NAVIGATION_ADDRESS_FIELD_* id */
+static const gsize address_fields[] =
 {
-  NavigationLocation *location = g_new0(NavigationLocation, 1);
-  DBusMessageIter sub;
-
-  dbus_message_iter_recurse(iter, &sub);
-
-  if (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_DOUBLE)
-    dbus_message_iter_get_basic(&sub, &location->latitude);
+  G_STRUCT_OFFSET(NavigationAddress, house_num),
+  G_STRUCT_OFFSET(NavigationAddress, house_name),
+  G_STRUCT_OFFSET(NavigationAddress, street),
+  G_STRUCT_OFFSET(NavigationAddress, suburb),
+  G_STRUCT_OFFSET(NavigationAddress, town),
+  G_STRUCT_OFFSET(NavigationAddress, municipality),
+  G_STRUCT_OFFSET(NavigationAddress, province),
+  G_STRUCT_OFFSET(NavigationAddress, postal_code),
+  G_STRUCT_OFFSET(NavigationAddress, country),
+  G_STRUCT_OFFSET(NavigationAddress, country_code),
+  G_STRUCT_OFFSET(NavigationAddress, time_zone)
+};
 
-  dbus_message_iter_next(&sub);
+#define ADDRESS_FIELD(address, id) \
+  G_STRUCT_MEMBER(gchar *, address, address_fields[id])
 
-  if (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_DOUBLE)
-    dbus_message_iter_get_basic(&sub, &location->longitude);
+enum
+{
+  ADDRESS_ENCODING_UNKNOWN,
+  ADDRESS_ENCODING_ARRAY,
+  ADDRESS_ENCODING_STRUCT
+};
 
-  return location;
+static void
+set_address_field(NavigationAddress *address, guchar id, const gchar *val)
+{
+  if (id < G_N_ELEMENTS(address_fields) && *val &&
+      !ADDRESS_FIELD(address, id))
+  {
+    ADDRESS_FIELD(address, id) = g_strdup(val);
+  }
 }
 
-static DBusHandlerResult
-navigation_provider_dbus_filter(DBusConnection *connection,
-                                DBusMessage *message,
-                                gpointer user_data)
+/* reads a (qa{ys}) */
+static NavigationAddress *
+get_encoded_address(DBusMessageIter *iter)
 {
-  NavigationProvider *provider = user_data;
-  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationAddress *address = g_new0(NavigationAddress, 1);
+  DBusMessageIter sub;
+  DBusMessageIter fields;
+  DBusMessageIter entry;
 
-  const char *path;
-  DBusMessageIter sub1;
-  DBusMessageIter sub2;
-  DBusMessageIter iter;
+  dbus_message_iter_recurse(iter, &sub);
+  dbus_message_iter_next(&sub);
 
-  path = dbus_message_get_path(message);
+  if (dbus_message_iter_get_arg_type(&sub) != DBUS_TYPE_ARRAY)
+    return address;
 
-  if (path)
+  dbus_message_iter_recurse(&sub, &fields);
+
+  while (dbus_message_iter_get_arg_type(&fields) == DBUS_TYPE_DICT_ENTRY)
   {
-    NavigationProviderRequest *request;
+    guchar id;
+    const gchar *val;
 
-    request = g_hash_table_lookup(priv->requests, path);
+    dbus_message_iter_recurse(&fields, &entry);
 
-    if (request)
+    if (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_BYTE)
     {
-      g_object_ref(provider);
+      dbus_message_iter_get_basic(&entry, &id);
+      dbus_message_iter_next(&entry);
 
-      if (request->cb)
+      if (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_STRING)
       {
-        if (dbus_message_is_signal(message,
-                                   "com.nokia.Navigation.MapProvider",
-                                   "LocationToAddressReply"))
-        {
-          NavigationAddress *address = NULL;
-
-          dbus_message_iter_init(message, &iter);
-
-          if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY)
-          {
-            dbus_message_iter_recurse(&iter, &sub1);
-
-            if (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_ARRAY)
-            {
-              int i = 0;
-
-              address = g_new0(NavigationAddress, 1);
-              dbus_message_iter_recurse(&sub1, &sub2);
-
-              while (dbus_message_iter_get_arg_type(&sub2) != DBUS_TYPE_INVALID)
-              {
-                const gchar *v;
+        dbus_message_iter_get_basic(&entry, &val);
+        set_address_field(address, id, val);
+      }
+    }
 
-                dbus_message_iter_get_basic(&sub2, &v);
-                array_to_address(&address, i, v);
-                dbus_message_iter_next(&sub2);
-                i++;
-              }
-            }
-          }
+    dbus_message_iter_next(&fields);
+  }
 
-          check_country(address);
+  return address;
+}
 
-          if (request->verbose)
-          {
-            ((NavigationProviderLocationToAddressCallback)request->cb)(
-              provider, address, request->user_data);
-          }
-          else
-          {
-            ((NavigationProviderLocationToAddressVerboseCallback)request->cb)(
-              provider, address, NULL, request->user_data);
-          }
-        }
-        else if (dbus_message_is_signal(message,
-                                        "com.nokia.Navigation.MapProvider",
-                                        "LocationToAddressError"))
-        {
-          ((NavigationProviderLocationToAddressVerboseCallback)request->cb)
-            (provider, NULL,
-            g_error_new(NAVIGATION_ERROR,
-                        NAVIGATION_ERROR_USER_CANCELED_OPERATION,
-                        "User canceled operation"),
-            request->user_data);
-        }
-        else if (dbus_message_is_signal(message,
-                                        "com.nokia.Navigation.MapProvider",
-                                        "AddressToLocationError"))
-        {
-          ((NavigationProviderAddressToLocationVerboseCallback)request->cb)
-            (provider, NULL,
-            g_error_new(NAVIGATION_ERROR,
-                        NAVIGATION_ERROR_USER_CANCELED_OPERATION,
-                        "User canceled operation"),
-            request->user_data);
-        }
-        else if (dbus_message_is_signal(message,
-                                        "com.nokia.Navigation.MapProvider",
-                                        "AddressToLocationsReply"))
-        {
-          NavigationLocation *location = NULL;
+static NavigationLocation *
+get_location(DBusMessageIter *iter)
+{
+  NavigationLocation *location = g_new0(NavigationLocation, 1);
+  DBusMessageIter sub;
 
-          dbus_message_iter_init(message, &sub2);
+  dbus_message_iter_recurse(iter, &sub);
 
-          if (dbus_message_iter_get_arg_type(&sub2))
-          {
-            dbus_message_iter_recurse(&sub2, &sub1);
+  if (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_DOUBLE)
+    dbus_message_iter_get_basic(&sub, &location->latitude);
 
-            if (dbus_message_iter_get_arg_type(&sub1))
-              location = get_location(&sub1);
-          }
+  dbus_message_iter_next(&sub);
 
-          if (request->verbose)
-          {
-            ((NavigationProviderAddressToLocationVerboseCallback)request->cb)(
-              provider, location, NULL, request->user_data);
-          }
-          else
-          {
-            ((NavigationProviderAddressToLocationCallback)request->cb)(
-              provider, location, request->user_data);
-          }
-        }
-        else if (dbus_message_is_signal(message,
-                                        "com.nokia.Navigation.MapProvider",
-                                        "GetMapTileReply"))
-        {
-          NavigationArea *area = NULL;
-          GdkPixbuf *pixbuf;
+  if (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_DOUBLE)
+    dbus_message_iter_get_basic(&sub, &location->longitude);
 
-          dbus_message_iter_init(message, &sub1);
+  return location;
+}
 
-          if ((dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_ARRAY) &&
-              (dbus_message_iter_get_element_type(&sub1) == DBUS_TYPE_BYTE))
-          {
-            int n_elements;
-            guint8 *stream;
-            GdkPixdata pixdata;
+/* Copies strings into a single immutable, reference counted block, so the
+ * same array can be handed to every caller. */
+static char **
+poi_categories_new(const char * const *strings, guint n)
+{
+  gsize size = (n + 1) * sizeof(char *);
+  char **categories;
+  char *p;
+  guint i;
 
-            dbus_message_iter_recurse(&sub1, &sub2);
-            dbus_message_iter_get_fixed_array(&sub2, &stream, &n_elements);
-            G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-            gdk_pixdata_deserialize(&pixdata, n_elements, stream, NULL);
+  for (i = 0; i < n; i++)
+    size += strlen(strings[i]) + 1;
 
-            pixbuf = gdk_pixbuf_from_pixdata(&pixdata, TRUE, NULL);
-            G_GNUC_END_IGNORE_DEPRECATIONS
+  categories = g_atomic_rc_box_alloc(size);
+  p = (char *)(categories + n + 1);
 
-            if (pixbuf)
-            {
-              NavigationArea *area = g_new(NavigationArea, 1);
+  for (i = 0; i < n; i++)
+  {
+    gsize len = strlen(strings[i]) + 1;
 
-              dbus_message_iter_next(&sub1);
+    categories[i] = memcpy(p, strings[i], len);
+    p += len;
+  }
 
-              if (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_STRUCT)
-              {
-                NavigationLocation *location = get_location(&sub1);
-                area->nw.longitude = location->longitude;
-                area->nw.latitude = location->latitude;
-                navigation_location_free(location);
-              }
+  categories[n] = NULL;
 
-              dbus_message_iter_next(&sub1);
+  return categories;
+}
 
-              if (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_STRUCT)
-              {
-                NavigationLocation *location = get_location(&sub1);
+/* The GConf settings the reply path needs. Replies are handled on any
+ * thread, where GConf must not be used, so these are read once by the
+ * thread creating the first provider. Changes apply to new processes. */
+struct _NavigationSettings
+{
+  gint64 geocode_cache_ttl;
+  gint64 geocode_cache_negative_ttl;
+  gchar *geocode_cache_file;
+  gint geocode_cache_max_size;
+  gint64 poi_categories_ttl;
+  double rate_limit;
+  gint rate_burst;
+};
 
-                area->se.longitude = location->longitude;
-                area->se.latitude = location->latitude;
+typedef struct _NavigationSettings NavigationSettings;
 
-                navigation_location_free(location);
-              }
-            }
-          }
+static NavigationSettings settings;
 
-          ((NavigationProviderGetPixbufCallback)request->cb)(
-            provider, pixbuf, area, request->user_data);
-        }
+static void
+settings_load()
+{
+  GConfClient *gconf = gconf_client_get_default();
 
-#if 0
-        else if (dbus_message_is_signal(message,
-                                        "com.nokia.Navigation.MapProvider",
-                                        "CoordinateReply"))
-        {
-          NavigationLocation *location = g_new(NavigationLocation, 1);
+  settings.geocode_cache_ttl = G_TIME_SPAN_SECOND *
+    gconf_client_get_int(gconf, GCONF_GEOCODE_CACHE_TTL_KEY, NULL);
+  settings.geocode_cache_negative_ttl = G_TIME_SPAN_SECOND *
+    gconf_client_get_int(gconf, GCONF_GEOCODE_CACHE_NEGATIVE_TTL_KEY, NULL);
+  settings.geocode_cache_file =
+    gconf_client_get_string(gconf, GCONF_GEOCODE_CACHE_FILE_KEY, NULL);
+  settings.geocode_cache_max_size =
+    gconf_client_get_int(gconf, GCONF_GEOCODE_CACHE_MAX_SIZE_KEY, NULL);
+  settings.poi_categories_ttl = G_TIME_SPAN_SECOND *
+    gconf_client_get_int(gconf, GCONF_POI_CATEGORIES_TTL_KEY, NULL);
+  settings.rate_limit = gconf_client_get_float(gconf, GCONF_RATE_LIMIT_KEY,
+                                               NULL);
+  settings.rate_burst = gconf_client_get_int(gconf, GCONF_RATE_BURST_KEY,
+                                             NULL);
 
-          if (!dbus_message_get_args(message, NULL,
-                                     DBUS_TYPE_DOUBLE, &location->latitude,
-                                     DBUS_TYPE_DOUBLE, &location->longitude,
-                                     DBUS_TYPE_INVALID))
-          {
-            g_warning("Could not parse get location from map response signal");
-            navigation_location_free(location);
-            location = NULL;
-          }
+  g_object_unref(gconf);
+}
 
-          request->cb(provider, location, request->user_data);
-        }
-#endif
-        else if (dbus_message_is_signal(message,
-                                        "com.nokia.Navigation.MapProvider",
-                                        "GetPOICategoriesReply"))
-        {
-          char **categories = NULL;
+struct _NavigationPOICache
+{
+  char **categories;
+  gint64 expires;
+};
 
-          dbus_message_iter_init(message, &sub2);
+typedef struct _NavigationPOICache NavigationPOICache;
 
-          if (dbus_message_iter_get_arg_type(&sub2) != DBUS_TYPE_INVALID)
-          {
-            GPtrArray *array = g_ptr_array_new();
+/* shared by all providers, keyed by service name */
+static GMutex poi_cache_lock;
+static GHashTable *poi_cache;
 
-            dbus_message_iter_recurse(&sub2, &sub1);
+static void
+poi_cache_free(gpointer data)
+{
+  NavigationPOICache *cache = data;
 
-            while (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_STRING)
-            {
-              const gchar *v;
+  g_atomic_rc_box_release(cache->categories);
+  g_free(cache);
+}
 
-              dbus_message_iter_get_basic(&sub1, &v);
-              g_ptr_array_add(array, g_strdup(v));
-              dbus_message_iter_next(&sub1);
-            }
+/* returns a new reference to the cached categories of service, if fresh */
+static char **
+poi_cache_lookup(const gchar *service)
+{
+  NavigationPOICache *cache = NULL;
+  char **categories = NULL;
 
-            g_ptr_array_add(array, NULL);
-            categories = (char **)g_ptr_array_free(array, FALSE);
-          }
+  g_mutex_lock(&poi_cache_lock);
 
-          ((NavigationProviderGetPOICategoriesCallback)request->cb)(
-            provider, categories, request->user_data);
-        }
-        else
-          g_warning("Unknown reply recieved");
-      }
+  if (poi_cache)
+    cache = g_hash_table_lookup(poi_cache, service);
 
-      g_hash_table_remove(priv->requests, path);
-      g_object_unref(provider);
-      return DBUS_HANDLER_RESULT_HANDLED;
-    }
+  if (cache)
+  {
+    if (g_get_monotonic_time() < cache->expires)
+      categories = g_atomic_rc_box_acquire(cache->categories);
+    else
+      g_hash_table_remove(poi_cache, service);
   }
 
-  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  g_mutex_unlock(&poi_cache_lock);
+
+  return categories;
 }
 
 static void
-navigation_provider_dispose(GObject *object)
+poi_cache_store(const gchar *service, char **categories)
 {
-  NavigationProviderPrivate *priv = PRIVATE(object);
+  NavigationPOICache *cache;
 
-  if (priv->requests)
-  {
-    g_hash_table_destroy(priv->requests);
-    priv->requests = NULL;
-  }
+  g_mutex_lock(&poi_cache_lock);
 
-  if (priv->dbus)
+  if (!poi_cache)
   {
-    dbus_bus_remove_match(
-      priv->dbus,
-      "type='signal',interface='com.nokia.Navigation.MapProvider'", NULL);
-    dbus_connection_remove_filter(priv->dbus, navigation_provider_dbus_filter,
-                                  object);
+    poi_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      poi_cache_free);
   }
 
-  if (priv->gdbus)
+  if (settings.poi_categories_ttl > 0)
   {
-    dbus_g_connection_unref(priv->gdbus);
-    priv->gdbus = NULL;
+    cache = g_new(NavigationPOICache, 1);
+    cache->categories = g_atomic_rc_box_acquire(categories);
+    cache->expires = g_get_monotonic_time() + settings.poi_categories_ttl;
+    g_hash_table_insert(poi_cache, g_strdup(service), cache);
   }
+  else
+    g_hash_table_remove(poi_cache, service);
 
-  G_OBJECT_CLASS(navigation_provider_parent_class)->dispose(object);
+  g_mutex_unlock(&poi_cache_lock);
 }
 
-static void
-navigation_provider_finalize(GObject *object)
+/* Forward geocoding results, shared by all providers and keyed by service and
+ * normalized address. Addresses the provider found no location for are
+ * cached as well, usually for a shorter time. */
+#define GEOCODE_CACHE_SIZE 512
+
+struct _NavigationGeocodeCache
 {
-  g_free(PRIVATE(object)->service);
+  gchar *key;
+  NavigationLocation location;
+  gboolean found;
+  gint64 expires;
+  /* in geocode_lru, the most recently used first */
+  GList link;
+};
 
-  G_OBJECT_CLASS(navigation_provider_parent_class)->finalize(object);
-}
+typedef struct _NavigationGeocodeCache NavigationGeocodeCache;
+
+static GMutex geocode_cache_lock;
+static GHashTable *geocode_cache;
+static GQueue geocode_lru = G_QUEUE_INIT;
 
 static void
-navigation_provider_class_init(NavigationProviderClass *klass)
+geocode_cache_free(gpointer data)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  NavigationGeocodeCache *cache = data;
 
-  object_class->dispose = navigation_provider_dispose;
-  object_class->finalize = navigation_provider_finalize;
+  g_free(cache->key);
+  g_free(cache);
 }
 
 static void
-navigation_provider_init(NavigationProvider *provider)
+geocode_cache_remove_locked(NavigationGeocodeCache *cache)
 {
-  NavigationProviderPrivate *priv = PRIVATE(provider);
-
-  priv->requests = g_hash_table_new_full((GHashFunc)&g_str_hash,
-                                         (GEqualFunc)&g_str_equal,
-                                         (GDestroyNotify)&g_free,
-                                         (GDestroyNotify)&g_free);
+  g_queue_unlink(&geocode_lru, &cache->link);
+  g_hash_table_remove(geocode_cache, cache->key);
 }
 
-NavigationProvider *
-navigation_provider_new_default()
-{
-  return g_object_new(NAVIGATION_TYPE_PROVIDER, NULL);
-}
+/* The persistent cache shared by all providers of the process, opened on
+ * first use if configured. */
+static GMutex geocache_lock;
+static NavigationGeocache *geocache;
+static gboolean geocache_opened;
 
-void
-navigation_location_free(NavigationLocation *location)
+static NavigationGeocache *
+get_geocache()
 {
-  g_free(location);
-}
+  NavigationGeocache *cache;
 
-void
-navigation_address_free(NavigationAddress *address)
-{
-  if (address)
+  g_mutex_lock(&geocache_lock);
+
+  if (!geocache_opened)
   {
-    g_free(address->house_num);
-    g_free(address->house_name);
-    g_free(address->street);
-    g_free(address->suburb);
-    g_free(address->town);
-    g_free(address->municipality);
-    g_free(address->province);
-    g_free(address->postal_code);
-    g_free(address->country);
-    g_free(address->country_code);
-    g_free(address->time_zone);
-    g_free(address);
+    const gchar *path = settings.geocode_cache_file;
+    GError *error = NULL;
+
+    if (path && *path)
+    {
+      geocache = navigation_geocache_open(
+          path, MAX(settings.geocode_cache_max_size, 1) * 1024, &error);
+
+      if (!geocache)
+      {
+        g_warning("Persistent geocode cache disabled: %s", error->message);
+        g_error_free(error);
+      }
+    }
+
+    geocache_opened = TRUE;
   }
+
+  cache = geocache;
+  g_mutex_unlock(&geocache_lock);
+
+  return cache;
 }
 
-GList *
-navigation_provider_list_all()
+static void __attribute__((destructor))
+close_geocache()
 {
-  GDir *dir = g_dir_open("/usr/share/osso-navigation-providers/", 0, NULL);
-  const gchar *dir_name;
-  GList *list = NULL;
+  navigation_geocache_free(geocache);
+}
 
-  if (!dir)
-    return NULL;
+/* Traffic with the services is recorded into the file named by the
+ * NAVIGATION_TRACE environment variable, for navigation-replay. */
+static GMutex trace_lock;
+static NavigationTrace *trace;
+static gboolean trace_opened;
 
-  while ((dir_name = g_dir_read_name(dir)))
+static NavigationTrace *
+get_trace()
+{
+  NavigationTrace *rv;
+
+  g_mutex_lock(&trace_lock);
+
+  if (!trace_opened)
   {
-    GKeyFile *key_file = g_key_file_new();
+    const gchar *path = g_getenv("NAVIGATION_TRACE");
     GError *error = NULL;
-    gchar *file = g_build_filename("/usr/share/osso-navigation-providers/",
-                                   dir_name, NULL);
-
-    if (g_key_file_load_from_file(key_file, file, G_KEY_FILE_NONE, &error))
-    {
-      NavigationProviderDetails *details = g_new0(NavigationProviderDetails, 1);
 
-      details->name = g_key_file_get_value(
-          key_file, "Map service", "Name", NULL);
-      details->service = g_key_file_get_value(
-          key_file, "Map service", "Service", NULL);
-      details->description = g_key_file_get_value(
-          key_file, "Map service", "Description", NULL);
-      list = g_list_prepend(list, details);
-    }
-    else
+    if (path && *path && !(trace = navigation_trace_new(path, &error)))
     {
-      g_warning("Error loading: %s - %s", file, error->message);
+      g_warning("Tracing disabled: %s", error->message);
       g_error_free(error);
     }
 
-    g_key_file_free(key_file);
-    g_free(file);
+    trace_opened = TRUE;
   }
 
-  g_dir_close(dir);
+  rv = trace;
+  g_mutex_unlock(&trace_lock);
 
-  return list;
+  return rv;
 }
 
-void
-navigation_provider_list_free(GList *list)
+static void __attribute__((destructor))
+close_trace()
 {
-  GList *l;
+  navigation_trace_free(trace);
+}
 
-  for (l = list; l; l = l->next)
+/* the plain method each kind of request is recorded as */
+static const char *
+request_method(NavigationProviderRequestType type)
+{
+  static const char *methods[] =
   {
-    NavigationProviderDetails *details = l->data;
+    [REQUEST_LOCATION_TO_ADDRESS] = "LocationToAddresses",
+    [REQUEST_ADDRESS_TO_LOCATION] = "AddressToLocations",
+    [REQUEST_MAP_TILE] = "GetMapTile",
+    [REQUEST_MAP_TILE_BYTES] = "GetMapTile",
+    [REQUEST_LOCATION_FROM_MAP] = "GetLocationFromMap",
+    [REQUEST_POI_CATEGORIES] = "GetPOICategories",
+    [REQUEST_POI_CATEGORIES_SHARED] = "GetPOICategories",
+    [REQUEST_ADDRESS_TO_LOCATIONS_STREAMED] = "AddressToLocationsStreamed",
+    [REQUEST_ROUTE] = "GetRoute",
+    [REQUEST_ROUTE_MATRIX] = "GetRouteMatrix",
+    [REQUEST_LOCATION_TO_ADDRESS_CACHED] = "LocationToAddressesCached"
+  };
+
+  return methods[type];
+}
 
-    g_free(details->name);
-    g_free(details->service);
-    g_free(details->description);
-    g_free(details);
-  }
-
-  g_list_free(list);
+static gint64
+geocode_cache_ttl(gboolean found)
+{
+  return found ? settings.geocode_cache_ttl :
+         settings.geocode_cache_negative_ttl;
 }
 
 static gchar *
-get_safe_string(const gchar *s)
+geocode_cache_key(const gchar *service, const NavigationAddress *address)
 {
-  if (s)
-    return g_strdup(s);
-  else
-    return g_strdup("");
+  gchar *normalized = navigation_address_normalize(address);
+  gchar *key = g_strconcat(service, "|", normalized, NULL);
+
+  g_free(normalized);
+
+  return key;
 }
 
-gchar **
-address_to_array(const NavigationAddress *address)
+/* Returns TRUE if key is cached and fresh, location is set to a new
+ * location then, or to NULL if the address was not found. The persistent
+ * cache is only consulted on a miss in memory. */
+static gboolean
+geocode_cache_lookup(const gchar *key, NavigationLocation **location)
 {
-  gchar **array = g_new(gchar *, 16);
+  NavigationGeocodeCache *cache = NULL;
+  gboolean hit = FALSE;
 
-  array[0] = get_safe_string(address->house_num);
-  array[1] = get_safe_string(address->house_name);
-  array[2] = get_safe_string(address->street);
-  array[3] = get_safe_string(address->suburb);
-  array[4] = get_safe_string(address->town);
-  array[5] = get_safe_string(address->municipality);
-  array[6] = get_safe_string(address->province);
-  array[7] = get_safe_string(address->postal_code);
-  array[8] = get_safe_string(address->country);
-  array[9] = get_safe_string(address->country_code);
-  array[10] = get_safe_string(address->time_zone);
-  array[11] = get_safe_string(NULL);
-  array[12] = get_safe_string(NULL);
-  array[13] = get_safe_string(NULL);
-  array[14] = get_safe_string(NULL);
-  array[15] = NULL;
+  g_mutex_lock(&geocode_cache_lock);
 
-  return array;
-}
+  if (geocode_cache)
+    cache = g_hash_table_lookup(geocode_cache, key);
 
-NavigationAddress *
-navigation_address_copy(NavigationAddress *address)
-{
-  NavigationAddress *copy;
+  if (cache)
+  {
+    if (g_get_monotonic_time() < cache->expires)
+    {
+      *location = NULL;
 
-  if (!address)
-    return NULL;
+      if (cache->found)
+      {
+        *location = g_new(NavigationLocation, 1);
+        **location = cache->location;
+      }
 
-  copy = g_memdup(address, sizeof(NavigationAddress));
+      g_queue_unlink(&geocode_lru, &cache->link);
+      g_queue_push_head_link(&geocode_lru, &cache->link);
+      hit = TRUE;
+    }
+    else
+      geocode_cache_remove_locked(cache);
+  }
 
-  copy->house_num = g_strdup(address->house_num);
-  copy->house_name = g_strdup(address->house_name);
-  copy->street = g_strdup(address->street);
-  copy->suburb = g_strdup(address->suburb);
-  copy->town = g_strdup(address->town);
-  copy->municipality = g_strdup(address->municipality);
-  copy->province = g_strdup(address->province);
-  copy->postal_code = g_strdup(address->postal_code);
-  copy->country = g_strdup(address->country);
-  copy->country_code = g_strdup(address->country_code);
-  copy->time_zone = g_strdup(address->time_zone);
+  g_mutex_unlock(&geocode_cache_lock);
 
-  return copy;
+  if (!hit && get_geocache())
+  {
+    hit = navigation_geocache_lookup(geocache, NAVIGATION_GEOCACHE_LOCATION,
+                                     key, (gpointer *)location);
+  }
+
+  return hit;
 }
 
-void
-navigation_make_resident()
+static void
+geocode_cache_store(const gchar *key, const NavigationLocation *location)
 {
-  GModule *module = g_module_open(LIBDIR "/libnavigation.so.0", 0);
+  gint64 ttl = geocode_cache_ttl(location != NULL);
+  NavigationGeocodeCache *cache;
 
-  if (!module)
+  if (get_geocache())
   {
-    g_critical("%s: g_module_open() failed: %s", __FUNCTION__,
-               g_module_error());
+    navigation_geocache_store(geocache, NAVIGATION_GEOCACHE_LOCATION, key,
+                              location, ttl);
   }
-  else
-    g_module_make_resident(module);
+
+  g_mutex_lock(&geocode_cache_lock);
+
+  if (!geocode_cache)
+  {
+    geocode_cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                          geocode_cache_free);
+  }
+
+  if ((cache = g_hash_table_lookup(geocode_cache, key)))
+    geocode_cache_remove_locked(cache);
+
+  if (ttl > 0)
+  {
+    cache = g_new0(NavigationGeocodeCache, 1);
+    cache->key = g_strdup(key);
+    cache->found = location != NULL;
+
+    if (location)
+      cache->location = *location;
+
+    cache->expires = g_get_monotonic_time() + ttl;
+    cache->link.data = cache;
+    g_hash_table_insert(geocode_cache, cache->key, cache);
+    g_queue_push_head_link(&geocode_lru, &cache->link);
+
+    while (geocode_lru.length > GEOCODE_CACHE_SIZE)
+      geocode_cache_remove_locked(geocode_lru.tail->data);
+  }
+
+  g_mutex_unlock(&geocode_cache_lock);
 }
 
-gchar *
-navigation_provider_get_default_service()
+/* Reverse geocoding results are only kept in the persistent cache, keyed by
+ * the location rounded to about a meter. */
+static gchar *
+reverse_cache_key(const gchar *service, const NavigationLocation *location)
 {
-  GConfClient *gconf = gconf_client_get_default();
-  GError *error = NULL;
-  gchar *service;
+  return g_strdup_printf("%s|%ld|%ld", service,
+                         lround(location->latitude * 1e5),
+                         lround(location->longitude * 1e5));
+}
 
-  service = gconf_client_get_string(gconf, "/apps/osso/navigation/service",
-                                    &error);
+static gboolean
+reverse_cache_lookup(const gchar *key, NavigationAddress **address)
+{
+  NavigationAddress *cached;
 
-  if (error)
+  if (!get_geocache() ||
+      !navigation_geocache_lookup(geocache, NAVIGATION_GEOCACHE_ADDRESS, key,
+                                  (gpointer *)&cached) || !cached)
   {
-    g_assert( service == NULL);
-    g_warning("service is not set: %s", error->message);
-    g_error_free(error);
+    return FALSE;
   }
 
-  g_object_unref(gconf);
+  *address = cached;
 
-  return service;
+  return TRUE;
 }
 
-void
-navigation_provider_set_default_service(const char *service)
+static void
+reverse_cache_store(const gchar *key, const NavigationAddress *address)
 {
-  gconf_client_set_string(gconf_client_get_default(),
-                          "/apps/osso/navigation/service", service, NULL);
+  if (get_geocache())
+  {
+    navigation_geocache_store(geocache, NAVIGATION_GEOCACHE_ADDRESS, key,
+                              address, geocode_cache_ttl(TRUE));
+  }
 }
 
-static int
-navigation_provider_service_init(NavigationProvider *provider, GError **error)
+/* A token bucket, shared by all providers talking to the same service. */
+struct _NavigationRateLimit
 {
-  NavigationProviderPrivate *priv = PRIVATE(provider);
+  /* tokens per second, no limit if 0 */
+  double rate;
+  double burst;
+  double tokens;
+  gint64 updated;
+};
 
-  if (priv->proxy)
-    return TRUE;
+typedef struct _NavigationRateLimit NavigationRateLimit;
 
-  if (!priv->service)
-    priv->service = navigation_provider_get_default_service();
+static GMutex rate_limit_lock;
+static GHashTable *rate_limits;
 
-  if (!priv->service)
+static void
+rate_limit_configure(const gchar *service)
+{
+  double rate = settings.rate_limit;
+  gint burst = settings.rate_burst;
+  NavigationRateLimit *limit;
+
+  g_mutex_lock(&rate_limit_lock);
+
+  if (!rate_limits)
   {
-    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_TOO_MANY_REQUESTS,
-                "Failed to identify the default service");
-    return FALSE;
+    rate_limits = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        g_free);
   }
 
-  priv->gdbus = dbus_g_bus_get(DBUS_BUS_SESSION, error);
+  limit = g_hash_table_lookup(rate_limits, service);
 
-  if (!priv->gdbus)
-    return FALSE;
+  if (!limit)
+  {
+    limit = g_new(NavigationRateLimit, 1);
+    limit->tokens = MAX(burst, 1);
+    limit->updated = g_get_monotonic_time();
+    g_hash_table_insert(rate_limits, g_strdup(service), limit);
+  }
 
-  priv->dbus = dbus_g_connection_get_connection(priv->gdbus);
+  limit->rate = MAX(rate, 0.0);
+  limit->burst = MAX(burst, 1);
+  limit->tokens = MIN(limit->tokens, limit->burst);
 
-  dbus_connection_add_filter(priv->dbus, navigation_provider_dbus_filter,
-                             provider, NULL);
-  dbus_bus_add_match(
-    priv->dbus,
-    "type='signal',interface='com.nokia.Navigation.MapProvider'", NULL);
-  priv->proxy = dbus_g_proxy_new_for_name(priv->gdbus, priv->service,
-                                          "/Provider",
-                                          "com.nokia.Navigation.MapProvider");
+  g_mutex_unlock(&rate_limit_lock);
+}
 
-  return TRUE;
+/* Takes a token for a request to service. Returns 0 on success, otherwise
+ * the microseconds until the next token. */
+static gint64
+rate_limit_take(const gchar *service, gint64 now)
+{
+  NavigationRateLimit *limit = NULL;
+  gint64 delay = 0;
+
+  g_mutex_lock(&rate_limit_lock);
+
+  if (rate_limits && service)
+    limit = g_hash_table_lookup(rate_limits, service);
+
+  if (limit && limit->rate > 0.0)
+  {
+    limit->tokens = MIN(limit->burst,
+                        limit->tokens +
+                        (now - limit->updated) * limit->rate /
+                        G_TIME_SPAN_SECOND);
+    limit->updated = now;
+
+    if (limit->tokens >= 1.0)
+      limit->tokens -= 1.0;
+    else
+    {
+      delay = ceil((1.0 - limit->tokens) * G_TIME_SPAN_SECOND / limit->rate);
+      delay = MAX(delay, 1);
+    }
+  }
+
+  g_mutex_unlock(&rate_limit_lock);
+
+  return delay;
 }
 
-gboolean
-navigation_provider_show_route(NavigationProvider *provider,
-                               NavigationLocation *from, NavigationLocation *to,
-                               unsigned int route_options,
-                               unsigned int map_options, GError **error)
+/* weight of the newest call in the moving averages */
+#define HEALTH_EWMA_WEIGHT 0.2
+/* the circuit opens after this many failures in a row, or once the error
+ * rate exceeds HEALTH_MAX_ERROR_RATE over at least HEALTH_MIN_CALLS calls */
+#define HEALTH_MAX_FAILURES 5
+#define HEALTH_MAX_ERROR_RATE 0.5
+#define HEALTH_MIN_CALLS 10
+/* how long an open circuit fails requests, doubled every failed probe */
+#define HEALTH_COOLDOWN (10 * G_TIME_SPAN_SECOND)
+#define HEALTH_MAX_COOLDOWN (5 * 60 * G_TIME_SPAN_SECOND)
+/* of the synchronous method calls, in milliseconds. A hung provider blocks
+ * the calling thread that long. */
+#define PROVIDER_CALL_TIMEOUT 10000
+/* how long queued requests wait for a provider that exited to come back,
+ * after that calling it activates it again */
+#define OWNER_RESTART_GRACE (5 * G_TIME_SPAN_SECOND)
+/* sent requests fail when the provider sends nothing for that long, checked
+ * every REPLY_TIMEOUT_INTERVAL seconds */
+#define REPLY_TIMEOUT (60 * G_TIME_SPAN_SECOND)
+#define REPLY_TIMEOUT_INTERVAL 5
+
+/* Circuit breaker of a service, shared by all providers talking to it. */
+struct _NavigationHealth
 {
-  NavigationProviderPrivate *priv;
+  NavigationServiceHealth stats;
+  guint failures;
+  gint64 opened_at;
+  gint64 cooldown;
+  /* the single call let through while half open is in flight */
+  gboolean probing;
+};
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+typedef struct _NavigationHealth NavigationHealth;
 
-  priv = PRIVATE(provider);
+typedef enum
+{
+  HEALTH_SUCCESS,
+  HEALTH_FAILURE,
+  HEALTH_TIMEOUT
+} NavigationHealthOutcome;
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+static GMutex health_lock;
+static GHashTable *healths;
 
-  return com_nokia_Navigation_MapProvider_show_route(
-           priv->proxy, from->latitude, from->longitude,
-           to->latitude, to->longitude, route_options, map_options, error);
+static NavigationHealth *
+health_lookup_locked(const gchar *service)
+{
+  NavigationHealth *health;
+
+  if (!healths)
+    healths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  health = g_hash_table_lookup(healths, service);
+
+  if (!health)
+  {
+    health = g_new0(NavigationHealth, 1);
+    health->cooldown = HEALTH_COOLDOWN;
+    g_hash_table_insert(healths, g_strdup(service), health);
+  }
+
+  return health;
 }
 
-gboolean
-navigation_provider_show_poi_categories(NavigationProvider *provider,
-                                        const char **categories,
-                                        unsigned int map_options,
-                                        GError **error)
+/* Whether a call to service may be made now. An open circuit turns half open
+ * once its cooldown is over, and then lets a single call through, *probe is
+ * set for that one. With probe NULL nothing changes, only calls failing for
+ * sure are refused. */
+static gboolean
+health_allow(const gchar *service, gint64 now, gboolean *probe)
 {
-  NavigationProviderPrivate *priv;
+  NavigationHealth *health;
+  gboolean allow = TRUE;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  if (!service)
+    return TRUE;
 
-  priv = PRIVATE(provider);
+  g_mutex_lock(&health_lock);
+  health = health_lookup_locked(service);
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+  switch (health->stats.state)
+  {
+    case NAVIGATION_CIRCUIT_CLOSED:
+    {
+      break;
+    }
+    case NAVIGATION_CIRCUIT_OPEN:
+    {
+      if (now < health->opened_at + health->cooldown)
+      {
+        allow = FALSE;
+        break;
+      }
 
-  return com_nokia_Navigation_MapProvider_show_places_po_icategories(
-           priv->proxy, categories, map_options, error);
+      if (!probe)
+        break;
+
+      health->stats.state = NAVIGATION_CIRCUIT_HALF_OPEN;
+      health->probing = FALSE;
+    }
+    /* fall through */
+    case NAVIGATION_CIRCUIT_HALF_OPEN:
+    {
+      if (health->probing)
+        allow = FALSE;
+      else if (probe)
+        health->probing = *probe = TRUE;
+
+      break;
+    }
+  }
+
+  if (!allow)
+    health->stats.n_rejected++;
+
+  g_mutex_unlock(&health_lock);
+
+  return allow;
 }
 
-gboolean
-navigation_provider_show_location(NavigationProvider *provider,
-                                  NavigationLocation *location,
-                                  unsigned int map_options, GError **error)
+static void
+health_open_locked(NavigationHealth *health, gint64 now)
 {
-  NavigationProviderPrivate *priv;
+  if (health->stats.state == NAVIGATION_CIRCUIT_HALF_OPEN)
+    health->cooldown = MIN(2 * health->cooldown, HEALTH_MAX_COOLDOWN);
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  health->stats.state = NAVIGATION_CIRCUIT_OPEN;
+  health->opened_at = now;
+  health->probing = FALSE;
+}
 
-  priv = PRIVATE(provider);
+static void
+health_record(const gchar *service, NavigationHealthOutcome outcome,
+              gint64 latency)
+{
+  NavigationHealth *health;
+  NavigationServiceHealth *stats;
+  gint64 now = g_get_monotonic_time();
+  double error = outcome != HEALTH_SUCCESS;
+  double timeout = outcome == HEALTH_TIMEOUT;
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+  if (!service)
+    return;
 
-  return com_nokia_Navigation_MapProvider_show_place_geo(
-           priv->proxy, location->latitude, location->longitude, map_options,
-           error);
+  g_mutex_lock(&health_lock);
+  health = health_lookup_locked(service);
+  stats = &health->stats;
+
+  if (stats->n_calls++)
+  {
+    stats->error_rate += HEALTH_EWMA_WEIGHT * (error - stats->error_rate);
+    stats->timeout_rate += HEALTH_EWMA_WEIGHT *
+      (timeout - stats->timeout_rate);
+  }
+  else
+  {
+    stats->error_rate = error;
+    stats->timeout_rate = timeout;
+  }
+
+  if (outcome == HEALTH_SUCCESS)
+  {
+    if (stats->latency)
+      stats->latency += HEALTH_EWMA_WEIGHT * (latency - stats->latency);
+    else
+      stats->latency = latency;
+
+    health->failures = 0;
+
+    if (stats->state == NAVIGATION_CIRCUIT_HALF_OPEN)
+    {
+      stats->state = NAVIGATION_CIRCUIT_CLOSED;
+      health->cooldown = HEALTH_COOLDOWN;
+      health->probing = FALSE;
+    }
+  }
+  else
+  {
+    health->failures++;
+
+    if (stats->state == NAVIGATION_CIRCUIT_HALF_OPEN ||
+        (stats->state == NAVIGATION_CIRCUIT_CLOSED &&
+         (health->failures >= HEALTH_MAX_FAILURES ||
+          (stats->n_calls >= HEALTH_MIN_CALLS &&
+           stats->error_rate > HEALTH_MAX_ERROR_RATE))))
+    {
+      g_debug("Circuit of service %s opened", service);
+      health_open_locked(health, now);
+    }
+  }
+
+  g_mutex_unlock(&health_lock);
 }
 
-gboolean
-navigation_provider_show_places(NavigationProvider *provider,
-                                const char **places, unsigned int map_options,
-                                GError **error)
+/* A probe that ended without a reply tells nothing about the service, the
+ * next call probes again. */
+static void
+health_release(const gchar *service)
 {
-  NavigationProviderPrivate *priv;
+  NavigationHealth *health;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  if (!service)
+    return;
 
-  priv = PRIVATE(provider);
+  g_mutex_lock(&health_lock);
+  health = health_lookup_locked(service);
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+  if (health->stats.state == NAVIGATION_CIRCUIT_HALF_OPEN)
+    health->probing = FALSE;
+
+  g_mutex_unlock(&health_lock);
+}
+
+static NavigationHealthOutcome
+health_outcome_from_error(const GError *error)
+{
+  if (g_error_matches(error, DBUS_GERROR, DBUS_GERROR_NO_REPLY) ||
+      g_error_matches(error, DBUS_GERROR, DBUS_GERROR_TIMEOUT))
+  {
+    return HEALTH_TIMEOUT;
+  }
+
+  return HEALTH_FAILURE;
+}
+
+/* Request records are recycled, never freed. They are allocated a slab at a
+ * time, so a steady stream of requests does not allocate any. */
+#define REQUEST_SLAB_SIZE 32
+
+static GMutex request_pool_lock;
+static NavigationProviderRequest *request_pool;
+
+static NavigationProviderRequest *
+request_alloc(void)
+{
+  NavigationProviderRequest *request;
+
+  g_mutex_lock(&request_pool_lock);
+
+  if (!request_pool)
+  {
+    NavigationProviderRequest *slab =
+      g_new(NavigationProviderRequest, REQUEST_SLAB_SIZE);
+    int i;
+
+    for (i = 0; i < REQUEST_SLAB_SIZE - 1; i++)
+      slab[i].next_free = &slab[i + 1];
+
+    slab[i].next_free = NULL;
+    request_pool = slab;
+  }
+
+  request = request_pool;
+  request_pool = request->next_free;
+
+  g_mutex_unlock(&request_pool_lock);
+
+  memset(request, 0, sizeof(*request));
+
+  return request;
+}
+
+static void
+request_free(NavigationProviderRequest *request)
+{
+  g_mutex_lock(&request_pool_lock);
+  request->next_free = request_pool;
+  request_pool = request;
+  g_mutex_unlock(&request_pool_lock);
+}
+
+/* The records handing requests and replies to idle sources are recycled the
+ * same way. */
+static GMutex reply_pool_lock;
+static NavigationProviderReply *reply_pool;
+
+static NavigationProviderReply *
+reply_alloc(NavigationProvider *provider, NavigationProviderRequest *request,
+            DBusMessage *message)
+{
+  NavigationProviderReply *reply;
+
+  g_mutex_lock(&reply_pool_lock);
+
+  if (!reply_pool)
+  {
+    NavigationProviderReply *slab =
+      g_new(NavigationProviderReply, REQUEST_SLAB_SIZE);
+    int i;
+
+    for (i = 0; i < REQUEST_SLAB_SIZE - 1; i++)
+      slab[i].next_free = &slab[i + 1];
+
+    slab[i].next_free = NULL;
+    reply_pool = slab;
+  }
+
+  reply = reply_pool;
+  reply_pool = reply->next_free;
+
+  g_mutex_unlock(&reply_pool_lock);
+
+  reply->provider = g_object_ref(provider);
+  reply->request = request;
+  reply->message = message ? dbus_message_ref(message) : NULL;
+
+  return reply;
+}
+
+static void
+reply_free(NavigationProviderReply *reply)
+{
+  g_mutex_lock(&reply_pool_lock);
+  reply->next_free = reply_pool;
+  reply_pool = reply;
+  g_mutex_unlock(&reply_pool_lock);
+}
+
+/* Providers name the object paths of requests after a counter, the number
+ * the path ends with is the id then. Other paths are hashed, with the top
+ * bit set so that they can not collide with a number. */
+static guint64
+request_id_from_path(const char *path)
+{
+  const char *p = strrchr(path, '/');
+  guint64 id = 0;
+
+  if (p && p[1] && strspn(p + 1, "0123456789") == strlen(p + 1) &&
+      strlen(p + 1) < 19)
+  {
+    for (p++; *p; p++)
+      id = id * 10 + (*p - '0');
+
+    return id;
+  }
+
+  return G_GUINT64_CONSTANT(0x8000000000000000) | g_str_hash(path);
+}
+
+#define REQUEST_TABLE_MIN_SIZE 16
+
+static inline guint
+request_table_home(NavigationRequestTable *table, guint64 id)
+{
+  /* Fibonacci hashing, the upper bits are the best mixed */
+  return (guint)((id * G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)) >> 32) &
+         (table->size - 1);
+}
+
+static void
+request_table_init(NavigationRequestTable *table)
+{
+  table->size = REQUEST_TABLE_MIN_SIZE;
+  table->n_requests = 0;
+  table->slots = g_new0(NavigationRequestSlot, table->size);
+}
+
+static void
+request_table_add(NavigationRequestTable *table,
+                  NavigationProviderRequest *request);
+
+static void
+request_table_grow(NavigationRequestTable *table)
+{
+  NavigationRequestSlot *slots = table->slots;
+  guint size = table->size;
+  guint i;
+
+  table->size *= 2;
+  table->n_requests = 0;
+  table->slots = g_new0(NavigationRequestSlot, table->size);
+
+  for (i = 0; i < size; i++)
+  {
+    if (slots[i].request)
+      request_table_add(table, slots[i].request);
+  }
+
+  g_free(slots);
+}
+
+/* Takes over the reference of the caller. */
+static void
+request_table_add(NavigationRequestTable *table,
+                  NavigationProviderRequest *request)
+{
+  guint i;
+
+  if (2 * (table->n_requests + 1) > table->size)
+    request_table_grow(table);
+
+  i = request_table_home(table, request->id);
+
+  while (table->slots[i].request)
+    i = (i + 1) & (table->size - 1);
+
+  table->slots[i].id = request->id;
+  table->slots[i].request = request;
+  table->n_requests++;
+}
+
+/* the object path is compared only for the request with a matching id */
+static NavigationProviderRequest *
+request_table_lookup(NavigationRequestTable *table, guint64 id,
+                     const char *path)
+{
+  guint i = request_table_home(table, id);
+  NavigationRequestSlot *slot;
+
+  while ((slot = &table->slots[i])->request)
+  {
+    if (slot->id == id && !strcmp(slot->request->object_path, path))
+      return slot->request;
+
+    i = (i + 1) & (table->size - 1);
+  }
+
+  return NULL;
+}
+
+/* Removes request without dropping its reference. Later entries of the probe
+ * sequence move up, so that no tombstones are needed. */
+static gboolean
+request_table_steal(NavigationRequestTable *table,
+                    NavigationProviderRequest *request)
+{
+  guint mask = table->size - 1;
+  guint i = request_table_home(table, request->id);
+  guint j;
+
+  while (table->slots[i].request != request)
+  {
+    if (!table->slots[i].request)
+      return FALSE;
+
+    i = (i + 1) & mask;
+  }
+
+  table->slots[i].request = NULL;
+  table->n_requests--;
+
+  for (j = (i + 1) & mask; table->slots[j].request; j = (j + 1) & mask)
+  {
+    guint home = request_table_home(table, table->slots[j].id);
+
+    /* the entry may move to the hole unless its home is after the hole */
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      table->slots[i] = table->slots[j];
+      table->slots[j].request = NULL;
+      i = j;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Removes all requests and returns them, with their references. */
+static GSList *
+request_table_steal_all(NavigationRequestTable *table)
+{
+  GSList *requests = NULL;
+  guint i;
+
+  for (i = 0; i < table->size; i++)
+  {
+    if (table->slots[i].request)
+    {
+      requests = g_slist_prepend(requests, table->slots[i].request);
+      table->slots[i].request = NULL;
+    }
+  }
+
+  table->n_requests = 0;
+
+  return requests;
+}
+
+static NavigationProviderRequest *
+navigation_provider_request_new(NavigationProviderRequestType type,
+                                GCallback cb, gboolean verbose,
+                                gpointer userdata, GCancellable *cancellable)
+{
+  NavigationProviderRequest *request = request_alloc();
+
+  request->ref_count = 1;
+  request->type = type;
+  request->cb = cb;
+  request->verbose = verbose;
+  request->user_data = userdata;
+  request->context = g_main_context_ref_thread_default();
+  request->priority = navigation_priority_get_thread_default();
+
+  if (cancellable)
+    request->cancellable = g_object_ref(cancellable);
+
+  return request;
+}
+
+static NavigationProviderRequest *
+navigation_provider_request_ref(NavigationProviderRequest *request)
+{
+  g_atomic_int_inc(&request->ref_count);
+
+  return request;
+}
+
+static void
+navigation_provider_request_unref(NavigationProviderRequest *request)
+{
+  if (!g_atomic_int_dec_and_test(&request->ref_count))
+    return;
+
+  if (request->cancellable)
+  {
+    g_cancellable_disconnect(request->cancellable,
+                             request->queued_cancelled_id);
+    g_cancellable_disconnect(request->cancellable, request->cancelled_id);
+    g_object_unref(request->cancellable);
+  }
+
+  if (request->args)
+    g_variant_unref(request->args);
+
+  g_clear_error(&request->error);
+  g_main_context_unref(request->context);
+  g_free(request->object_path);
+  g_free(request->cache_key);
+  request_free(request);
+}
+
+/* Returns the encoded tile of a GetMapTileReply without copying it, the
+ * bytes keep a reference to message instead. */
+static GBytes *
+get_map_tile(DBusMessage *message, NavigationArea **area)
+{
+  DBusMessageIter iter;
+  DBusMessageIter sub;
+  NavigationLocation *location;
+  int n_elements;
+  guint8 *stream;
+
+  *area = NULL;
+  dbus_message_iter_init(message, &iter);
+
+  if ((dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) ||
+      (dbus_message_iter_get_element_type(&iter) != DBUS_TYPE_BYTE))
+  {
+    return NULL;
+  }
+
+  dbus_message_iter_recurse(&iter, &sub);
+  dbus_message_iter_get_fixed_array(&sub, &stream, &n_elements);
+
+  if (n_elements <= 0)
+    return NULL;
+
+  *area = g_new0(NavigationArea, 1);
+
+  dbus_message_iter_next(&iter);
+
+  if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_STRUCT)
+  {
+    location = get_location(&iter);
+    (*area)->nw = *location;
+    navigation_location_free(location);
+  }
+
+  dbus_message_iter_next(&iter);
+
+  if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_STRUCT)
+  {
+    location = get_location(&iter);
+    (*area)->se = *location;
+    navigation_location_free(location);
+  }
+
+  return g_bytes_new_with_free_func(stream, n_elements,
+                                    (GDestroyNotify)dbus_message_unref,
+                                    dbus_message_ref(message));
+}
+
+/* reads (ay polyline, d length, d duration) of a GetRouteReply */
+static NavigationRoute *
+get_route(DBusMessageIter *iter, GError **error)
+{
+  NavigationRoute *route;
+  DBusMessageIter sub;
+  int n_elements = 0;
+  guint8 *stream = NULL;
+
+  if ((dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY) ||
+      (dbus_message_iter_get_element_type(iter) != DBUS_TYPE_BYTE))
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                "Route reply without polyline");
+    return NULL;
+  }
+
+  dbus_message_iter_recurse(iter, &sub);
+  dbus_message_iter_get_fixed_array(&sub, &stream, &n_elements);
+
+  route = g_new0(NavigationRoute, 1);
+  route->points = navigation_polyline_decode(stream, n_elements,
+                                             &route->n_points, error);
+
+  if (!route->points && n_elements)
+  {
+    g_free(route);
+    return NULL;
+  }
+
+  dbus_message_iter_next(iter);
+
+  if (dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_DOUBLE)
+    dbus_message_iter_get_basic(iter, &route->length);
+
+  dbus_message_iter_next(iter);
+
+  if (dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_DOUBLE)
+    dbus_message_iter_get_basic(iter, &route->duration);
+
+  return route;
+}
+
+static gboolean
+is_partial_reply(DBusMessage *message)
+{
+  return dbus_message_is_signal(message, MAP_PROVIDER_INTERFACE,
+                                "AddressToLocationsChunk");
+}
+
+static void
+navigation_provider_handle_cancel(NavigationProvider *provider,
+                                  NavigationProviderRequest *request)
+{
+  GError *error = NULL;
+
+  if (request->verbose)
+  {
+    if (request->error)
+      error = g_error_copy(request->error);
+    else
+    {
+      error = g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                          "Operation was cancelled");
+    }
+  }
+
+  switch (request->type)
+  {
+    case REQUEST_LOCATION_TO_ADDRESS:
+    {
+      if (request->verbose)
+      {
+        ((NavigationProviderLocationToAddressVerboseCallback)request->cb)(
+          provider, NULL, error, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderLocationToAddressCallback)request->cb)(
+          provider, NULL, request->user_data);
+      }
+
+      break;
+    }
+    case REQUEST_ADDRESS_TO_LOCATION:
+    {
+      if (request->verbose)
+      {
+        ((NavigationProviderAddressToLocationVerboseCallback)request->cb)(
+          provider, NULL, error, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderAddressToLocationCallback)request->cb)(
+          provider, NULL, request->user_data);
+      }
+
+      break;
+    }
+    case REQUEST_MAP_TILE:
+    {
+      ((NavigationProviderGetPixbufCallback)request->cb)(
+        provider, NULL, NULL, request->user_data);
+      break;
+    }
+    case REQUEST_MAP_TILE_BYTES:
+    {
+      ((NavigationProviderGetTileBytesCallback)request->cb)(
+        provider, NULL, NULL, request->user_data);
+      break;
+    }
+    case REQUEST_LOCATION_FROM_MAP:
+    {
+      ((NavigationProviderGetLocationCallback)request->cb)(
+        provider, NULL, request->user_data);
+      break;
+    }
+    case REQUEST_POI_CATEGORIES:
+    {
+      ((NavigationProviderGetPOICategoriesCallback)request->cb)(
+        provider, NULL, request->user_data);
+      break;
+    }
+    case REQUEST_POI_CATEGORIES_SHARED:
+    {
+      ((NavigationProviderGetSharedPOICategoriesCallback)request->cb)(
+        provider, NULL, request->user_data);
+      break;
+    }
+    case REQUEST_ROUTE:
+    {
+      ((NavigationProviderGetRouteCallback)request->cb)(
+        provider, NULL, error, request->user_data);
+      break;
+    }
+    case REQUEST_ROUTE_MATRIX:
+    {
+      ((NavigationProviderRouteMatrixTileCallback)request->cb)(
+        provider, NULL, NULL, 0, error, request->user_data);
+      break;
+    }
+    case REQUEST_ADDRESS_TO_LOCATIONS_STREAMED:
+    {
+      ((NavigationProviderAddressToLocationsDoneCallback)request->done_cb)(
+        provider, request->n_results, error, request->user_data);
+      break;
+    }
+    case REQUEST_LOCATION_TO_ADDRESS_CACHED:
+    {
+      ((NavigationProviderAddressListCallback)request->cb)(
+        provider, NULL, error, request->user_data);
+      break;
+    }
+  }
+}
+
+/* reads an a(dd) into an array of NavigationLocation */
+static GArray *
+get_locations(DBusMessageIter *iter)
+{
+  GArray *locations = g_array_new(FALSE, FALSE, sizeof(NavigationLocation));
+  DBusMessageIter sub;
+
+  if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+    return locations;
+
+  dbus_message_iter_recurse(iter, &sub);
+
+  while (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_STRUCT)
+  {
+    NavigationLocation *location = get_location(&sub);
+
+    g_array_append_val(locations, *location);
+    navigation_location_free(location);
+    dbus_message_iter_next(&sub);
+  }
+
+  return locations;
+}
+
+static void
+navigation_provider_handle_streamed_reply(NavigationProvider *provider,
+                                          NavigationProviderRequest *request,
+                                          DBusMessage *message)
+{
+  NavigationProviderAddressToLocationsDoneCallback done_cb =
+    (NavigationProviderAddressToLocationsDoneCallback)request->done_cb;
+  DBusMessageIter iter;
+
+  if (is_partial_reply(message) ||
+      dbus_message_is_signal(message, MAP_PROVIDER_INTERFACE,
+                             "AddressToLocationsReply"))
+  {
+    GArray *locations;
+
+    /* a provider without streaming support replies to the fallback
+     * AddressToLocations call with all locations at once */
+    dbus_message_iter_init(message, &iter);
+    locations = get_locations(&iter);
+
+    if (locations->len)
+    {
+      request->n_results += locations->len;
+      ((NavigationProviderAddressToLocationsChunkCallback)request->cb)(
+        provider, (const NavigationLocation *)locations->data,
+        locations->len, request->user_data);
+    }
+
+    g_array_free(locations, TRUE);
+
+    if (!is_partial_reply(message))
+      done_cb(provider, request->n_results, NULL, request->user_data);
+  }
+  else if (dbus_message_is_signal(message, MAP_PROVIDER_INTERFACE,
+                                  "AddressToLocationsDone"))
+  {
+    done_cb(provider, request->n_results, NULL, request->user_data);
+  }
+  else if (dbus_message_is_signal(message, MAP_PROVIDER_INTERFACE,
+                                  "AddressToLocationError"))
+  {
+    done_cb(provider, request->n_results,
+            g_error_new(NAVIGATION_ERROR,
+                        NAVIGATION_ERROR_USER_CANCELED_OPERATION,
+                        "User canceled operation"),
+            request->user_data);
+  }
+  else
+    g_warning("Unknown reply recieved");
+}
+
+static void navigation_provider_handle_cached_reply(
+  NavigationProvider *provider, NavigationProviderRequest *request,
+  DBusMessage *message);
+
+static void
+navigation_provider_handle_reply(NavigationProvider *provider,
+                                 NavigationProviderRequest *request,
+                                 DBusMessage *message)
+{
+  DBusMessageIter sub1;
+  DBusMessageIter sub2;
+  DBusMessageIter iter;
+
+  if (request->cb)
+  {
+    if (!message)
+      navigation_provider_handle_cancel(provider, request);
+    else if (request->type == REQUEST_ADDRESS_TO_LOCATIONS_STREAMED)
+      navigation_provider_handle_streamed_reply(provider, request, message);
+    else if (request->type == REQUEST_LOCATION_TO_ADDRESS_CACHED)
+      navigation_provider_handle_cached_reply(provider, request, message);
+    else if (dbus_message_is_signal(message,
+                               MAP_PROVIDER_INTERFACE,
+                               "LocationToAddressReply"))
+    {
+      NavigationAddress *address = NULL;
+
+      dbus_message_iter_init(message, &iter);
+
+      if (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY)
+      {
+        dbus_message_iter_recurse(&iter, &sub1);
+
+        if (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_STRUCT)
+          address = get_encoded_address(&sub1);
+        else if (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_ARRAY)
+        {
+          int i = 0;
+
+          address = g_new0(NavigationAddress, 1);
+          dbus_message_iter_recurse(&sub1, &sub2);
+
+          while (dbus_message_iter_get_arg_type(&sub2) != DBUS_TYPE_INVALID)
+          {
+            const gchar *v;
+
+            dbus_message_iter_get_basic(&sub2, &v);
+            array_to_address(&address, i, v);
+            dbus_message_iter_next(&sub2);
+            i++;
+          }
+        }
+      }
+
+      check_country(address);
+
+      if (address && request->cache_key)
+        reverse_cache_store(request->cache_key, address);
+
+      if (request->verbose)
+      {
+        ((NavigationProviderLocationToAddressVerboseCallback)request->cb)(
+          provider, address, NULL, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderLocationToAddressCallback)request->cb)(
+          provider, address, request->user_data);
+      }
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "LocationToAddressError"))
+    {
+      if (request->verbose)
+      {
+        ((NavigationProviderLocationToAddressVerboseCallback)request->cb)
+          (provider, NULL,
+          g_error_new(NAVIGATION_ERROR,
+                      NAVIGATION_ERROR_USER_CANCELED_OPERATION,
+                      "User canceled operation"),
+          request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderLocationToAddressCallback)request->cb)(
+          provider, NULL, request->user_data);
+      }
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "AddressToLocationError"))
+    {
+      if (request->verbose)
+      {
+        ((NavigationProviderAddressToLocationVerboseCallback)request->cb)
+          (provider, NULL,
+          g_error_new(NAVIGATION_ERROR,
+                      NAVIGATION_ERROR_USER_CANCELED_OPERATION,
+                      "User canceled operation"),
+          request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderAddressToLocationCallback)request->cb)(
+          provider, NULL, request->user_data);
+      }
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "AddressToLocationsReply"))
+    {
+      NavigationLocation *location = NULL;
+
+      dbus_message_iter_init(message, &sub2);
+
+      if (dbus_message_iter_get_arg_type(&sub2))
+      {
+        dbus_message_iter_recurse(&sub2, &sub1);
+
+        if (dbus_message_iter_get_arg_type(&sub1))
+          location = get_location(&sub1);
+      }
+
+      if (request->cache_key)
+        geocode_cache_store(request->cache_key, location);
+
+      if (request->verbose)
+      {
+        ((NavigationProviderAddressToLocationVerboseCallback)request->cb)(
+          provider, location, NULL, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderAddressToLocationCallback)request->cb)(
+          provider, location, request->user_data);
+      }
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "GetMapTileReply"))
+    {
+      NavigationArea *area = NULL;
+      GBytes *tile = get_map_tile(message, &area);
+
+      if (request->type == REQUEST_MAP_TILE_BYTES)
+      {
+        ((NavigationProviderGetTileBytesCallback)request->cb)(
+          provider, tile, area, request->user_data);
+      }
+      else
+      {
+        GdkPixbuf *pixbuf = NULL;
+
+        if (tile)
+        {
+          pixbuf = navigation_map_tile_decode(tile, NULL);
+          g_bytes_unref(tile);
+        }
+
+        if (!pixbuf)
+        {
+          g_free(area);
+          area = NULL;
+        }
+
+        ((NavigationProviderGetPixbufCallback)request->cb)(
+          provider, pixbuf, area, request->user_data);
+      }
+    }
+
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "GetRouteReply"))
+    {
+      NavigationRoute *route = NULL;
+      GError *error = NULL;
+
+      dbus_message_iter_init(message, &iter);
+      route = get_route(&iter, &error);
+
+      ((NavigationProviderGetRouteCallback)request->cb)(
+        provider, route, error, request->user_data);
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "GetRouteMatrixReply"))
+    {
+      double *durations = NULL;
+      double *lengths = NULL;
+      int n_durations = 0;
+      int n_lengths = 0;
+
+      dbus_message_iter_init(message, &iter);
+
+      if ((dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) &&
+          (dbus_message_iter_get_element_type(&iter) == DBUS_TYPE_DOUBLE))
+      {
+        dbus_message_iter_recurse(&iter, &sub1);
+        dbus_message_iter_get_fixed_array(&sub1, &durations, &n_durations);
+        dbus_message_iter_next(&iter);
+      }
+
+      if ((dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) &&
+          (dbus_message_iter_get_element_type(&iter) == DBUS_TYPE_DOUBLE))
+      {
+        dbus_message_iter_recurse(&iter, &sub1);
+        dbus_message_iter_get_fixed_array(&sub1, &lengths, &n_lengths);
+      }
+
+      if (n_durations != n_lengths)
+      {
+        ((NavigationProviderRouteMatrixTileCallback)request->cb)(
+          provider, NULL, NULL, 0,
+          g_error_new(NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                      "Route matrix reply size mismatch"),
+          request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderRouteMatrixTileCallback)request->cb)(
+          provider, durations, lengths, n_durations, NULL,
+          request->user_data);
+      }
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "GetRouteMatrixError"))
+    {
+      ((NavigationProviderRouteMatrixTileCallback)request->cb)(
+        provider, NULL, NULL, 0,
+        g_error_new(NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                    "No routes found"),
+        request->user_data);
+    }
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "GetRouteError"))
+    {
+      ((NavigationProviderGetRouteCallback)request->cb)(
+        provider, NULL,
+        g_error_new(NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                    "No route found"),
+        request->user_data);
+    }
+
+#if 0
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "CoordinateReply"))
+    {
+      NavigationLocation *location = g_new(NavigationLocation, 1);
+
+      if (!dbus_message_get_args(message, NULL,
+                                 DBUS_TYPE_DOUBLE, &location->latitude,
+                                 DBUS_TYPE_DOUBLE, &location->longitude,
+                                 DBUS_TYPE_INVALID))
+      {
+        g_warning("Could not parse get location from map response signal");
+        navigation_location_free(location);
+        location = NULL;
+      }
+
+      request->cb(provider, location, request->user_data);
+    }
+#endif
+    else if (dbus_message_is_signal(message,
+                                    MAP_PROVIDER_INTERFACE,
+                                    "GetPOICategoriesReply"))
+    {
+      char **categories = NULL;
+
+      dbus_message_iter_init(message, &sub2);
+
+      if (dbus_message_iter_get_arg_type(&sub2) != DBUS_TYPE_INVALID)
+      {
+        /* the strings are borrowed from message until copied in one go */
+        GPtrArray *array = g_ptr_array_new();
+
+        dbus_message_iter_recurse(&sub2, &sub1);
+
+        while (dbus_message_iter_get_arg_type(&sub1) == DBUS_TYPE_STRING)
+        {
+          const gchar *v;
+
+          dbus_message_iter_get_basic(&sub1, &v);
+          g_ptr_array_add(array, (gpointer)v);
+          dbus_message_iter_next(&sub1);
+        }
+
+        categories = poi_categories_new((const char * const *)array->pdata,
+                                        array->len);
+        g_ptr_array_free(array, TRUE);
+        poi_cache_store(PRIVATE(provider)->service, categories);
+      }
+
+      if (request->type == REQUEST_POI_CATEGORIES_SHARED)
+      {
+        ((NavigationProviderGetSharedPOICategoriesCallback)request->cb)(
+          provider, (const char * const *)categories, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderGetPOICategoriesCallback)request->cb)(
+          provider, g_strdupv(categories), request->user_data);
+      }
+
+      if (categories)
+        g_atomic_rc_box_release(categories);
+    }
+    else
+      g_warning("Unknown reply recieved");
+  }
+}
+
+static gboolean
+navigation_provider_reply_idle(gpointer user_data)
+{
+  NavigationProviderReply *reply = user_data;
+
+  navigation_provider_handle_reply(reply->provider, reply->request,
+                                   reply->message);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+navigation_provider_reply_free(gpointer user_data)
+{
+  NavigationProviderReply *reply = user_data;
+
+  navigation_provider_request_unref(reply->request);
+
+  if (reply->message)
+    dbus_message_unref(reply->message);
+
+  g_object_unref(reply->provider);
+  reply_free(reply);
+}
+
+/* Takes over the reference to request. Replies always go through an idle
+ * source, so they are delivered in order, never from within a
+ * GCancellable::cancelled handler, where freeing the request would deadlock,
+ * and never before the call that issued the request returned, even when a
+ * reply overtook it. */
+static void
+navigation_provider_dispatch_reply(NavigationProvider *provider,
+                                   NavigationProviderRequest *request,
+                                   DBusMessage *message)
+{
+  NavigationProviderReply *reply = reply_alloc(provider, request, message);
+  GSource *source = g_idle_source_new();
+
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, navigation_provider_reply_idle, reply,
+                        navigation_provider_reply_free);
+  g_source_attach(source, request->context);
+  g_source_unref(source);
+}
+
+struct _NavigationProviderLocalReply
+{
+  NavigationProvider *provider;
+  NavigationProviderRequest *request;
+  /* NavigationAddress, NavigationLocation or shared POI categories,
+   * depending on the request */
+  gpointer result;
+};
+
+typedef struct _NavigationProviderLocalReply NavigationProviderLocalReply;
+
+static void
+navigation_provider_local_result_free(NavigationProviderRequest *request,
+                                      gpointer result)
+{
+  switch (request->type)
+  {
+    case REQUEST_LOCATION_TO_ADDRESS:
+      navigation_address_free(result);
+      break;
+    case REQUEST_POI_CATEGORIES:
+    case REQUEST_POI_CATEGORIES_SHARED:
+      g_atomic_rc_box_release(result);
+      break;
+    default:
+      navigation_location_free(result);
+      break;
+  }
+}
+
+static gboolean
+navigation_provider_local_reply_idle(gpointer user_data)
+{
+  NavigationProviderLocalReply *reply = user_data;
+  NavigationProviderRequest *request = reply->request;
+
+  if (request->cancellable && g_cancellable_is_cancelled(request->cancellable))
+  {
+    navigation_provider_handle_cancel(reply->provider, request);
+    return G_SOURCE_REMOVE;
+  }
+
+  switch (request->type)
+  {
+    case REQUEST_LOCATION_TO_ADDRESS:
+    {
+      if (request->verbose)
+      {
+        ((NavigationProviderLocationToAddressVerboseCallback)request->cb)(
+          reply->provider, reply->result, NULL, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderLocationToAddressCallback)request->cb)(
+          reply->provider, reply->result, request->user_data);
+      }
+
+      /* the callback owns it now */
+      reply->result = NULL;
+      break;
+    }
+    case REQUEST_POI_CATEGORIES:
+    {
+      ((NavigationProviderGetPOICategoriesCallback)request->cb)(
+        reply->provider, g_strdupv(reply->result), request->user_data);
+      break;
+    }
+    case REQUEST_POI_CATEGORIES_SHARED:
+    {
+      ((NavigationProviderGetSharedPOICategoriesCallback)request->cb)(
+        reply->provider, reply->result, request->user_data);
+      break;
+    }
+    default:
+    {
+      if (request->verbose)
+      {
+        ((NavigationProviderAddressToLocationVerboseCallback)request->cb)(
+          reply->provider, reply->result, NULL, request->user_data);
+      }
+      else
+      {
+        ((NavigationProviderAddressToLocationCallback)request->cb)(
+          reply->provider, reply->result, request->user_data);
+      }
+
+      reply->result = NULL;
+      break;
+    }
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+navigation_provider_local_reply_free(gpointer user_data)
+{
+  NavigationProviderLocalReply *reply = user_data;
+
+  if (reply->result)
+    navigation_provider_local_result_free(reply->request, reply->result);
+
+  navigation_provider_request_unref(reply->request);
+  g_object_unref(reply->provider);
+  g_free(reply);
+}
+
+/* Delivers an address or location found in the offline dataset, or cached POI
+ * categories, the same way a provider reply would be. Takes over the
+ * reference to request and result. */
+static void
+navigation_provider_dispatch_local_reply(NavigationProvider *provider,
+                                         NavigationProviderRequest *request,
+                                         gpointer result)
+{
+  NavigationProviderLocalReply *reply = g_new(NavigationProviderLocalReply, 1);
+  GSource *source = g_idle_source_new();
+
+  reply->provider = g_object_ref(provider);
+  reply->request = request;
+  reply->result = result;
+
+  if (request->type == REQUEST_LOCATION_TO_ADDRESS)
+    check_country(result);
+
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, navigation_provider_local_reply_idle, reply,
+                        navigation_provider_local_reply_free);
+  g_source_attach(source, request->context);
+  g_source_unref(source);
+}
+
+static void
+free_early_replies(GSList *replies)
+{
+  g_slist_free_full(replies, (GDestroyNotify)dbus_message_unref);
+}
+
+static void navigation_provider_schedule_locked(NavigationProvider *provider);
+
+/* the request is alive while connected, the handler is disconnected before
+ * its record goes back to the pool */
+static void
+navigation_provider_request_cancelled(GCancellable *cancellable,
+                                      gpointer user_data)
+{
+  NavigationProviderRequest *request = user_data;
+  NavigationProviderPrivate *priv = PRIVATE(request->provider);
+  gboolean found;
+
+  g_mutex_lock(&priv->lock);
+
+  if ((found = request_table_steal(&priv->requests, request)))
+    navigation_provider_schedule_locked(request->provider);
+
+  g_mutex_unlock(&priv->lock);
+
+  if (found)
+  {
+    if (request->probe)
+      health_release(priv->service);
+
+    navigation_provider_dispatch_reply(request->provider, request, NULL);
+  }
+}
+
+/* Pending requests fail when the owner of the service goes away, they would
+ * never get a reply. Queued ones wait for a new owner instead. */
+static void
+navigation_provider_name_owner_changed(NavigationProvider *provider,
+                                       DBusMessage *message)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  GSList *lost = NULL;
+  GSList *l;
+  const char *name;
+  const char *old_owner;
+  const char *new_owner;
+
+  if (g_strcmp0(dbus_message_get_sender(message), DBUS_SERVICE_DBUS) ||
+      !dbus_message_get_args(message, NULL, DBUS_TYPE_STRING, &name,
+                             DBUS_TYPE_STRING, &old_owner,
+                             DBUS_TYPE_STRING, &new_owner,
+                             DBUS_TYPE_INVALID) ||
+      g_strcmp0(name, priv->service))
+  {
+    return;
+  }
+
+  g_mutex_lock(&priv->lock);
+  g_free(priv->owner);
+
+  if (*new_owner)
+  {
+    priv->owner = g_strdup(new_owner);
+    priv->owner_lost_at = 0;
+    g_atomic_int_set(&priv->address_encoding, ADDRESS_ENCODING_UNKNOWN);
+  }
+  else
+  {
+    priv->owner = NULL;
+    priv->owner_lost_at = g_get_monotonic_time();
+
+    lost = request_table_steal_all(&priv->requests);
+
+    for (l = lost; l; l = l->next)
+    {
+      NavigationProviderRequest *request = l->data;
+
+      g_clear_error(&request->error);
+      request->error = g_error_new(NAVIGATION_ERROR,
+                                   NAVIGATION_ERROR_PROVIDER_EXITED,
+                                   "Provider %s exited before replying",
+                                   priv->service);
+    }
+  }
+
+  navigation_provider_schedule_locked(provider);
+  g_mutex_unlock(&priv->lock);
+
+  /* the callbacks are told through the cancel path, with request->error */
+  for (l = lost; l; l = l->next)
+  {
+    NavigationProviderRequest *request = l->data;
+
+    /* the new owner is probed instead */
+    if (request->probe)
+      health_release(priv->service);
+
+    navigation_provider_dispatch_reply(provider, request, NULL);
+  }
+
+  g_slist_free(lost);
+}
+
+static DBusHandlerResult
+navigation_provider_dbus_filter(DBusConnection *connection,
+                                DBusMessage *message,
+                                gpointer user_data)
+{
+  NavigationProvider *provider = user_data;
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationProviderRequest *request = NULL;
+  gboolean from_owner;
+  const char *path;
+
+  /* other providers on the connection may watch the same name */
+  if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS,
+                             "NameOwnerChanged"))
+  {
+    navigation_provider_name_owner_changed(provider, message);
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  path = dbus_message_get_path(message);
+
+  if (!path)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  g_mutex_lock(&priv->lock);
+
+  /* replies from a previous owner of the service are stale */
+  from_owner = !priv->owner ||
+    !g_strcmp0(dbus_message_get_sender(message), priv->owner);
+
+  if (from_owner)
+  {
+    request = request_table_lookup(&priv->requests,
+                                   request_id_from_path(path), path);
+  }
+
+  if (request)
+  {
+    if (is_partial_reply(message))
+    {
+      navigation_provider_request_ref(request);
+      request->active_at = g_get_monotonic_time();
+    }
+    else
+    {
+      request_table_steal(&priv->requests, request);
+      navigation_provider_schedule_locked(provider);
+    }
+  }
+  else if (from_owner && priv->issuing &&
+           dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_SIGNAL &&
+           dbus_message_has_interface(message, MAP_PROVIDER_INTERFACE))
+  {
+    /* the reply may overtake the method return carrying its object path
+     * when the request is issued from another thread */
+    GSList *replies = g_hash_table_lookup(priv->early_replies, path);
+
+    if (get_trace())
+      navigation_trace_add_reply(trace, priv->service, message);
+
+    message = dbus_message_ref(message);
+
+    if (replies)
+      g_slist_append(replies, message);
+    else
+    {
+      g_hash_table_insert(priv->early_replies, g_strdup(path),
+                          g_slist_append(NULL, message));
+    }
+  }
+
+  g_mutex_unlock(&priv->lock);
+
+  if (!request)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  if (get_trace())
+    navigation_trace_add_reply(trace, priv->service, message);
+
+  if (!is_partial_reply(message))
+  {
+    health_record(priv->service, HEALTH_SUCCESS,
+                  g_get_monotonic_time() - request->issued_at);
+  }
+
+  navigation_provider_dispatch_reply(provider, request, message);
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+navigation_provider_poi_categories_changed_cb(DBusGProxy *proxy,
+                                              char **categories,
+                                              gpointer user_data)
+{
+  NavigationProvider *provider = user_data;
+  char **shared = poi_categories_new((const char * const *)categories,
+                                     g_strv_length(categories));
+
+  poi_cache_store(PRIVATE(provider)->service, shared);
+  g_atomic_rc_box_release(shared);
+
+  g_signal_emit(provider, signals[POI_CATEGORIES_CHANGED], 0);
+}
+
+static void
+navigation_provider_dispose(GObject *object)
+{
+  NavigationProviderPrivate *priv = PRIVATE(object);
+  int i;
+
+  if (priv->dbus)
+  {
+    dbus_bus_remove_match(
+      priv->dbus,
+      "type='signal',interface='com.nokia.Navigation.MapProvider'", NULL);
+    dbus_bus_remove_match(priv->dbus, priv->owner_match, NULL);
+    dbus_connection_remove_filter(priv->dbus, navigation_provider_dbus_filter,
+                                  object);
+    priv->dbus = NULL;
+  }
+
+  if (priv->requests.slots)
+  {
+    g_slist_free_full(request_table_steal_all(&priv->requests),
+                      (GDestroyNotify)navigation_provider_request_unref);
+    g_clear_pointer(&priv->requests.slots, g_free);
+  }
+
+  if (priv->reply_timeout_source)
+  {
+    g_source_destroy(priv->reply_timeout_source);
+    g_clear_pointer(&priv->reply_timeout_source, g_source_unref);
+  }
+
+  if (priv->early_replies)
+  {
+    g_hash_table_destroy(priv->early_replies);
+    priv->early_replies = NULL;
+  }
+
+  for (i = 0; i < N_PRIORITIES; i++)
+  {
+    NavigationProviderRequest *request;
+
+    while ((request = g_queue_pop_head(&priv->queued[i])))
+    {
+      request->link = NULL;
+      navigation_provider_request_unref(request);
+    }
+  }
+
+  if (priv->hedge)
+  {
+    g_object_unref(priv->hedge);
+    priv->hedge = NULL;
+  }
+
+  if (priv->proxy)
+  {
+    dbus_g_proxy_disconnect_signal(
+      priv->proxy, "POICategoriesChanged",
+      G_CALLBACK(navigation_provider_poi_categories_changed_cb), object);
+    g_object_unref(priv->proxy);
+    priv->proxy = NULL;
+  }
+
+  if (priv->gdbus)
+  {
+    dbus_g_connection_unref(priv->gdbus);
+    priv->gdbus = NULL;
+  }
+
+  G_OBJECT_CLASS(navigation_provider_parent_class)->dispose(object);
+}
+
+static void
+navigation_provider_finalize(GObject *object)
+{
+  NavigationProviderPrivate *priv = PRIVATE(object);
+
+  g_mutex_clear(&priv->lock);
+  g_mutex_clear(&priv->init_lock);
+  navigation_dataset_free(priv->dataset);
+  g_free(priv->owner);
+  g_free(priv->owner_match);
+  g_free(priv->service);
+
+  G_OBJECT_CLASS(navigation_provider_parent_class)->finalize(object);
+}
+
+static void
+navigation_provider_class_init(NavigationProviderClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = navigation_provider_dispose;
+  object_class->finalize = navigation_provider_finalize;
+
+  signals[POI_CATEGORIES_CHANGED] =
+    g_signal_new("poi-categories-changed", G_TYPE_FROM_CLASS(klass),
+                 G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+  dbus_g_object_register_marshaller(g_cclosure_marshal_VOID__BOXED,
+                                    G_TYPE_NONE, G_TYPE_STRV, G_TYPE_INVALID);
+
+  /* providers are shared between threads, so libdbus must lock */
+  dbus_threads_init_default();
+
+  settings_load();
+}
+
+static void
+navigation_provider_init(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  int i;
+
+  g_mutex_init(&priv->init_lock);
+  g_mutex_init(&priv->lock);
+  request_table_init(&priv->requests);
+  priv->early_replies = g_hash_table_new_full(
+      (GHashFunc)&g_str_hash, (GEqualFunc)&g_str_equal,
+      (GDestroyNotify)&g_free, (GDestroyNotify)&free_early_replies);
+
+  for (i = 0; i < N_PRIORITIES; i++)
+    g_queue_init(&priv->queued[i]);
+}
+
+NavigationProvider *
+navigation_provider_new_default()
+{
+  return g_object_new(NAVIGATION_TYPE_PROVIDER, NULL);
+}
+
+void
+navigation_route_free(NavigationRoute *route)
+{
+  if (route)
+  {
+    g_free(route->points);
+    g_free(route);
+  }
+}
+
+void
+navigation_location_free(NavigationLocation *location)
+{
+  g_free(location);
+}
+
+void
+navigation_address_free(NavigationAddress *address)
+{
+  if (address)
+  {
+    g_free(address->house_num);
+    g_free(address->house_name);
+    g_free(address->street);
+    g_free(address->suburb);
+    g_free(address->town);
+    g_free(address->municipality);
+    g_free(address->province);
+    g_free(address->postal_code);
+    g_free(address->country);
+    g_free(address->country_code);
+    g_free(address->time_zone);
+    g_free(address);
+  }
+}
+
+void
+navigation_address_list_free(GSList *addresses)
+{
+  g_slist_free_full(addresses, (GDestroyNotify)navigation_address_free);
+}
+
+GList *
+navigation_provider_list_all()
+{
+  GDir *dir = g_dir_open("/usr/share/osso-navigation-providers/", 0, NULL);
+  const gchar *dir_name;
+  GList *list = NULL;
+
+  if (!dir)
+    return NULL;
+
+  while ((dir_name = g_dir_read_name(dir)))
+  {
+    GKeyFile *key_file = g_key_file_new();
+    GError *error = NULL;
+    gchar *file = g_build_filename("/usr/share/osso-navigation-providers/",
+                                   dir_name, NULL);
+
+    if (g_key_file_load_from_file(key_file, file, G_KEY_FILE_NONE, &error))
+    {
+      NavigationProviderDetails *details = g_new0(NavigationProviderDetails, 1);
+
+      details->name = g_key_file_get_value(
+          key_file, "Map service", "Name", NULL);
+      details->service = g_key_file_get_value(
+          key_file, "Map service", "Service", NULL);
+      details->description = g_key_file_get_value(
+          key_file, "Map service", "Description", NULL);
+      list = g_list_prepend(list, details);
+    }
+    else
+    {
+      g_warning("Error loading: %s - %s", file, error->message);
+      g_error_free(error);
+    }
+
+    g_key_file_free(key_file);
+    g_free(file);
+  }
+
+  g_dir_close(dir);
+
+  return list;
+}
+
+void
+navigation_provider_list_free(GList *list)
+{
+  GList *l;
+
+  for (l = list; l; l = l->next)
+  {
+    NavigationProviderDetails *details = l->data;
+
+    g_free(details->name);
+    g_free(details->service);
+    g_free(details->description);
+    g_free(details);
+  }
+
+  g_list_free(list);
+}
+
+static gchar *
+get_safe_string(const gchar *s)
+{
+  if (s)
+    return g_strdup(s);
+  else
+    return g_strdup("");
+}
+
+gchar **
+address_to_array(const NavigationAddress *address)
+{
+  gchar **array = g_new(gchar *, 16);
+
+  array[0] = get_safe_string(address->house_num);
+  array[1] = get_safe_string(address->house_name);
+  array[2] = get_safe_string(address->street);
+  array[3] = get_safe_string(address->suburb);
+  array[4] = get_safe_string(address->town);
+  array[5] = get_safe_string(address->municipality);
+  array[6] = get_safe_string(address->province);
+  array[7] = get_safe_string(address->postal_code);
+  array[8] = get_safe_string(address->country);
+  array[9] = get_safe_string(address->country_code);
+  array[10] = get_safe_string(address->time_zone);
+  array[11] = get_safe_string(NULL);
+  array[12] = get_safe_string(NULL);
+  array[13] = get_safe_string(NULL);
+  array[14] = get_safe_string(NULL);
+  array[15] = NULL;
+
+  return array;
+}
+
+GVariant *
+navigation_address_to_variant(const NavigationAddress *address)
+{
+  GVariantBuilder fields;
+  guchar id;
+
+  g_return_val_if_fail(address != NULL, NULL);
+
+  g_variant_builder_init(&fields, G_VARIANT_TYPE("a{ys}"));
+
+  for (id = 0; id < G_N_ELEMENTS(address_fields); id++)
+  {
+    const gchar *val = ADDRESS_FIELD(address, id);
+
+    if (val && *val)
+      g_variant_builder_add(&fields, "{ys}", id, val);
+  }
+
+  return g_variant_new("(qa{ys})", NAVIGATION_ADDRESS_ENCODING_VERSION,
+                       &fields);
+}
+
+NavigationAddress *
+navigation_address_from_variant(GVariant *variant)
+{
+  NavigationAddress *address;
+  GVariantIter *fields;
+  guint16 version;
+  guchar id;
+  const gchar *val;
+
+  g_return_val_if_fail(variant != NULL, NULL);
+
+  if (!g_variant_is_of_type(variant, G_VARIANT_TYPE("(qa{ys})")))
+    return NULL;
+
+  address = g_new0(NavigationAddress, 1);
+  g_variant_get(variant, "(qa{ys})", &version, &fields);
+
+  while (g_variant_iter_next(fields, "{y&s}", &id, &val))
+    set_address_field(address, id, val);
+
+  g_variant_iter_free(fields);
+
+  return address;
+}
+
+NavigationAddress *
+navigation_address_copy(NavigationAddress *address)
+{
+  NavigationAddress *copy;
+
+  if (!address)
+    return NULL;
+
+  copy = g_memdup(address, sizeof(NavigationAddress));
+
+  copy->house_num = g_strdup(address->house_num);
+  copy->house_name = g_strdup(address->house_name);
+  copy->street = g_strdup(address->street);
+  copy->suburb = g_strdup(address->suburb);
+  copy->town = g_strdup(address->town);
+  copy->municipality = g_strdup(address->municipality);
+  copy->province = g_strdup(address->province);
+  copy->postal_code = g_strdup(address->postal_code);
+  copy->country = g_strdup(address->country);
+  copy->country_code = g_strdup(address->country_code);
+  copy->time_zone = g_strdup(address->time_zone);
+
+  return copy;
+}
+
+/* normalized country name to lower case alpha-3 code */
+static GHashTable *country_codes;
+
+static void
+append_normalized(GString *string, const gchar *text)
+{
+  gchar token[NAVIGATION_DATASET_MAX_TOKEN + 1];
+  gsize start = string->len;
+
+  if (!text)
+    return;
+
+  while (navigation_dataset_next_token(&text, token))
+  {
+    if (string->len > start)
+      g_string_append_c(string, ' ');
+
+    g_string_append(string, token);
+  }
+}
+
+static gchar *
+normalize(const gchar *text)
+{
+  GString *string = g_string_new(NULL);
+
+  append_normalized(string, text);
+
+  return g_string_free(string, FALSE);
+}
+
+static gpointer
+create_country_codes(gpointer data)
+{
+  GHashTable *table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            g_free);
+  GHashTableIter iter;
+  gpointer code;
+  gpointer country;
+
+  g_hash_table_iter_init(&iter, a3_2_country);
+
+  while (g_hash_table_iter_next(&iter, &code, &country))
+    g_hash_table_insert(table, normalize(country), normalize(code));
+
+  return table;
+}
+
+/* the country as lower case alpha-3 code if it is known, the normalized
+ * name otherwise */
+static void
+append_country(GString *string, const NavigationAddress *address)
+{
+  static GOnce once = G_ONCE_INIT;
+  const gchar *code = NULL;
+  gchar *country;
+
+  if (address->country_code && *address->country_code)
+  {
+    append_normalized(string, address->country_code);
+    return;
+  }
+
+  country = normalize(address->country);
+
+  if (*country)
+  {
+    country_codes = g_once(&once, create_country_codes, NULL);
+    code = g_hash_table_lookup(country_codes, country);
+  }
+
+  g_string_append(string, code ? code : country);
+  g_free(country);
+}
+
+gchar *
+navigation_address_normalize(const NavigationAddress *address)
+{
+  const gchar *fields[] =
+  {
+    address->house_num, address->house_name, address->street,
+    address->suburb, address->town, address->municipality,
+    address->province, address->postal_code
+  };
+  GString *string = g_string_new(NULL);
+  guint i;
+
+  g_return_val_if_fail(address != NULL, NULL);
+
+  /* tokens are alphanumeric, so the separators can not be mistaken for
+   * them */
+  for (i = 0; i < G_N_ELEMENTS(fields); i++)
+  {
+    append_normalized(string, fields[i]);
+    g_string_append_c(string, '|');
+  }
+
+  append_country(string, address);
+
+  return g_string_free(string, FALSE);
+}
+
+/* 64 bit FNV-1a */
+static guint64
+hash_string(const gchar *s)
+{
+  guint64 hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+
+  for (; *s; s++)
+  {
+    hash ^= (guchar)*s;
+    hash *= G_GUINT64_CONSTANT(0x100000001b3);
+  }
+
+  return hash;
+}
+
+guint64
+navigation_address_hash(const NavigationAddress *address)
+{
+  gchar *normalized = navigation_address_normalize(address);
+  guint64 hash = hash_string(normalized);
+
+  g_free(normalized);
+
+  return hash;
+}
+
+gboolean
+navigation_address_equal(const NavigationAddress *a,
+                         const NavigationAddress *b)
+{
+  gchar *normalized_a = navigation_address_normalize(a);
+  gchar *normalized_b = navigation_address_normalize(b);
+  gboolean equal = !strcmp(normalized_a, normalized_b);
+
+  g_free(normalized_a);
+  g_free(normalized_b);
+
+  return equal;
+}
+
+void
+navigation_make_resident()
+{
+  GModule *module = g_module_open(LIBDIR "/libnavigation.so.0", 0);
+
+  if (!module)
+  {
+    g_critical("%s: g_module_open() failed: %s", __FUNCTION__,
+               g_module_error());
+  }
+  else
+    g_module_make_resident(module);
+}
+
+gchar *
+navigation_provider_get_default_service()
+{
+  GConfClient *gconf = gconf_client_get_default();
+  GError *error = NULL;
+  gchar *service;
+
+  service = gconf_client_get_string(gconf, GCONF_SERVICE_KEY, &error);
+
+  if (error)
+  {
+    g_assert( service == NULL);
+    g_warning("service is not set: %s", error->message);
+    g_error_free(error);
+  }
+
+  g_object_unref(gconf);
+
+  return service;
+}
+
+void
+navigation_provider_set_default_service(const char *service)
+{
+  gconf_client_set_string(gconf_client_get_default(), GCONF_SERVICE_KEY,
+                          service, NULL);
+}
+
+/* Replies are only taken from the owner the service has when they arrive.
+ * Fails if the service is not running, it is activated by the first method
+ * call then, and NameOwnerChanged tells the owner. */
+static void
+navigation_provider_query_owner(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  DBusMessage *message;
+  DBusMessage *reply;
+  const char *owner;
+
+  message = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                         DBUS_INTERFACE_DBUS, "GetNameOwner");
+  dbus_message_append_args(message, DBUS_TYPE_STRING, &priv->service,
+                           DBUS_TYPE_INVALID);
+  reply = dbus_connection_send_with_reply_and_block(
+      priv->dbus, message, DBUS_TIMEOUT_USE_DEFAULT, NULL);
+  dbus_message_unref(message);
+
+  if (!reply)
+    return;
+
+  if (dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &owner,
+                            DBUS_TYPE_INVALID))
+  {
+    g_mutex_lock(&priv->lock);
+
+    /* NameOwnerChanged may have come first */
+    if (!priv->owner && !priv->owner_lost_at)
+      priv->owner = g_strdup(owner);
+
+    g_mutex_unlock(&priv->lock);
+  }
+
+  dbus_message_unref(reply);
+}
+
+static int
+navigation_provider_service_init_locked(NavigationProvider *provider,
+                                        GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  if (priv->proxy)
+    return TRUE;
+
+  if (!priv->service)
+    priv->service = navigation_provider_get_default_service();
+
+  if (!priv->service)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_TOO_MANY_REQUESTS,
+                "Failed to identify the default service");
+    return FALSE;
+  }
+
+  if (!g_strcmp0(priv->service, NAVIGATION_LOCAL_SERVICE))
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NOT_SUPPORTED,
+                "The local service does not support maps, POI categories, "
+                "routes or streamed address lookups");
+    return FALSE;
+  }
+
+  priv->gdbus = dbus_g_bus_get(DBUS_BUS_SESSION, error);
+
+  if (!priv->gdbus)
+    return FALSE;
+
+  priv->dbus = dbus_g_connection_get_connection(priv->gdbus);
+
+  dbus_connection_add_filter(priv->dbus, navigation_provider_dbus_filter,
+                             provider, NULL);
+  dbus_bus_add_match(
+    priv->dbus,
+    "type='signal',interface='com.nokia.Navigation.MapProvider'", NULL);
+  priv->owner_match = g_strdup_printf(
+      "type='signal',sender='" DBUS_SERVICE_DBUS "',"
+      "interface='" DBUS_INTERFACE_DBUS "',member='NameOwnerChanged',"
+      "arg0='%s'", priv->service);
+  dbus_bus_add_match(priv->dbus, priv->owner_match, NULL);
+  navigation_provider_query_owner(provider);
+
+  priv->proxy = dbus_g_proxy_new_for_name(priv->gdbus, priv->service,
+                                          "/Provider",
+                                          "com.nokia.Navigation.MapProvider");
+  dbus_g_proxy_set_default_timeout(priv->proxy, PROVIDER_CALL_TIMEOUT);
+
+  /* bound to the owner of the service name, unlike the filter above */
+  dbus_g_proxy_add_signal(priv->proxy, "POICategoriesChanged", G_TYPE_STRV,
+                          G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal(
+    priv->proxy, "POICategoriesChanged",
+    G_CALLBACK(navigation_provider_poi_categories_changed_cb), provider, NULL);
+
+  rate_limit_configure(priv->service);
+
+  return TRUE;
+}
+
+static int
+navigation_provider_service_init(NavigationProvider *provider, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  int rv;
+
+  g_mutex_lock(&priv->init_lock);
+  rv = navigation_provider_service_init_locked(provider, error);
+  g_mutex_unlock(&priv->init_lock);
+
+  return rv;
+}
+
+/* Returns the offline dataset configured in GConf, if any. local_only is set
+ * when the local service is selected and D-Bus must not be used at all. */
+static NavigationDataset *
+navigation_provider_get_dataset(NavigationProvider *provider,
+                                gboolean *local_only)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationDataset *dataset;
+
+  g_mutex_lock(&priv->init_lock);
+
+  if (!priv->service)
+    priv->service = navigation_provider_get_default_service();
+
+  if (!priv->dataset_loaded)
+  {
+    GConfClient *gconf = gconf_client_get_default();
+    gchar *path = gconf_client_get_string(gconf, GCONF_DATASET_KEY, NULL);
+
+    if (path && *path)
+    {
+      GError *error = NULL;
+
+      priv->dataset = navigation_dataset_open(path, &error);
+
+      if (!priv->dataset)
+      {
+        g_warning("Unable to open offline dataset: %s", error->message);
+        g_error_free(error);
+      }
+    }
+
+    priv->dataset_loaded = TRUE;
+    g_free(path);
+    g_object_unref(gconf);
+  }
+
+  *local_only = !g_strcmp0(priv->service, NAVIGATION_LOCAL_SERVICE);
+  dataset = priv->dataset;
+
+  g_mutex_unlock(&priv->init_lock);
+
+  return dataset;
+}
+
+static void
+navigation_provider_prewarm_notify(DBusPendingCall *pending, void *user_data)
+{
+  const gchar *service = user_data;
+  DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+  DBusError error;
+
+  dbus_error_init(&error);
+
+  if (dbus_set_error_from_message(&error, reply))
+  {
+    g_debug("Unable to start service %s: %s", service, error.message);
+    dbus_error_free(&error);
+  }
+
+  dbus_message_unref(reply);
+}
+
+void
+navigation_provider_prewarm(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv;
+  DBusPendingCall *pending = NULL;
+  DBusMessage *message;
+  GError *error = NULL;
+  dbus_uint32_t flags = 0;
+  gboolean local_only;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+
+  priv = PRIVATE(provider);
+  navigation_provider_get_dataset(provider, &local_only);
+
+  if (local_only)
+    return;
+
+  if (!navigation_provider_service_init(provider, &error))
+  {
+    g_debug("Prewarming provider failed: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  /* activation is what makes the first method call slow, start it without
+   * waiting for it */
+  message = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                         DBUS_INTERFACE_DBUS,
+                                         "StartServiceByName");
+  dbus_message_append_args(message, DBUS_TYPE_STRING, &priv->service,
+                           DBUS_TYPE_UINT32, &flags, DBUS_TYPE_INVALID);
+
+  if (dbus_connection_send_with_reply(priv->dbus, message, &pending,
+                                      DBUS_TIMEOUT_USE_DEFAULT) && pending)
+  {
+    dbus_pending_call_set_notify(pending, navigation_provider_prewarm_notify,
+                                 g_strdup(priv->service), g_free);
+    dbus_pending_call_unref(pending);
+  }
+
+  dbus_message_unref(message);
+}
+
+gboolean
+navigation_provider_show_route(NavigationProvider *provider,
+                               NavigationLocation *from, NavigationLocation *to,
+                               unsigned int route_options,
+                               unsigned int map_options, GError **error)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  priv = PRIVATE(provider);
+
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  return com_nokia_Navigation_MapProvider_show_route(
+           priv->proxy, from->latitude, from->longitude,
+           to->latitude, to->longitude, route_options, map_options, error);
+}
+
+gboolean
+navigation_provider_show_poi_categories(NavigationProvider *provider,
+                                        const char **categories,
+                                        unsigned int map_options,
+                                        GError **error)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  priv = PRIVATE(provider);
+
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  return com_nokia_Navigation_MapProvider_show_places_po_icategories(
+           priv->proxy, categories, map_options, error);
+}
+
+gboolean
+navigation_provider_show_location(NavigationProvider *provider,
+                                  NavigationLocation *location,
+                                  unsigned int map_options, GError **error)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  priv = PRIVATE(provider);
+
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  return com_nokia_Navigation_MapProvider_show_place_geo(
+           priv->proxy, location->latitude, location->longitude, map_options,
+           error);
+}
+
+gboolean
+navigation_provider_show_places(NavigationProvider *provider,
+                                const char **places, unsigned int map_options,
+                                GError **error)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  priv = PRIVATE(provider);
+
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  return com_nokia_Navigation_MapProvider_show_places_topos(
+           priv->proxy, places, map_options, error);
+}
+
+gboolean
+navigation_provider_show_region(NavigationProvider *provider,
+                                const NavigationArea *area,
+                                unsigned int map_options, GError **error)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  priv = PRIVATE(provider);
+
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  return com_nokia_Navigation_MapProvider_show_region(
+           priv->proxy, area->nw.latitude, area->nw.longitude,
+           area->se.latitude, area->se.longitude, map_options,
+           error);
+}
+
+static void
+navigation_provider_request_end_locked(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  if (!--priv->issuing)
+    g_hash_table_remove_all(priv->early_replies);
+
+  navigation_provider_schedule_locked(provider);
+}
+
+/* Fails the sent requests the provider stopped replying to. They count as
+ * timed out calls of the service. */
+static gboolean
+navigation_provider_reply_timeout_cb(gpointer user_data)
+{
+  NavigationProvider *provider = user_data;
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  gint64 now = g_get_monotonic_time();
+  GSList *expired = NULL;
+  GSList *l;
+  gboolean pending;
+  guint i;
+
+  g_mutex_lock(&priv->lock);
+
+  for (i = 0; i < priv->requests.size; i++)
+  {
+    NavigationProviderRequest *request = priv->requests.slots[i].request;
+
+    if (request && now - request->active_at >= REPLY_TIMEOUT)
+      expired = g_slist_prepend(expired, request);
+  }
+
+  for (l = expired; l; l = l->next)
+  {
+    NavigationProviderRequest *request = l->data;
+
+    request_table_steal(&priv->requests, request);
+    g_clear_error(&request->error);
+    request->error = g_error_new(NAVIGATION_ERROR,
+                                 NAVIGATION_ERROR_TIMED_OUT,
+                                 "Provider %s did not reply in time",
+                                 priv->service);
+  }
+
+  if (expired)
+    navigation_provider_schedule_locked(provider);
+
+  if (!(pending = priv->requests.n_requests > 0))
+  {
+    g_source_unref(priv->reply_timeout_source);
+    priv->reply_timeout_source = NULL;
+  }
+
+  g_mutex_unlock(&priv->lock);
+
+  /* the callbacks are told through the cancel path, with request->error */
+  for (l = expired; l; l = l->next)
+  {
+    health_record(priv->service, HEALTH_TIMEOUT, 0);
+    navigation_provider_dispatch_reply(provider, l->data, NULL);
+  }
+
+  g_slist_free(expired);
+
+  return pending ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/* watches the sent requests while there are any */
+static void
+navigation_provider_reply_timeout_locked(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  if (priv->reply_timeout_source)
+    return;
+
+  /* next to the replies it races with, in the default main context */
+  priv->reply_timeout_source =
+    g_timeout_source_new_seconds(REPLY_TIMEOUT_INTERVAL);
+  g_source_set_callback(priv->reply_timeout_source,
+                        navigation_provider_reply_timeout_cb,
+                        g_object_ref(provider), g_object_unref);
+  g_source_attach(priv->reply_timeout_source, NULL);
+}
+
+static void
+navigation_provider_request_abort(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->lock);
+  navigation_provider_request_end_locked(provider);
+  g_mutex_unlock(&priv->lock);
+}
+
+static void
+navigation_provider_request_commit(NavigationProvider *provider,
+                                   char *object_path,
+                                   NavigationProviderRequest *request)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  GSList *replies = NULL;
+  GSList *l;
+  DBusMessage *complete = NULL;
+  gboolean cancelled = FALSE;
+  gpointer key;
+
+  request->object_path = object_path;
+  request->id = request_id_from_path(object_path);
+  request->provider = provider;
+
+  if (request->cancellable)
+  {
+    request->cancelled_id = g_cancellable_connect(
+        request->cancellable,
+        G_CALLBACK(navigation_provider_request_cancelled), request, NULL);
+  }
+
+  g_mutex_lock(&priv->lock);
+
+  if (g_hash_table_steal_extended(priv->early_replies, object_path, &key,
+                                  (gpointer *)&replies))
+  {
+    g_free(key);
+  }
+
+  /* partial replies are queued while still locked, so that later ones
+   * received by the filter can not overtake them */
+  for (l = replies; l && !complete; l = l->next)
+  {
+    if (is_partial_reply(l->data))
+    {
+      navigation_provider_dispatch_reply(
+        provider, navigation_provider_request_ref(request), l->data);
+    }
+    else
+      complete = l->data;
+  }
+
+  if (!complete)
+  {
+    if (request->cancellable &&
+        g_cancellable_is_cancelled(request->cancellable))
+    {
+      cancelled = TRUE;
+    }
+    else
+    {
+      request_table_add(&priv->requests, request);
+      navigation_provider_reply_timeout_locked(provider);
+    }
+  }
+
+  navigation_provider_request_end_locked(provider);
+  g_mutex_unlock(&priv->lock);
+
+  if (complete)
+  {
+    health_record(priv->service, HEALTH_SUCCESS,
+                  g_get_monotonic_time() - request->issued_at);
+    navigation_provider_dispatch_reply(provider, request, complete);
+  }
+  else if (cancelled)
+  {
+    if (request->probe)
+      health_release(priv->service);
+
+    navigation_provider_dispatch_reply(provider, request, NULL);
+  }
+
+  free_early_replies(replies);
+}
+
+/* provider method calls in flight, across all classes */
+#define MAX_REQUESTS 6
+#define MAX_QUEUED_REQUESTS 32
+/* a queued request gains a class every interval it waits */
+#define PRIORITY_AGING_INTERVAL (2 * G_TIME_SPAN_SECOND)
+
+/* slots of MAX_REQUESTS only more urgent classes may take */
+static const guint reserved_slots[N_PRIORITIES] = { 0, 1, 2 };
+
+static GPrivate priority_stack = G_PRIVATE_INIT((GDestroyNotify)g_slist_free);
+
+void
+navigation_priority_push_thread_default(NavigationPriority priority)
+{
+  GSList *stack = g_private_get(&priority_stack);
+
+  g_return_if_fail(priority < N_PRIORITIES);
+
+  g_private_set(&priority_stack,
+                g_slist_prepend(stack, GINT_TO_POINTER(priority)));
+}
+
+void
+navigation_priority_pop_thread_default()
+{
+  GSList *stack = g_private_get(&priority_stack);
+
+  g_return_if_fail(stack != NULL);
+
+  g_private_set(&priority_stack, g_slist_delete_link(stack, stack));
+}
+
+NavigationPriority
+navigation_priority_get_thread_default()
+{
+  GSList *stack = g_private_get(&priority_stack);
+
+  if (stack)
+    return GPOINTER_TO_INT(stack->data);
+
+  return NAVIGATION_PRIORITY_NORMAL;
+}
+
+NavigationPriority
+navigation_priority_from_io_priority(int io_priority)
+{
+  if (io_priority < G_PRIORITY_DEFAULT)
+    return NAVIGATION_PRIORITY_INTERACTIVE;
+
+  if (io_priority > G_PRIORITY_DEFAULT)
+    return NAVIGATION_PRIORITY_BACKGROUND;
+
+  return NAVIGATION_PRIORITY_NORMAL;
+}
+
+static gboolean
+slot_available_locked(NavigationProviderPrivate *priv,
+                      NavigationPriority priority)
+{
+  guint in_flight = priv->requests.n_requests + priv->issuing;
+
+  return in_flight + reserved_slots[priority] < MAX_REQUESTS;
+}
+
+/* Returns the microseconds queued requests still wait for the service to be
+ * restarted, 0 if there is an owner or the grace period is over. */
+static gint64
+owner_wait_locked(NavigationProviderPrivate *priv, gint64 now)
+{
+  if (priv->owner_lost_at && now < priv->owner_lost_at + OWNER_RESTART_GRACE)
+    return priv->owner_lost_at + OWNER_RESTART_GRACE - now;
+
+  priv->owner_lost_at = 0;
+
+  return 0;
+}
+
+static NavigationPriority
+effective_priority(NavigationProviderRequest *request, gint64 now)
+{
+  gint64 promotion = (now - request->queued_at) / PRIORITY_AGING_INTERVAL;
+
+  return MAX((gint64)request->priority - promotion,
+             NAVIGATION_PRIORITY_INTERACTIVE);
+}
+
+/* whether a queued request would go before a new one of priority */
+static gboolean
+queued_ahead_locked(NavigationProviderPrivate *priv,
+                    NavigationPriority priority, gint64 now)
+{
+  int i;
+
+  for (i = 0; i < N_PRIORITIES; i++)
+  {
+    NavigationProviderRequest *head = g_queue_peek_head(&priv->queued[i]);
+
+    if (head && effective_priority(head, now) <= priority)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+account_wait_locked(NavigationProviderPrivate *priv,
+                    NavigationProviderRequest *request, gint64 now)
+{
+  NavigationPriorityStats *stats = &priv->stats[request->priority];
+  gint64 wait_time = request->queued_at ? now - request->queued_at : 0;
+
+  stats->n_requests++;
+  stats->wait_time += wait_time;
+  stats->max_wait_time = MAX(stats->max_wait_time, wait_time);
+
+  if (request->throttled_at)
+    stats->throttle_time += now - request->throttled_at;
+}
+
+static gboolean
+navigation_provider_throttle_cb(gpointer user_data)
+{
+  NavigationProvider *provider = user_data;
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->lock);
+  g_source_unref(priv->throttle_source);
+  priv->throttle_source = NULL;
+  navigation_provider_schedule_locked(provider);
+  g_mutex_unlock(&priv->lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* runs the scheduler again after delay microseconds. The timer is shared by
+ * the requests of all threads, so it goes to the default main context, where
+ * the replies that free the slots are received too */
+static void
+navigation_provider_throttle_locked(NavigationProvider *provider,
+                                    gint64 delay)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  if (priv->throttle_source)
+    return;
+
+  priv->throttle_source = g_timeout_source_new((delay + 999) / 1000);
+  g_source_set_callback(priv->throttle_source,
+                        navigation_provider_throttle_cb,
+                        g_object_ref(provider), g_object_unref);
+  g_source_attach(priv->throttle_source, NULL);
+}
+
+static void
+navigation_provider_call_free(void *user_data)
+{
+  NavigationProviderCall *call = user_data;
+
+  navigation_provider_request_unref(call->request);
+  g_object_unref(call->provider);
+  g_free(call);
+}
+
+static void
+navigation_provider_call_notify(DBusPendingCall *pending, void *user_data)
+{
+  NavigationProviderCall *call = user_data;
+  NavigationProvider *provider = call->provider;
+  NavigationProviderRequest *request = call->request;
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  DBusMessage *reply;
+  DBusError derror;
+
+  if (!g_atomic_int_compare_and_exchange(&call->handled, FALSE, TRUE))
+    return;
+
+  reply = dbus_pending_call_steal_reply(pending);
+  dbus_error_init(&derror);
+
+  if (dbus_set_error_from_message(&derror, reply))
+  {
+    dbus_set_g_error(&request->error, &derror);
+    dbus_error_free(&derror);
+    health_record(priv->service, health_outcome_from_error(request->error),
+                  0);
+    dbus_message_unref(reply);
+    reply = NULL;
+  }
+  else
+  {
+    health_record(priv->service, HEALTH_SUCCESS,
+                  g_get_monotonic_time() - request->issued_at);
+  }
+
+  /* answered, the slot is free again, errors take the cancel path */
+  navigation_provider_request_abort(provider);
+  navigation_provider_dispatch_reply(
+    provider, navigation_provider_request_ref(request), reply);
+
+  if (reply)
+    dbus_message_unref(reply);
+}
+
+/* Sends the method call of request without waiting for the reply, which
+ * navigation_provider_call_notify() handles. Takes over request on success. */
+static gboolean
+navigation_provider_request_call(NavigationProvider *provider,
+                                 NavigationProviderRequest *request,
+                                 GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  DBusMessage *message = request->call(provider, request->args);
+  DBusPendingCall *pending = NULL;
+  NavigationProviderCall *call;
+
+  if (!dbus_connection_send_with_reply(priv->dbus, message, &pending,
+                                       PROVIDER_CALL_TIMEOUT) || !pending)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_UNAVAILABLE,
+                "Could not call %s on %s", dbus_message_get_member(message),
+                priv->service);
+    dbus_message_unref(message);
+
+    return FALSE;
+  }
+
+  dbus_message_unref(message);
+
+  call = g_new(NavigationProviderCall, 1);
+  call->provider = g_object_ref(provider);
+  call->request = request;
+  call->handled = FALSE;
+
+  dbus_pending_call_set_notify(pending, navigation_provider_call_notify, call,
+                               navigation_provider_call_free);
+
+  /* the reply may have come in on another thread before the notify was set,
+   * libdbus does not call it then */
+  if (dbus_pending_call_get_completed(pending))
+    navigation_provider_call_notify(pending, call);
+
+  dbus_pending_call_unref(pending);
+
+  return TRUE;
+}
+
+/* Takes over request, whose slot is already counted in priv->issuing. */
+static gboolean
+navigation_provider_request_issue(NavigationProvider *provider,
+                                  NavigationProviderRequest *request,
+                                  GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  char *object_path = NULL;
+
+  if (navigation_provider_service_init(provider, error))
+  {
+    GError *local_error = NULL;
+
+    request->issued_at = request->active_at = g_get_monotonic_time();
+
+    if (!health_allow(priv->service, request->issued_at, &request->probe))
+    {
+      g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_UNAVAILABLE,
+                  "Provider %s is not responding", priv->service);
+    }
+    else if (request->call &&
+             navigation_provider_request_call(provider, request,
+                                              &local_error))
+    {
+      /* the slot is given back once the reply arrives */
+      return TRUE;
+    }
+    else if (!request->call &&
+             request->issue(provider, request->args, &object_path,
+                            &local_error))
+    {
+      if (get_trace())
+      {
+        navigation_trace_add_request(trace, priv->service,
+                                     request_method(request->type),
+                                     object_path, request->args);
+      }
+
+      /* the latency is recorded once the reply arrives */
+      navigation_provider_request_commit(provider, object_path, request);
+      return TRUE;
+    }
+    else
+    {
+      health_record(priv->service, health_outcome_from_error(local_error), 0);
+      g_propagate_error(error, local_error);
+    }
+  }
+
+  navigation_provider_request_abort(provider);
+  navigation_provider_request_unref(request);
+
+  return FALSE;
+}
+
+static gboolean
+navigation_provider_request_issue_idle(gpointer user_data)
+{
+  NavigationProviderReply *reply = user_data;
+  NavigationProviderRequest *request = reply->request;
+  GError *error = NULL;
+
+  if (request->cancellable &&
+      g_cancellable_is_cancelled(request->cancellable))
+  {
+    navigation_provider_request_abort(reply->provider);
+  }
+  else if (navigation_provider_request_issue(
+             reply->provider, navigation_provider_request_ref(request),
+             &error))
+  {
+    return G_SOURCE_REMOVE;
+  }
+  else
+    request->error = error;
+
+  /* the callback is told through the cancel path, with request->error */
+  navigation_provider_dispatch_reply(
+    reply->provider, navigation_provider_request_ref(request), NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Sends queued requests while there are free slots for them, the most urgent
+ * first. Every class is FIFO, so the head of a class waited longest. */
+static void
+navigation_provider_schedule_locked(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  gint64 now = g_get_monotonic_time();
+
+  for (;;)
+  {
+    NavigationProviderRequest *next = NULL;
+    NavigationPriority best = N_PRIORITIES;
+    NavigationProviderReply *reply;
+    GSource *source;
+    gint64 delay;
+    int i;
+
+    for (i = 0; i < N_PRIORITIES; i++)
+    {
+      NavigationProviderRequest *head = g_queue_peek_head(&priv->queued[i]);
+      NavigationPriority priority;
+
+      if (!head)
+        continue;
+
+      priority = effective_priority(head, now);
+
+      if (priority < best ||
+          (priority == best && head->queued_at < next->queued_at))
+      {
+        best = priority;
+        next = head;
+      }
+    }
+
+    if (!next || !slot_available_locked(priv, best))
+      break;
+
+    if ((delay = owner_wait_locked(priv, now)) ||
+        (delay = rate_limit_take(priv->service, now)))
+    {
+      if (!next->throttled_at)
+        next->throttled_at = now;
+
+      navigation_provider_throttle_locked(provider, delay);
+      break;
+    }
+
+    g_queue_delete_link(&priv->queued[next->priority], next->link);
+    next->link = NULL;
+    priv->issuing++;
+    account_wait_locked(priv, next, now);
+
+    /* method calls are made from the thread that issued the request, never
+     * from within the D-Bus filter */
+    reply = reply_alloc(provider, next, NULL);
+    source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, navigation_provider_request_issue_idle,
+                          reply, navigation_provider_reply_free);
+    g_source_attach(source, next->context);
+    g_source_unref(source);
+  }
+}
+
+static void
+navigation_provider_queued_request_cancelled(GCancellable *cancellable,
+                                             gpointer user_data)
+{
+  NavigationProviderRequest *request = user_data;
+  NavigationProviderPrivate *priv = PRIVATE(request->provider);
+  gboolean found = FALSE;
+
+  g_mutex_lock(&priv->lock);
+
+  if (request->link)
+  {
+    g_queue_delete_link(&priv->queued[request->priority], request->link);
+    request->link = NULL;
+    found = TRUE;
+  }
+
+  g_mutex_unlock(&priv->lock);
+
+  if (found)
+    navigation_provider_dispatch_reply(request->provider, request, NULL);
+}
+
+/* Takes over request and args. The request is sent right away if there is a
+ * free slot for its class, it waits in the queue otherwise. */
+static gboolean
+navigation_provider_request_submit(NavigationProvider *provider,
+                                   NavigationProviderRequest *request,
+                                   NavigationProviderIssueFunc issue,
+                                   GVariant *args, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationPriority priority = request->priority;
+  guint n_queued = 0;
+  gint64 now;
+  gint64 delay;
+  int i;
+
+  request->provider = provider;
+  request->issue = issue;
+  request->args = args ? g_variant_ref_sink(args) : NULL;
+
+  /* the rate limit of the service is set up along with it */
+  if (!navigation_provider_service_init(provider, error))
+  {
+    navigation_provider_request_unref(request);
+    return FALSE;
+  }
+
+  /* fail fast rather than queueing for a provider that is not responding */
+  if (!health_allow(priv->service, g_get_monotonic_time(), NULL))
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_UNAVAILABLE,
+                "Provider %s is not responding", priv->service);
+    navigation_provider_request_unref(request);
+
+    return FALSE;
+  }
+
+  g_mutex_lock(&priv->lock);
+
+  /* requests that waited long enough go before this one */
+  navigation_provider_schedule_locked(provider);
+  now = g_get_monotonic_time();
+
+  if (slot_available_locked(priv, priority) &&
+      !queued_ahead_locked(priv, priority, now))
+  {
+    if (!(delay = owner_wait_locked(priv, now)) &&
+        !(delay = rate_limit_take(priv->service, now)))
+    {
+      priv->issuing++;
+      account_wait_locked(priv, request, now);
+      g_mutex_unlock(&priv->lock);
+
+      return navigation_provider_request_issue(provider, request, error);
+    }
+
+    /* delayed rather than failed */
+    request->throttled_at = now;
+    navigation_provider_throttle_locked(provider, delay);
+  }
+
+  for (i = 0; i < N_PRIORITIES; i++)
+    n_queued += g_queue_get_length(&priv->queued[i]);
+
+  if (n_queued >= MAX_QUEUED_REQUESTS)
+  {
+    g_mutex_unlock(&priv->lock);
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_TOO_MANY_REQUESTS,
+                "Libnavigation buffer for pending requests is full");
+    navigation_provider_request_unref(request);
+
+    return FALSE;
+  }
+
+  request->queued_at = now;
+  g_queue_push_tail(&priv->queued[priority], request);
+  request->link = priv->queued[priority].tail;
+
+  if (!request->cancellable)
+  {
+    g_mutex_unlock(&priv->lock);
+    return TRUE;
+  }
+
+  /* it may be sent and even be done before the handler is connected, which
+   * runs right away if already cancelled */
+  navigation_provider_request_ref(request);
+  g_mutex_unlock(&priv->lock);
+
+  request->queued_cancelled_id = g_cancellable_connect(
+      request->cancellable,
+      G_CALLBACK(navigation_provider_queued_request_cancelled), request,
+      NULL);
+  navigation_provider_request_unref(request);
+
+  return TRUE;
+}
+
+void
+navigation_provider_get_priority_stats(NavigationProvider *provider,
+                                       NavigationPriority priority,
+                                       NavigationPriorityStats *stats)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+  g_return_if_fail(priority < N_PRIORITIES && stats != NULL);
+
+  priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->lock);
+  *stats = priv->stats[priority];
+  stats->n_queued = g_queue_get_length(&priv->queued[priority]);
+  g_mutex_unlock(&priv->lock);
+}
+
+unsigned int
+navigation_map_tile_get_format(GBytes *tile)
+{
+  static const guint8 png_magic[] =
+  {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  };
+  const guint8 *data;
+  gsize size;
+
+  g_return_val_if_fail(tile != NULL, NAVIGATION_MAP_FORMAT_PIXDATA);
+
+  data = g_bytes_get_data(tile, &size);
+
+  if (size >= sizeof(png_magic) && !memcmp(data, png_magic, sizeof(png_magic)))
+    return NAVIGATION_MAP_FORMAT_PNG;
+
+  if (size >= 12 && !memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WEBP", 4))
+    return NAVIGATION_MAP_FORMAT_WEBP;
+
+  return NAVIGATION_MAP_FORMAT_PIXDATA;
+}
+
+GdkPixbuf *
+navigation_map_tile_decode(GBytes *tile, GError **error)
+{
+  GdkPixbufLoader *loader;
+  GdkPixbuf *pixbuf = NULL;
+  const guint8 *data;
+  gsize size;
+
+  g_return_val_if_fail(tile != NULL, NULL);
+
+  data = g_bytes_get_data(tile, &size);
+
+  if (navigation_map_tile_get_format(tile) == NAVIGATION_MAP_FORMAT_PIXDATA)
+  {
+    GdkPixdata pixdata;
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+
+    if (gdk_pixdata_deserialize(&pixdata, size, data, error))
+      pixbuf = gdk_pixbuf_from_pixdata(&pixdata, TRUE, error);
+
+    G_GNUC_END_IGNORE_DEPRECATIONS
+
+    return pixbuf;
+  }
+
+  loader = gdk_pixbuf_loader_new();
+
+  if (gdk_pixbuf_loader_write(loader, data, size, error) &&
+      gdk_pixbuf_loader_close(loader, error))
+  {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+
+    if (pixbuf)
+      g_object_ref(pixbuf);
+  }
+  else
+    gdk_pixbuf_loader_close(loader, NULL);
+
+  g_object_unref(loader);
+
+  return pixbuf;
+}
+
+/* takes over message */
+static DBusMessage *
+send_to_provider(NavigationProvider *provider, DBusMessage *message,
+                 GError **error)
+{
+  DBusMessage *reply;
+  DBusError derror;
+
+  dbus_error_init(&derror);
+  reply = dbus_connection_send_with_reply_and_block(
+      PRIVATE(provider)->dbus, message, PROVIDER_CALL_TIMEOUT, &derror);
+  dbus_message_unref(message);
+
+  if (!reply)
+  {
+    dbus_set_g_error(error, &derror);
+    dbus_error_free(&derror);
+  }
+
+  return reply;
+}
+
+/* for the methods the client glue does not know, the provider replies with
+ * the object path of the request */
+static gboolean
+call_provider(NavigationProvider *provider, DBusMessage *message,
+              char **object_path, GError **error)
+{
+  DBusMessage *reply = send_to_provider(provider, message, error);
+  DBusError derror;
+  const char *path;
+  gboolean rv;
+
+  if (!reply)
+    return FALSE;
+
+  dbus_error_init(&derror);
+  rv = dbus_message_get_args(reply, &derror, DBUS_TYPE_OBJECT_PATH, &path,
+                             DBUS_TYPE_INVALID);
+
+  if (rv)
+    *object_path = g_strdup(path);
+  else
+  {
+    dbus_set_g_error(error, &derror);
+    dbus_error_free(&derror);
+  }
+
+  dbus_message_unref(reply);
+
+  return rv;
+}
+
+static DBusMessage *
+provider_method_new(NavigationProvider *provider, const char *method)
+{
+  return dbus_message_new_method_call(PRIVATE(provider)->service,
+                                      "/Provider", MAP_PROVIDER_INTERFACE,
+                                      method);
+}
+
+static gboolean
+issue_get_map_tile(NavigationProvider *provider, GVariant *args,
+                   char **object_path, GError **error)
+{
+  double latitude, longitude;
+  gint32 zoom, map_width, map_height;
+  guint32 map_options;
+
+  g_variant_get(args, "(ddiiiu)", &latitude, &longitude, &zoom, &map_width,
+                &map_height, &map_options);
+
+  return com_nokia_Navigation_MapProvider_get_map_tile(
+           PRIVATE(provider)->proxy, latitude, longitude, zoom, map_width,
+           map_height, map_options, object_path, error);
+}
+
+static gboolean
+navigation_provider_request_pixbuf_full(NavigationProvider *provider,
+                                        const NavigationLocation *location,
+                                        int zoom, int map_width,
+                                        int map_height,
+                                        unsigned int map_options,
+                                        NavigationProviderRequestType type,
+                                        GCallback cb, gpointer userdata,
+                                        GCancellable *cancellable,
+                                        GError **error)
+{
+  return navigation_provider_request_submit(
+           provider,
+           navigation_provider_request_new(type, cb, FALSE, userdata,
+                                           cancellable),
+           issue_get_map_tile,
+           g_variant_new("(ddiiiu)", location->latitude, location->longitude,
+                         zoom, map_width, map_height, map_options),
+           error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_request_pixbuf_from_map(
+  NavigationProvider *provider, const NavigationLocation *location, int zoom,
+  int map_width, int map_height, unsigned int map_options,
+  NavigationProviderGetPixbufCallback cb, gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_request_pixbuf_full(provider, location, zoom,
+                                                 map_width, map_height,
+                                                 map_options, REQUEST_MAP_TILE,
+                                                 (GCallback)cb, userdata,
+                                                 NULL, error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_request_tile_bytes(
+  NavigationProvider *provider, const NavigationLocation *location, int zoom,
+  int map_width, int map_height, unsigned int map_options,
+  NavigationProviderGetTileBytesCallback cb, gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_request_pixbuf_full(provider, location, zoom,
+                                                 map_width, map_height,
+                                                 map_options,
+                                                 REQUEST_MAP_TILE_BYTES,
+                                                 (GCallback)cb, userdata,
+                                                 NULL, error);
+}
+
+static gboolean
+issue_get_location_from_map(NavigationProvider *provider, GVariant *args,
+                            char **object_path, GError **error)
+{
+  guint32 map_options;
+
+  g_variant_get(args, "(u)", &map_options);
+
+  return com_nokia_Navigation_MapProvider_get_location_from_map(
+           PRIVATE(provider)->proxy, map_options, object_path, error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_get_location_from_map(
+  NavigationProvider *provider, unsigned int map_options,
+  NavigationProviderGetLocationCallback cb, gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_request_submit(
+           provider,
+           navigation_provider_request_new(REQUEST_LOCATION_FROM_MAP,
+                                           (GCallback)cb, FALSE, userdata,
+                                           NULL),
+           issue_get_location_from_map, g_variant_new("(u)", map_options),
+           error);
+}
+
+static gboolean
+issue_get_poi_categories(NavigationProvider *provider, GVariant *args,
+                         char **object_path, GError **error)
+{
+  return com_nokia_Navigation_MapProvider_get_po_icategories(
+           PRIVATE(provider)->proxy, object_path, error);
+}
+
+static gboolean
+navigation_provider_get_poi_categories_full(
+  NavigationProvider *provider, NavigationProviderRequestType type,
+  GCallback cb, gpointer userdata, GCancellable *cancellable, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  char **categories;
+
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  /* the list rarely changes, the provider announces it when it does */
+  categories = poi_cache_lookup(priv->service);
+
+  if (categories)
+  {
+    navigation_provider_dispatch_local_reply(
+      provider,
+      navigation_provider_request_new(type, cb, FALSE, userdata, cancellable),
+      categories);
+
+    return TRUE;
+  }
+
+  return navigation_provider_request_submit(
+           provider,
+           navigation_provider_request_new(type, cb, FALSE, userdata,
+                                           cancellable),
+           issue_get_poi_categories, NULL, error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_get_poi_categories(
+  NavigationProvider *provider, NavigationProviderGetPOICategoriesCallback cb,
+  gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_get_poi_categories_full(
+           provider, REQUEST_POI_CATEGORIES, (GCallback)cb, userdata, NULL,
+           error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_get_poi_categories_shared(
+  NavigationProvider *provider,
+  NavigationProviderGetSharedPOICategoriesCallback cb, gpointer userdata,
+  GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_get_poi_categories_full(
+           provider, REQUEST_POI_CATEGORIES_SHARED, (GCallback)cb, userdata,
+           NULL, error);
+}
+
+const char * const *
+navigation_poi_categories_ref(const char * const *categories)
+{
+  g_return_val_if_fail(categories != NULL, NULL);
+
+  return g_atomic_rc_box_acquire((gpointer)categories);
+}
+
+void
+navigation_poi_categories_unref(const char * const *categories)
+{
+  g_return_if_fail(categories != NULL);
+
+  g_atomic_rc_box_release((gpointer)categories);
+}
+
+static gboolean
+issue_get_route(NavigationProvider *provider, GVariant *args,
+                char **object_path, GError **error)
+{
+  double from_latitude, from_longitude, to_latitude, to_longitude;
+  guint32 route_options;
+  DBusMessage *message = provider_method_new(provider, "GetRoute");
+
+  g_variant_get(args, "(ddddu)", &from_latitude, &from_longitude,
+                &to_latitude, &to_longitude, &route_options);
+  dbus_message_append_args(message,
+                           DBUS_TYPE_DOUBLE, &from_latitude,
+                           DBUS_TYPE_DOUBLE, &from_longitude,
+                           DBUS_TYPE_DOUBLE, &to_latitude,
+                           DBUS_TYPE_DOUBLE, &to_longitude,
+                           DBUS_TYPE_UINT32, &route_options,
+                           DBUS_TYPE_INVALID);
+
+  return call_provider(provider, message, object_path, error);
+}
+
+static gboolean
+navigation_provider_get_route_full(NavigationProvider *provider,
+                                   const NavigationLocation *from,
+                                   const NavigationLocation *to,
+                                   unsigned int route_options,
+                                   NavigationProviderGetRouteCallback cb,
+                                   gpointer userdata,
+                                   GCancellable *cancellable, GError **error)
+{
+  return navigation_provider_request_submit(
+           provider,
+           navigation_provider_request_new(REQUEST_ROUTE, (GCallback)cb, TRUE,
+                                           userdata, cancellable),
+           issue_get_route,
+           g_variant_new("(ddddu)", from->latitude, from->longitude,
+                         to->latitude, to->longitude, route_options),
+           error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_get_route(
+  NavigationProvider *provider, const NavigationLocation *from,
+  const NavigationLocation *to, unsigned int route_options,
+  NavigationProviderGetRouteCallback cb, gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_get_route_full(provider, from, to, route_options,
+                                            cb, userdata, NULL, error);
+}
+
+/* keeps each reply below 32 KiB per array */
+#define MAX_MATRIX_CELLS 4096
+
+struct _NavigationRouteMatrixRequest
+{
+  NavigationProvider *provider;
+  GMainContext *context;
+  NavigationLocation *sources;
+  guint n_sources;
+  NavigationLocation *destinations;
+  guint n_destinations;
+  unsigned int route_options;
+  /* tiles are requested from callbacks, with the class of the first one */
+  NavigationPriority priority;
+  guint rows;
+  guint cols;
+  /* top left cell of the tile being requested */
+  guint row;
+  guint col;
+  NavigationProviderRouteMatrixCallback cb;
+  NavigationProviderRouteMatrixDoneCallback done_cb;
+  gpointer user_data;
+};
+
+typedef struct _NavigationRouteMatrixRequest NavigationRouteMatrixRequest;
+
+static void
+navigation_route_matrix_request_free(NavigationRouteMatrixRequest *matrix)
+{
+  g_main_context_unref(matrix->context);
+  g_object_unref(matrix->provider);
+  g_free(matrix->sources);
+  g_free(matrix->destinations);
+  g_free(matrix);
+}
+
+static GVariant *
+locations_to_variant(const NavigationLocation *locations, guint n_locations)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("ad"));
+
+  for (i = 0; i < n_locations; i++)
+  {
+    g_variant_builder_add(&builder, "d", locations[i].latitude);
+    g_variant_builder_add(&builder, "d", locations[i].longitude);
+  }
+
+  return g_variant_builder_end(&builder);
+}
+
+static gboolean
+issue_get_route_matrix(NavigationProvider *provider, GVariant *args,
+                       char **object_path, GError **error)
+{
+  DBusMessage *message = provider_method_new(provider, "GetRouteMatrix");
+  GVariant *sources = g_variant_get_child_value(args, 0);
+  GVariant *destinations = g_variant_get_child_value(args, 1);
+  const double *source_values;
+  const double *destination_values;
+  gsize n_sources;
+  gsize n_destinations;
+  guint32 route_options;
+
+  g_variant_get_child(args, 2, "u", &route_options);
+  source_values = g_variant_get_fixed_array(sources, &n_sources,
+                                            sizeof(double));
+  destination_values = g_variant_get_fixed_array(destinations,
+                                                 &n_destinations,
+                                                 sizeof(double));
+  dbus_message_append_args(message,
+                           DBUS_TYPE_ARRAY, DBUS_TYPE_DOUBLE, &source_values,
+                           (int)n_sources,
+                           DBUS_TYPE_ARRAY, DBUS_TYPE_DOUBLE,
+                           &destination_values, (int)n_destinations,
+                           DBUS_TYPE_UINT32, &route_options,
+                           DBUS_TYPE_INVALID);
+  g_variant_unref(sources);
+  g_variant_unref(destinations);
+
+  return call_provider(provider, message, object_path, error);
+}
+
+static void navigation_route_matrix_tile_cb(NavigationProvider *provider,
+                                            const double *durations,
+                                            const double *lengths,
+                                            guint n_cells, GError *error,
+                                            gpointer userdata);
+
+static gboolean
+navigation_route_matrix_request_tile(NavigationRouteMatrixRequest *matrix,
+                                     GError **error)
+{
+  guint rows = MIN(matrix->rows, matrix->n_sources - matrix->row);
+  guint cols = MIN(matrix->cols, matrix->n_destinations - matrix->col);
+  NavigationProviderRequest *request;
+  GVariant *args;
+
+  args = g_variant_new(
+      "(@ad@adu)", locations_to_variant(matrix->sources + matrix->row, rows),
+      locations_to_variant(matrix->destinations + matrix->col, cols),
+      matrix->route_options);
+
+  g_main_context_push_thread_default(matrix->context);
+  navigation_priority_push_thread_default(matrix->priority);
+  request = navigation_provider_request_new(
+      REQUEST_ROUTE_MATRIX, (GCallback)navigation_route_matrix_tile_cb, TRUE,
+      matrix, NULL);
+  navigation_priority_pop_thread_default();
+  g_main_context_pop_thread_default(matrix->context);
+
+  return navigation_provider_request_submit(matrix->provider, request,
+                                            issue_get_route_matrix, args,
+                                            error);
+}
+
+static void
+navigation_route_matrix_tile_cb(NavigationProvider *provider,
+                                const double *durations,
+                                const double *lengths, guint n_cells,
+                                GError *error, gpointer userdata)
+{
+  NavigationRouteMatrixRequest *matrix = userdata;
+  guint rows = MIN(matrix->rows, matrix->n_sources - matrix->row);
+  guint cols = MIN(matrix->cols, matrix->n_destinations - matrix->col);
+
+  if (!error && n_cells != rows * cols)
+  {
+    error = g_error_new(NAVIGATION_ERROR, NAVIGATION_ERROR_INVALID_DATA,
+                        "Route matrix reply has %u cells, expected %u",
+                        n_cells, rows * cols);
+  }
+
+  if (!error)
+  {
+    matrix->cb(provider, matrix->row, rows, matrix->col, cols, durations,
+               lengths, matrix->user_data);
+
+    matrix->col += cols;
+
+    if (matrix->col >= matrix->n_destinations)
+    {
+      matrix->col = 0;
+      matrix->row += rows;
+    }
+
+    if (matrix->row >= matrix->n_sources)
+    {
+      matrix->done_cb(provider, NULL, matrix->user_data);
+      navigation_route_matrix_request_free(matrix);
+      return;
+    }
+
+    /* one tile at a time, so neither the provider nor we ever hold more
+     * than MAX_MATRIX_CELLS of the matrix */
+    if (navigation_route_matrix_request_tile(matrix, &error))
+      return;
+  }
+
+  matrix->done_cb(provider, error, matrix->user_data);
+  navigation_route_matrix_request_free(matrix);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_get_route_matrix(
+  NavigationProvider *provider, const NavigationLocation *sources,
+  guint n_sources, const NavigationLocation *destinations,
+  guint n_destinations, unsigned int route_options,
+  NavigationProviderRouteMatrixCallback cb,
+  NavigationProviderRouteMatrixDoneCallback done_cb, gpointer userdata,
+  GError **error)
+/* *INDENT-ON* */
+{
+  NavigationRouteMatrixRequest *matrix;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_val_if_fail(sources != NULL && n_sources > 0, FALSE);
+  g_return_val_if_fail(destinations != NULL && n_destinations > 0, FALSE);
+  g_return_val_if_fail(cb != NULL && done_cb != NULL, FALSE);
+
+  matrix = g_new0(NavigationRouteMatrixRequest, 1);
+  matrix->provider = g_object_ref(provider);
+  matrix->context = g_main_context_ref_thread_default();
+  matrix->sources = g_new(NavigationLocation, n_sources);
+  memcpy(matrix->sources, sources, n_sources * sizeof(*sources));
+  matrix->n_sources = n_sources;
+  matrix->destinations = g_new(NavigationLocation, n_destinations);
+  memcpy(matrix->destinations, destinations,
+         n_destinations * sizeof(*destinations));
+  matrix->n_destinations = n_destinations;
+  matrix->route_options = route_options;
+  matrix->priority = navigation_priority_get_thread_default();
+  matrix->cols = MIN(n_destinations, MAX_MATRIX_CELLS);
+  matrix->rows = MAX(MAX_MATRIX_CELLS / matrix->cols, 1);
+  matrix->cb = cb;
+  matrix->done_cb = done_cb;
+  matrix->user_data = userdata;
+
+  if (!navigation_route_matrix_request_tile(matrix, error))
+  {
+    navigation_route_matrix_request_free(matrix);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* appends an address kept as (qa{ys}) without copying its fields */
+static void
+append_encoded_address(DBusMessageIter *iter, GVariant *address)
+{
+  DBusMessageIter sub;
+  DBusMessageIter fields;
+  DBusMessageIter entry;
+  GVariantIter *iter_fields;
+  guint16 version;
+  guchar id;
+  const gchar *val;
+
+  g_variant_get(address, "(qa{ys})", &version, &iter_fields);
+
+  dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL, &sub);
+  dbus_message_iter_append_basic(&sub, DBUS_TYPE_UINT16, &version);
+  dbus_message_iter_open_container(&sub, DBUS_TYPE_ARRAY, "{ys}", &fields);
+
+  while (g_variant_iter_next(iter_fields, "{y&s}", &id, &val))
+  {
+    dbus_message_iter_open_container(&fields, DBUS_TYPE_DICT_ENTRY, NULL,
+                                     &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_BYTE, &id);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &val);
+    dbus_message_iter_close_container(&fields, &entry);
+  }
+
+  dbus_message_iter_close_container(&sub, &fields);
+  dbus_message_iter_close_container(iter, &sub);
+  g_variant_iter_free(iter_fields);
+}
+
+/* Lays out an address kept as (qa{ys}) like address_to_array() does, for
+ * providers that only take string arrays. The strings belong to address. */
+static void
+encoded_address_to_array(GVariant *address, const gchar **array)
+{
+  GVariantIter *fields;
+  guint16 version;
+  guchar id;
+  const gchar *val;
+  int i;
+
+  for (i = 0; i < 15; i++)
+    array[i] = "";
+
+  array[15] = NULL;
+  g_variant_get(address, "(qa{ys})", &version, &fields);
+
+  while (g_variant_iter_next(fields, "{y&s}", &id, &val))
+  {
+    if (id < G_N_ELEMENTS(address_fields))
+      array[id] = val;
+  }
+
+  g_variant_iter_free(fields);
+}
+
+/* Returns TRUE if the encoded call has to be repeated with string arrays,
+ * the provider does not know about encoded addresses then. */
+static gboolean
+address_encoding_unsupported(NavigationProvider *provider, gboolean rv,
+                             GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  if (rv)
+    g_atomic_int_set(&priv->address_encoding, ADDRESS_ENCODING_STRUCT);
+  else if (g_error_matches(*error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD))
+  {
+    g_atomic_int_set(&priv->address_encoding, ADDRESS_ENCODING_ARRAY);
+    g_clear_error(error);
+
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+issue_address_to_locations(NavigationProvider *provider, GVariant *args,
+                           char **object_path, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  GError *local_error = NULL;
+  GVariant *address;
+  gboolean verbose;
+  gboolean rv;
+
+  g_variant_get(args, "(@(qa{ys})b)", &address, &verbose);
+
+  if (g_atomic_int_get(&priv->address_encoding) != ADDRESS_ENCODING_ARRAY)
+  {
+    DBusMessage *message = provider_method_new(provider,
+                                               "AddressToLocationsEncoded");
+    DBusMessageIter iter;
+    dbus_bool_t b = verbose;
+
+    dbus_message_iter_init_append(message, &iter);
+    append_encoded_address(&iter, address);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &b);
+    rv = call_provider(provider, message, object_path, &local_error);
+
+    if (!address_encoding_unsupported(provider, rv, &local_error))
+      goto out;
+  }
+
+  {
+    const gchar *array[16];
+
+    encoded_address_to_array(address, array);
+    rv = com_nokia_Navigation_MapProvider_address_to_locations(
+          priv->proxy, array, verbose, object_path, &local_error);
+  }
+
+out:
+  g_variant_unref(address);
+
+  if (!rv)
+  {
+    g_warning("Address to locations failed in provider");
+    g_propagate_error(error, local_error);
+  }
+
+  return rv;
+}
+
+static gboolean
+navigation_provider_address_to_location_full(
+  NavigationProvider *provider, const NavigationAddress *address,
+  gboolean verbose, GCallback cb, gpointer userdata,
+  GCancellable *cancellable, GError **error)
+{
+  NavigationProviderRequest *request;
+  NavigationDataset *dataset;
+  NavigationLocation *location = NULL;
+  gchar *cache_key = NULL;
+  GVariant *args;
+  gboolean local_only;
+
+  dataset = navigation_provider_get_dataset(provider, &local_only);
+
+  if (dataset)
+  {
+    NavigationDatasetMatch match;
+
+    if (navigation_dataset_search_address(dataset, address, &match, 1))
+    {
+      location = g_new(NavigationLocation, 1);
+      navigation_dataset_get_location(dataset, match.record, location);
+    }
+  }
+
+  /* the service is known once the dataset was looked up */
+  if (!location && !local_only && PRIVATE(provider)->service)
+  {
+    cache_key = geocode_cache_key(PRIVATE(provider)->service, address);
+
+    if (geocode_cache_lookup(cache_key, &location))
+    {
+      g_free(cache_key);
+      local_only = TRUE;
+    }
+  }
+
+  if (location || local_only)
+  {
+    navigation_provider_dispatch_local_reply(
+      provider,
+      navigation_provider_request_new(REQUEST_ADDRESS_TO_LOCATION, cb,
+                                      verbose, userdata, cancellable),
+      location);
+
+    return TRUE;
+  }
+
+  args = g_variant_new("(@(qa{ys})b)", navigation_address_to_variant(address),
+                       verbose);
+  request = navigation_provider_request_new(REQUEST_ADDRESS_TO_LOCATION, cb,
+                                            verbose, userdata, cancellable);
+  request->cache_key = cache_key;
+
+  return navigation_provider_request_submit(provider, request,
+                                            issue_address_to_locations, args,
+                                            error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_address_to_location(
+  NavigationProvider *provider, const NavigationAddress *address,
+  NavigationProviderAddressToLocationCallback cb, gpointer userdata,
+  GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_address_to_location_full(
+           provider, address, FALSE, (GCallback)cb, userdata, NULL, error);
+}
+
+static gboolean
+issue_location_to_addresses(NavigationProvider *provider, GVariant *args,
+                            char **object_path, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  GError *local_error = NULL;
+  double latitude, longitude;
+  gboolean verbose;
+  gboolean rv;
+
+  g_variant_get(args, "(ddb)", &latitude, &longitude, &verbose);
+
+  /* the reply carries encoded addresses if the provider takes this call */
+  if (g_atomic_int_get(&priv->address_encoding) != ADDRESS_ENCODING_ARRAY)
+  {
+    DBusMessage *message = provider_method_new(provider,
+                                               "LocationToAddressesEncoded");
+    dbus_bool_t b = verbose;
+
+    dbus_message_append_args(message, DBUS_TYPE_DOUBLE, &latitude,
+                             DBUS_TYPE_DOUBLE, &longitude,
+                             DBUS_TYPE_BOOLEAN, &b, DBUS_TYPE_INVALID);
+    rv = call_provider(provider, message, object_path, &local_error);
+
+    if (!address_encoding_unsupported(provider, rv, &local_error))
+      goto out;
+  }
+
+  rv = com_nokia_Navigation_MapProvider_location_to_addresses(
+        priv->proxy, latitude, longitude, verbose, object_path, &local_error);
+
+out:
+  if (!rv)
+  {
+    g_warning("Location to address failed in provider");
+    g_propagate_error(error, local_error);
+  }
+
+  return rv;
+}
+
+/* samples needed before the delay follows the latencies of the primary */
+#define HEDGE_MIN_SAMPLES 8
+#define HEDGE_DEFAULT_DELAY G_TIME_SPAN_SECOND
+#define HEDGE_MIN_DELAY (50 * G_TIME_SPAN_MILLISECOND)
+
+enum
+{
+  HEDGE_PRIMARY,
+  HEDGE_SECONDARY,
+  N_HEDGE_LEGS
+};
+
+/* a reverse geocoding request sent to the primary provider and, if it is
+ * slow, to the secondary as well. Lives in the context of the caller, where
+ * both legs reply. */
+typedef struct _NavigationHedge
+{
+  NavigationProvider *provider;
+  NavigationProvider *secondary;
+  GMainContext *context;
+  NavigationPriority priority;
+  NavigationLocation location;
+  gboolean verbose;
+  GCallback cb;
+  gpointer user_data;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  GCancellable *legs[N_HEDGE_LEGS];
+  /* legs sent whose callback did not run yet */
+  guint pending;
+  gboolean secondary_sent;
+  gboolean done;
+  GError *error;
+  GSource *timer;
+  gint64 started;
+} NavigationHedge;
+
+static int
+compare_latencies(gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a;
+  gint64 y = *(const gint64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static gint64
+hedge_delay_locked(NavigationProviderPrivate *priv)
+{
+  gint64 latencies[HEDGE_SAMPLES];
+  guint n = MIN(priv->n_hedge_latencies, HEDGE_SAMPLES);
+
+  if (n < HEDGE_MIN_SAMPLES)
+    return HEDGE_DEFAULT_DELAY;
+
+  memcpy(latencies, priv->hedge_latencies, n * sizeof(latencies[0]));
+  qsort(latencies, n, sizeof(latencies[0]), compare_latencies);
+
+  return MAX(latencies[(n * 95 - 1) / 100], HEDGE_MIN_DELAY);
+}
+
+static void
+hedge_add_latency(NavigationProvider *provider, gint64 latency)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->lock);
+  priv->hedge_latencies[priv->n_hedge_latencies++ % HEDGE_SAMPLES] = latency;
+
+  /* keep the index from wrapping into a different slot order */
+  if (priv->n_hedge_latencies == 2 * HEDGE_SAMPLES)
+    priv->n_hedge_latencies = HEDGE_SAMPLES;
+
+  g_mutex_unlock(&priv->lock);
+}
+
+static void
+hedge_free(NavigationHedge *hedge)
+{
+  int i;
+
+  if (hedge->cancellable)
+  {
+    g_cancellable_disconnect(hedge->cancellable, hedge->cancelled_id);
+    g_object_unref(hedge->cancellable);
+  }
+
+  for (i = 0; i < N_HEDGE_LEGS; i++)
+    g_object_unref(hedge->legs[i]);
+
+  g_clear_error(&hedge->error);
+  g_main_context_unref(hedge->context);
+  g_object_unref(hedge->secondary);
+  g_object_unref(hedge->provider);
+  g_free(hedge);
+}
+
+static void
+hedge_stop_timer(NavigationHedge *hedge)
+{
+  if (hedge->timer)
+  {
+    g_source_destroy(hedge->timer);
+    g_source_unref(hedge->timer);
+    hedge->timer = NULL;
+  }
+}
+
+static void
+hedge_deliver(NavigationHedge *hedge, NavigationAddress *address)
+{
+  hedge->done = TRUE;
+
+  if (hedge->verbose)
+  {
+    ((NavigationProviderLocationToAddressVerboseCallback)hedge->cb)(
+      hedge->provider, address, address ? NULL : hedge->error,
+      hedge->user_data);
+
+    if (!address)
+      hedge->error = NULL;
+  }
+  else
+  {
+    ((NavigationProviderLocationToAddressCallback)hedge->cb)(
+      hedge->provider, address, hedge->user_data);
+  }
+}
+
+static void hedge_leg_cb(NavigationHedge *hedge, int leg,
+                         NavigationAddress *address, GError *error);
+
+static void
+hedge_primary_cb(NavigationProvider *provider, NavigationAddress *address,
+                 GError *error, gpointer userdata)
+{
+  hedge_leg_cb(userdata, HEDGE_PRIMARY, address, error);
+}
+
+static void
+hedge_secondary_cb(NavigationProvider *provider, NavigationAddress *address,
+                   GError *error, gpointer userdata)
+{
+  hedge_leg_cb(userdata, HEDGE_SECONDARY, address, error);
+}
+
+/* legs always take the verbose callback, to tell failures from cancels */
+static gboolean
+hedge_submit(NavigationHedge *hedge, int leg, GError **error)
+{
+  static const GCallback callbacks[N_HEDGE_LEGS] =
+  {
+    (GCallback)hedge_primary_cb,
+    (GCallback)hedge_secondary_cb
+  };
+  NavigationProvider *provider =
+    leg == HEDGE_PRIMARY ? hedge->provider : hedge->secondary;
+  NavigationProviderRequest *request;
+
+  g_main_context_push_thread_default(hedge->context);
+  navigation_priority_push_thread_default(hedge->priority);
+  request = navigation_provider_request_new(REQUEST_LOCATION_TO_ADDRESS,
+                                            callbacks[leg], TRUE, hedge,
+                                            hedge->legs[leg]);
+  navigation_priority_pop_thread_default();
+  g_main_context_pop_thread_default(hedge->context);
+
+  if (PRIVATE(provider)->service)
+  {
+    request->cache_key = reverse_cache_key(PRIVATE(provider)->service,
+                                           &hedge->location);
+  }
+
+  return navigation_provider_request_submit(
+           provider, request, issue_location_to_addresses,
+           g_variant_new("(ddb)", hedge->location.latitude,
+                         hedge->location.longitude, hedge->verbose),
+           error);
+}
+
+static void
+hedge_send_secondary(NavigationHedge *hedge)
+{
+  NavigationProviderPrivate *priv = PRIVATE(hedge->provider);
+  GError *error = NULL;
+
+  hedge_stop_timer(hedge);
+  hedge->secondary_sent = TRUE;
+
+  if (hedge_submit(hedge, HEDGE_SECONDARY, &error))
+  {
+    hedge->pending++;
+
+    g_mutex_lock(&priv->lock);
+    priv->hedge_stats.n_hedged++;
+    g_mutex_unlock(&priv->lock);
+  }
+  else
+  {
+    g_debug("Hedging to the secondary provider failed: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+static gboolean
+hedge_timeout_cb(gpointer userdata)
+{
+  NavigationHedge *hedge = userdata;
+
+  /* the primary did not reply yet, or the timer would be gone */
+  g_source_unref(hedge->timer);
+  hedge->timer = NULL;
+  hedge_send_secondary(hedge);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+hedge_leg_cb(NavigationHedge *hedge, int leg, NavigationAddress *address,
+             GError *error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(hedge->provider);
+
+  hedge->pending--;
+
+  if (hedge->done)
+  {
+    /* the loser, most likely cancelled */
+    if (address)
+      navigation_address_free(address);
+
+    g_clear_error(&error);
+  }
+  else if (address)
+  {
+    /* the primary may still reply, which would be a latency larger than
+     * this one. Count it as this one anyway, leaving it out would only
+     * make the delay shorter and hedging more frequent. */
+    hedge_add_latency(hedge->provider, g_get_monotonic_time() - hedge->started);
+
+    if (leg == HEDGE_SECONDARY)
+    {
+      g_mutex_lock(&priv->lock);
+      priv->hedge_stats.n_secondary_wins++;
+      g_mutex_unlock(&priv->lock);
+    }
+
+    g_clear_error(&error);
+    hedge_stop_timer(hedge);
+    g_cancellable_cancel(hedge->legs[!leg]);
+    hedge_deliver(hedge, address);
+  }
+  else
+  {
+    /* take the first reply with an address, the error of the primary
+     * otherwise */
+    if (!hedge->error)
+      hedge->error = error;
+    else
+      g_clear_error(&error);
+
+    /* fail over without waiting for the delay, unless the caller gave up */
+    if (!hedge->secondary_sent &&
+        !(hedge->cancellable && g_cancellable_is_cancelled(hedge->cancellable)))
+    {
+      hedge_send_secondary(hedge);
+    }
+
+    if (!hedge->pending)
+    {
+      hedge_stop_timer(hedge);
+      hedge_deliver(hedge, NULL);
+    }
+  }
+
+  if (!hedge->pending && !hedge->timer)
+    hedge_free(hedge);
+}
+
+static void
+hedge_cancelled_cb(GCancellable *cancellable, gpointer userdata)
+{
+  NavigationHedge *hedge = userdata;
+  int i;
+
+  for (i = 0; i < N_HEDGE_LEGS; i++)
+    g_cancellable_cancel(hedge->legs[i]);
+}
+
+static gboolean
+navigation_provider_location_to_address_hedged(
+  NavigationProvider *provider, NavigationProvider *secondary,
+  const NavigationLocation *location, gboolean verbose, GCallback cb,
+  gpointer userdata, GCancellable *cancellable, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationHedge *hedge = g_new0(NavigationHedge, 1);
+  GError *local_error = NULL;
+  gint64 delay;
+  int i;
+
+  hedge->provider = g_object_ref(provider);
+  hedge->secondary = secondary;
+  hedge->context = g_main_context_ref_thread_default();
+  hedge->priority = navigation_priority_get_thread_default();
+  hedge->location = *location;
+  hedge->verbose = verbose;
+  hedge->cb = cb;
+  hedge->user_data = userdata;
+  hedge->started = g_get_monotonic_time();
+
+  for (i = 0; i < N_HEDGE_LEGS; i++)
+    hedge->legs[i] = g_cancellable_new();
+
+  if (hedge_submit(hedge, HEDGE_PRIMARY, &local_error))
+    hedge->pending = 1;
+  else if (g_error_matches(local_error, NAVIGATION_ERROR,
+                           NAVIGATION_ERROR_UNAVAILABLE))
+  {
+    /* fail over while the circuit of the primary is open */
+    hedge->error = local_error;
+    hedge_send_secondary(hedge);
+  }
+
+  if (!hedge->pending)
+  {
+    if (hedge->error)
+      g_propagate_error(error, g_steal_pointer(&hedge->error));
+    else
+      g_propagate_error(error, local_error);
+
+    hedge_free(hedge);
+
+    return FALSE;
+  }
+
+  g_mutex_lock(&priv->lock);
+  priv->hedge_stats.n_requests++;
+  delay = hedge_delay_locked(priv);
+  g_mutex_unlock(&priv->lock);
+
+  if (!hedge->secondary_sent)
+  {
+    hedge->timer = g_timeout_source_new(delay / G_TIME_SPAN_MILLISECOND);
+    g_source_set_callback(hedge->timer, hedge_timeout_cb, hedge, NULL);
+    g_source_attach(hedge->timer, hedge->context);
+  }
+
+  /* connected last, it runs right away if already cancelled */
+  if (cancellable)
+  {
+    hedge->cancellable = g_object_ref(cancellable);
+    hedge->cancelled_id = g_cancellable_connect(
+        cancellable, G_CALLBACK(hedge_cancelled_cb), hedge, NULL);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+navigation_provider_location_to_address_full(
+  NavigationProvider *provider, const NavigationLocation *location,
+  gboolean verbose, GCallback cb, gpointer userdata,
+  GCancellable *cancellable, GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationDataset *dataset;
+  NavigationAddress *address = NULL;
+  NavigationProvider *secondary = NULL;
+  NavigationProviderRequest *request;
+  gchar *cache_key = NULL;
+  gboolean local_only;
+
+  dataset = navigation_provider_get_dataset(provider, &local_only);
+
+  if (dataset)
+    address = navigation_dataset_lookup(dataset, location, -1);
+
+  if (!address && !local_only && priv->service)
+  {
+    cache_key = reverse_cache_key(priv->service, location);
+
+    if (reverse_cache_lookup(cache_key, &address))
+      g_clear_pointer(&cache_key, g_free);
+  }
+
+  /* the offline dataset answers without going through D-Bus, nor counting
+   * against the request limit */
+  if (address || local_only)
+  {
+    navigation_provider_dispatch_local_reply(
+      provider,
+      navigation_provider_request_new(REQUEST_LOCATION_TO_ADDRESS, cb,
+                                      verbose, userdata, cancellable),
+      address);
+
+    return TRUE;
+  }
+
+  g_mutex_lock(&priv->lock);
+
+  if (priv->hedge)
+    secondary = g_object_ref(priv->hedge);
+
+  g_mutex_unlock(&priv->lock);
+
+  if (secondary)
+  {
+    /* each leg caches under the service it asked */
+    g_free(cache_key);
+
+    return navigation_provider_location_to_address_hedged(
+             provider, secondary, location, verbose, cb, userdata,
+             cancellable, error);
+  }
+
+  request = navigation_provider_request_new(REQUEST_LOCATION_TO_ADDRESS, cb,
+                                            verbose, userdata, cancellable);
+  request->cache_key = cache_key;
+
+  return navigation_provider_request_submit(
+           provider, request, issue_location_to_addresses,
+           g_variant_new("(ddb)", location->latitude, location->longitude,
+                         verbose),
+           error);
+}
+
+gboolean
+navigation_provider_enable_hedging(NavigationProvider *provider,
+                                   const char *service, GError **error)
+{
+  NavigationProviderPrivate *priv;
+  NavigationProvider *secondary;
+  NavigationProvider *old;
+  GList *providers = NULL;
+  GList *l;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  priv = PRIVATE(provider);
+
+  /* the service of @provider is needed to pick a different one */
+  if (!navigation_provider_service_init(provider, error))
+    return FALSE;
+
+  if (!service)
+  {
+    providers = navigation_provider_list_all();
+
+    for (l = providers; l; l = l->next)
+    {
+      NavigationProviderDetails *details = l->data;
+
+      if (details->service &&
+          g_strcmp0(details->service, priv->service) &&
+          g_strcmp0(details->service, NAVIGATION_LOCAL_SERVICE))
+      {
+        service = details->service;
+        break;
+      }
+    }
+  }
+
+  if (!service || !g_strcmp0(service, priv->service))
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NOT_SUPPORTED,
+                "No other provider to hedge requests to");
+    navigation_provider_list_free(providers);
+
+    return FALSE;
+  }
+
+  secondary = g_object_new(NAVIGATION_TYPE_PROVIDER, NULL);
+  PRIVATE(secondary)->service = g_strdup(service);
+  navigation_provider_list_free(providers);
+
+  if (!navigation_provider_service_init(secondary, error))
+  {
+    g_object_unref(secondary);
+
+    return FALSE;
+  }
+
+  g_mutex_lock(&priv->lock);
+  old = priv->hedge;
+  priv->hedge = secondary;
+  g_mutex_unlock(&priv->lock);
+
+  if (old)
+    g_object_unref(old);
+
+  return TRUE;
+}
+
+void
+navigation_provider_disable_hedging(NavigationProvider *provider)
+{
+  NavigationProviderPrivate *priv;
+  NavigationProvider *old;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+
+  priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->lock);
+  old = priv->hedge;
+  priv->hedge = NULL;
+  g_mutex_unlock(&priv->lock);
+
+  /* requests in flight keep their own reference */
+  if (old)
+    g_object_unref(old);
+}
+
+void
+navigation_provider_get_hedge_stats(NavigationProvider *provider,
+                                    NavigationHedgeStats *stats)
+{
+  NavigationProviderPrivate *priv;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+  g_return_if_fail(stats != NULL);
+
+  priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->lock);
+  *stats = priv->hedge_stats;
+  stats->delay = hedge_delay_locked(priv);
+  g_mutex_unlock(&priv->lock);
+}
+
+gboolean
+navigation_provider_get_health(NavigationProvider *provider,
+                               NavigationServiceHealth *health)
+{
+  NavigationProviderPrivate *priv;
+  gboolean known;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_val_if_fail(health != NULL, FALSE);
+
+  priv = PRIVATE(provider);
+
+  g_mutex_lock(&priv->init_lock);
+
+  if ((known = priv->service != NULL))
+  {
+    g_mutex_lock(&health_lock);
+    *health = health_lookup_locked(priv->service)->stats;
+    g_mutex_unlock(&health_lock);
+  }
+
+  g_mutex_unlock(&priv->init_lock);
+
+  return known;
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_location_to_address(
+    NavigationProvider *provider, NavigationLocation *location,
+    NavigationProviderLocationToAddressCallback cb, gpointer userdata,
+    GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_location_to_address_full(
+           provider, location, FALSE, (GCallback)cb, userdata, NULL, error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_location_to_address_verbose(
+    NavigationProvider *provider, NavigationLocation *location,
+    NavigationProviderLocationToAddressVerboseCallback cb, gpointer userdata,
+    GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_location_to_address_full(
+           provider, location, TRUE, (GCallback)cb, userdata, NULL, error);
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_address_to_location_verbose(
+    NavigationProvider *provider, const NavigationAddress *address,
+    NavigationProviderAddressToLocationVerboseCallback cb, gpointer userdata,
+    GError **error)
+/* *INDENT-ON* */
+{
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+
+  return navigation_provider_address_to_location_full(
+           provider, address, TRUE, (GCallback)cb, userdata, NULL, error);
+}
+
+#define MAX_COMPLETIONS 32
+
+GSList *
+navigation_provider_complete_address(NavigationProvider *provider,
+                                     const char *text, guint max_results,
+                                     GError **error)
+{
+  NavigationDatasetMatch matches[MAX_COMPLETIONS];
+  NavigationDataset *dataset;
+  GSList *addresses = NULL;
+  gboolean local_only;
+  guint n;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), NULL);
+  g_return_val_if_fail(text != NULL, NULL);
+
+  dataset = navigation_provider_get_dataset(provider, &local_only);
+
+  if (!dataset)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NOT_SUPPORTED,
+                "No offline dataset configured");
+    return NULL;
+  }
+
+  n = navigation_dataset_search_text(dataset, text, matches,
+                                     MIN(max_results, MAX_COMPLETIONS));
+
+  if (!n)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                "No address matches '%s'", text);
+    return NULL;
+  }
+
+  while (n--)
+  {
+    NavigationAddress *address =
+      navigation_dataset_get_address(dataset, matches[n].record);
+
+    check_country(address);
+    addresses = g_slist_prepend(addresses, address);
+  }
+
+  return addresses;
+}
+
+static gboolean
+issue_address_to_locations_streamed(NavigationProvider *provider,
+                                    GVariant *args, char **object_path,
+                                    GError **error)
+{
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  GError *local_error = NULL;
+  GVariant *address;
+  DBusMessage *message = provider_method_new(provider,
+                                             "AddressToLocationsStreamed");
+  const gchar *array[16];
+  const gchar **strings = array;
+  guint32 chunk_size;
+  gboolean rv;
+
+  g_variant_get(args, "(@(qa{ys})u)", &address, &chunk_size);
+  encoded_address_to_array(address, array);
+
+  dbus_message_append_args(message,
+                           DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &strings,
+                           (int)g_strv_length((gchar **)array),
+                           DBUS_TYPE_UINT32, &chunk_size,
+                           DBUS_TYPE_INVALID);
+  rv = call_provider(provider, message, object_path, &local_error);
+
+  /* providers without streaming support get the plain call, its single
+   * AddressToLocationsReply is then delivered as one chunk */
+  if (!rv && g_error_matches(local_error, DBUS_GERROR,
+                             DBUS_GERROR_UNKNOWN_METHOD))
+  {
+    g_clear_error(&local_error);
+    rv = com_nokia_Navigation_MapProvider_address_to_locations(
+          priv->proxy, array, TRUE, object_path, &local_error);
+  }
+
+  g_variant_unref(address);
+
+  if (!rv)
+  {
+    g_warning("Address to locations failed in provider");
+    g_propagate_error(error, local_error);
+  }
+
+  return rv;
+}
+
+/* *INDENT-OFF* */
+gboolean
+navigation_provider_address_to_locations_streamed(
+    NavigationProvider *provider, const NavigationAddress *address,
+    guint chunk_size, NavigationProviderAddressToLocationsChunkCallback chunk_cb,
+    NavigationProviderAddressToLocationsDoneCallback done_cb,
+    gpointer userdata, GError **error)
+/* *INDENT-ON* */
+{
+  NavigationProviderRequest *request;
+  GVariant *args;
+
+  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_val_if_fail(chunk_cb != NULL && done_cb != NULL, FALSE);
+
+  args = g_variant_new("(@(qa{ys})u)", navigation_address_to_variant(address),
+                       chunk_size);
+
+  request = navigation_provider_request_new(
+        REQUEST_ADDRESS_TO_LOCATIONS_STREAMED, (GCallback)chunk_cb, TRUE,
+        userdata, NULL);
+  request->done_cb = (GCallback)done_cb;
+
+  return navigation_provider_request_submit(
+           provider, request, issue_address_to_locations_streamed, args,
+           error);
+}
+
+static void
+location_to_address_async_cb(NavigationProvider *provider,
+                             NavigationAddress *address, GError *error,
+                             gpointer userdata)
+{
+  GTask *task = userdata;
+
+  if (error)
+    g_task_return_error(task, error);
+  else if (address)
+  {
+    g_task_return_pointer(task, address,
+                          (GDestroyNotify)navigation_address_free);
+  }
+  else
+  {
+    g_task_return_new_error(task, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                            "No address found for location");
+  }
+
+  g_object_unref(task);
+}
+
+/* *INDENT-OFF* */
+void
+navigation_provider_location_to_address_async(
+    NavigationProvider *provider, const NavigationLocation *location,
+    int io_priority, GCancellable *cancellable, GAsyncReadyCallback callback,
+    gpointer user_data)
+/* *INDENT-ON* */
+{
+  GError *error = NULL;
+  GTask *task;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+
+  task = g_task_new(provider, cancellable, callback, user_data);
+  g_task_set_source_tag(task, navigation_provider_location_to_address_async);
+  g_task_set_priority(task, io_priority);
+
+  navigation_priority_push_thread_default(
+    navigation_priority_from_io_priority(io_priority));
+
+  if (!navigation_provider_location_to_address_full(
+        provider, location, TRUE, (GCallback)location_to_address_async_cb,
+        task, cancellable, &error))
+  {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+  }
+
+  navigation_priority_pop_thread_default();
+}
+
+NavigationAddress *
+navigation_provider_location_to_address_finish(NavigationProvider *provider,
+                                               GAsyncResult *result,
+                                               GError **error)
+{
+  g_return_val_if_fail(g_task_is_valid(result, provider), NULL);
+
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void
+address_to_location_async_cb(NavigationProvider *provider,
+                             NavigationLocation *location, GError *error,
+                             gpointer userdata)
+{
+  GTask *task = userdata;
+
+  if (error)
+    g_task_return_error(task, error);
+  else if (location)
+  {
+    g_task_return_pointer(task, location,
+                          (GDestroyNotify)navigation_location_free);
+  }
+  else
+  {
+    g_task_return_new_error(task, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                            "No location found for address");
+  }
+
+  g_object_unref(task);
+}
+
+/* *INDENT-OFF* */
+void
+navigation_provider_address_to_location_async(
+    NavigationProvider *provider, const NavigationAddress *address,
+    int io_priority, GCancellable *cancellable, GAsyncReadyCallback callback,
+    gpointer user_data)
+/* *INDENT-ON* */
+{
+  GError *error = NULL;
+  GTask *task;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+
+  task = g_task_new(provider, cancellable, callback, user_data);
+  g_task_set_source_tag(task, navigation_provider_address_to_location_async);
+  g_task_set_priority(task, io_priority);
+
+  navigation_priority_push_thread_default(
+    navigation_priority_from_io_priority(io_priority));
+
+  if (!navigation_provider_address_to_location_full(
+        provider, address, TRUE, (GCallback)address_to_location_async_cb,
+        task, cancellable, &error))
+  {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+  }
+
+  navigation_priority_pop_thread_default();
+}
+
+NavigationLocation *
+navigation_provider_address_to_location_finish(NavigationProvider *provider,
+                                               GAsyncResult *result,
+                                               GError **error)
+{
+  g_return_val_if_fail(g_task_is_valid(result, provider), NULL);
+
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void
+request_pixbuf_async_cb(NavigationProvider *provider, GdkPixbuf *pixbuf,
+                        NavigationArea *area, gpointer userdata)
+{
+  GTask *task = userdata;
+
+  if (pixbuf)
+  {
+    g_task_set_task_data(task, area, g_free);
+    g_task_return_pointer(task, pixbuf, g_object_unref);
+  }
+  else
+  {
+    g_free(area);
+
+    if (!g_task_return_error_if_cancelled(task))
+    {
+      g_task_return_new_error(task, NAVIGATION_ERROR,
+                              NAVIGATION_ERROR_NO_RESULT,
+                              "Provider did not return a map tile");
+    }
+  }
+
+  g_object_unref(task);
+}
+
+/* *INDENT-OFF* */
+void
+navigation_provider_request_pixbuf_async(
+  NavigationProvider *provider, const NavigationLocation *location, int zoom,
+  int map_width, int map_height, unsigned int map_options, int io_priority,
+  GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+/* *INDENT-ON* */
+{
+  GError *error = NULL;
+  GTask *task;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+
+  task = g_task_new(provider, cancellable, callback, user_data);
+  g_task_set_source_tag(task, navigation_provider_request_pixbuf_async);
+  g_task_set_priority(task, io_priority);
+
+  navigation_priority_push_thread_default(
+    navigation_priority_from_io_priority(io_priority));
+
+  if (!navigation_provider_request_pixbuf_full(
+        provider, location, zoom, map_width, map_height, map_options,
+        REQUEST_MAP_TILE, (GCallback)request_pixbuf_async_cb, task,
+        cancellable, &error))
+  {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+  }
 
-  return com_nokia_Navigation_MapProvider_show_places_topos(
-           priv->proxy, places, map_options, error);
+  navigation_priority_pop_thread_default();
 }
 
-gboolean
-navigation_provider_show_region(NavigationProvider *provider,
-                                const NavigationArea *area,
-                                unsigned int map_options, GError **error)
+GdkPixbuf *
+navigation_provider_request_pixbuf_finish(NavigationProvider *provider,
+                                          GAsyncResult *result,
+                                          NavigationArea *area,
+                                          GError **error)
 {
-  NavigationProviderPrivate *priv;
+  GdkPixbuf *pixbuf;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_val_if_fail(g_task_is_valid(result, provider), NULL);
 
-  priv = PRIVATE(provider);
+  pixbuf = g_task_propagate_pointer(G_TASK(result), error);
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+  if (pixbuf && area)
+  {
+    NavigationArea *pixbuf_area = g_task_get_task_data(G_TASK(result));
 
-  return com_nokia_Navigation_MapProvider_show_region(
-           priv->proxy, area->nw.latitude, area->nw.longitude,
-           area->se.latitude, area->se.longitude, map_options,
-           error);
+    if (pixbuf_area)
+      *area = *pixbuf_area;
+  }
+
+  return pixbuf;
 }
 
-static gboolean
-check_too_many_requests(NavigationProviderPrivate *priv, GError **error)
+static void
+get_poi_categories_async_cb(NavigationProvider *provider, char **categories,
+                            gpointer userdata)
 {
-  if (g_hash_table_size(priv->requests) > 5)
+  GTask *task = userdata;
+
+  if (categories)
+    g_task_return_pointer(task, categories, (GDestroyNotify)g_strfreev);
+  else if (!g_task_return_error_if_cancelled(task))
   {
-    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_TOO_MANY_REQUESTS,
-                "Libnavigation buffer for pending requests is full");
-    return TRUE;
+    g_task_return_new_error(task, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                            "Provider did not return POI categories");
   }
 
-  return FALSE;
+  g_object_unref(task);
 }
 
 /* *INDENT-OFF* */
-gboolean
-navigation_provider_request_pixbuf_from_map(
-  NavigationProvider *provider, const NavigationLocation *location, int zoom,
-  int map_width, int map_height, unsigned int map_options,
-  NavigationProviderGetPixbufCallback cb, gpointer userdata, GError **error)
+void
+navigation_provider_get_poi_categories_async(
+  NavigationProvider *provider, int io_priority, GCancellable *cancellable,
+  GAsyncReadyCallback callback, gpointer user_data)
 /* *INDENT-ON* */
 {
-  NavigationProviderPrivate *priv;
-  char *object_path = NULL;
+  GError *error = NULL;
+  GTask *task;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
 
-  priv = PRIVATE(provider);
+  task = g_task_new(provider, cancellable, callback, user_data);
+  g_task_set_source_tag(task, navigation_provider_get_poi_categories_async);
+  g_task_set_priority(task, io_priority);
 
-  if (check_too_many_requests(priv, error))
-    return FALSE;
+  navigation_priority_push_thread_default(
+    navigation_priority_from_io_priority(io_priority));
 
-  if (navigation_provider_service_init(provider, error) &&
-      com_nokia_Navigation_MapProvider_get_map_tile(
-        priv->proxy, location->latitude, location->longitude, zoom,
-        map_width, map_height, map_options, &object_path, error))
+  if (!navigation_provider_get_poi_categories_full(
+        provider, REQUEST_POI_CATEGORIES,
+        (GCallback)get_poi_categories_async_cb, task, cancellable, &error))
   {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
-
-    request->cb = (GCallback)cb;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
-    return TRUE;
+    g_task_return_error(task, error);
+    g_object_unref(task);
   }
 
-  return FALSE;
+  navigation_priority_pop_thread_default();
 }
 
-/* *INDENT-OFF* */
-gboolean
-navigation_provider_get_location_from_map(
-  NavigationProvider *provider, unsigned int map_options,
-  NavigationProviderGetLocationCallback cb, gpointer userdata, GError **error)
-/* *INDENT-ON* */
+char **
+navigation_provider_get_poi_categories_finish(NavigationProvider *provider,
+                                              GAsyncResult *result,
+                                              GError **error)
 {
-  NavigationProviderPrivate *priv;
-  char *object_path = NULL;
+  g_return_val_if_fail(g_task_is_valid(result, provider), NULL);
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
 
-  priv = PRIVATE(provider);
+/* mean earth radius in meters */
+#define EARTH_RADIUS 6371008.8
 
-  if (check_too_many_requests(priv, error))
-    return FALSE;
+static gdouble
+location_distance(const NavigationLocation *from, const NavigationLocation *to)
+{
+  gdouble dlat = (to->latitude - from->latitude) * G_PI / 180.0;
+  gdouble dlon = (to->longitude - from->longitude) * G_PI / 180.0;
+  gdouble a = sin(dlat / 2) * sin(dlat / 2) +
+    cos(from->latitude * G_PI / 180.0) * cos(to->latitude * G_PI / 180.0) *
+    sin(dlon / 2) * sin(dlon / 2);
 
-  if (navigation_provider_service_init(provider, error) &&
-      com_nokia_Navigation_MapProvider_get_location_from_map(
-        priv->proxy, map_options, &object_path, error))
-  {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
+  return 2 * EARTH_RADIUS * asin(sqrt(MIN(a, 1.0)));
+}
 
-    request->cb = (GCallback)cb;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
-    return TRUE;
-  }
+struct _CachedAddress
+{
+  NavigationAddress *address;
+  gdouble distance;
+};
 
-  return FALSE;
+typedef struct _CachedAddress CachedAddress;
+
+static gint
+compare_cached_address(gconstpointer a, gconstpointer b)
+{
+  gdouble da = ((const CachedAddress *)a)->distance;
+  gdouble db = ((const CachedAddress *)b)->distance;
+
+  return (da > db) - (da < db);
 }
 
-/* *INDENT-OFF* */
-gboolean
-navigation_provider_get_poi_categories(
-  NavigationProvider *provider, NavigationProviderGetPOICategoriesCallback cb,
-  gpointer userdata, GError **error)
-/* *INDENT-ON* */
+/*
+ * LocationToAddressesCached replies with one string array per cached
+ * candidate, laid out as in address_to_array(). Providers that know where a
+ * candidate is put its latitude and longitude into the first two reserved
+ * slots, candidates without coordinates are ranked last in provider order.
+ */
+static GSList *
+parse_cached_addresses(GPtrArray *addresses,
+                       const NavigationLocation *location)
 {
-  NavigationProviderPrivate *priv;
-  char *object_path = NULL;
+  GSList *candidates = NULL;
+  GSList *l;
+  guint i;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  for (i = 0; i < addresses->len; i++)
+  {
+    gchar **fields = g_ptr_array_index(addresses, i);
+    CachedAddress *candidate = g_new(CachedAddress, 1);
+    int idx;
 
-  priv = PRIVATE(provider);
+    candidate->address = g_new0(NavigationAddress, 1);
+    candidate->distance = G_MAXDOUBLE;
 
-  if (check_too_many_requests(priv, error))
-    return FALSE;
+    for (idx = 0; fields && fields[idx] && idx < 11; idx++)
+      array_to_address(&candidate->address, idx, fields[idx]);
+
+    check_country(candidate->address);
+
+    if (fields && g_strv_length(fields) > 12 && *fields[11] && *fields[12])
+    {
+      NavigationLocation where;
+
+      where.latitude = g_ascii_strtod(fields[11], NULL);
+      where.longitude = g_ascii_strtod(fields[12], NULL);
+      candidate->distance = location_distance(location, &where);
+    }
+
+    candidates = g_slist_prepend(candidates, candidate);
+  }
+
+  /* g_slist_sort() is stable */
+  candidates = g_slist_sort(g_slist_reverse(candidates),
+                            compare_cached_address);
 
-  if (navigation_provider_service_init(provider, error) &&
-      com_nokia_Navigation_MapProvider_get_po_icategories(
-        priv->proxy, &object_path, error))
+  for (l = candidates; l; l = l->next)
   {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
+    CachedAddress *candidate = l->data;
 
-    request->cb = (GCallback)cb;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
-    return TRUE;
+    l->data = candidate->address;
+    g_free(candidate);
   }
 
-  return FALSE;
+  return candidates;
 }
 
-/* *INDENT-OFF* */
-gboolean
-navigation_provider_address_to_location(
-  NavigationProvider *provider, const NavigationAddress *address,
-  NavigationProviderAddressToLocationCallback cb, gpointer userdata,
-  GError **error)
-/* *INDENT-ON* */
-
+/* reads the aas of a LocationToAddressesCached reply into string arrays */
+static GPtrArray *
+get_cached_addresses(DBusMessage *message)
 {
-  NavigationProviderPrivate *priv;
-  gchar **array;
-  char *object_path = NULL;
+  GPtrArray *addresses = g_ptr_array_new_with_free_func(
+      (GDestroyNotify)g_strfreev);
+  DBusMessageIter iter;
+  DBusMessageIter sub;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  dbus_message_iter_init(message, &iter);
 
-  priv = PRIVATE(provider);
+  if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+    return addresses;
 
-  if (check_too_many_requests(priv, error))
-    return FALSE;
+  dbus_message_iter_recurse(&iter, &sub);
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+  while (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_ARRAY)
+  {
+    GPtrArray *fields = g_ptr_array_new();
+    DBusMessageIter field;
 
-  array = address_to_array(address);
+    dbus_message_iter_recurse(&sub, &field);
 
-  if (com_nokia_Navigation_MapProvider_address_to_locations(
-        priv->proxy, (const char **)array, FALSE, &object_path, error))
-  {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
+    while (dbus_message_iter_get_arg_type(&field) == DBUS_TYPE_STRING)
+    {
+      const gchar *v;
 
-    request->cb = (GCallback)cb;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
-    g_strfreev(array);
+      dbus_message_iter_get_basic(&field, &v);
+      g_ptr_array_add(fields, g_strdup(v));
+      dbus_message_iter_next(&field);
+    }
 
-    return TRUE;
-  }
-  else
-  {
-    g_warning("Address to locations failed in provider");
-    g_strfreev(array);
+    g_ptr_array_add(fields, NULL);
+    g_ptr_array_add(addresses, g_ptr_array_free(fields, FALSE));
+    dbus_message_iter_next(&sub);
   }
 
-  return FALSE;
+  return addresses;
 }
 
-/* *INDENT-OFF* */
-gboolean
-navigation_provider_location_to_address(
-    NavigationProvider *provider, NavigationLocation *location,
-    NavigationProviderLocationToAddressCallback cb, gpointer userdata,
-    GError **error)
-/* *INDENT-ON* */
+/* the candidates of a LocationToAddressesCached reply to the (ddd) args of
+ * the call, nearest first */
+static GSList *
+get_cached_candidates(DBusMessage *message, GVariant *args)
 {
-  NavigationProviderPrivate *priv;
-  char *object_path = NULL;
+  GPtrArray *addresses = get_cached_addresses(message);
+  NavigationLocation location;
+  GSList *candidates;
 
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
-
-  priv = PRIVATE(provider);
+  g_variant_get(args, "(ddd)", &location.latitude, &location.longitude,
+                NULL);
+  candidates = parse_cached_addresses(addresses, &location);
+  g_ptr_array_free(addresses, TRUE);
 
-  if (check_too_many_requests(priv, error))
-    return FALSE;
+  return candidates;
+}
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+static void
+navigation_provider_handle_cached_reply(NavigationProvider *provider,
+                                        NavigationProviderRequest *request,
+                                        DBusMessage *message)
+{
+  NavigationProviderAddressListCallback cb =
+    (NavigationProviderAddressListCallback)request->cb;
+  GSList *candidates = get_cached_candidates(message, request->args);
 
-  if (!com_nokia_Navigation_MapProvider_location_to_addresses(
-        priv->proxy, location->latitude, location->longitude, FALSE,
-        &object_path, error))
+  if (candidates)
+    cb(provider, candidates, NULL, request->user_data);
+  else
   {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
+    cb(provider, NULL,
+       g_error_new(NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                   "No cached address within tolerance"),
+       request->user_data);
+  }
+}
 
-    request->cb = (GCallback)cb;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
+static DBusMessage *
+call_location_to_addresses_cached(NavigationProvider *provider, GVariant *args)
+{
+  DBusMessage *message = provider_method_new(provider,
+                                             "LocationToAddressesCached");
+  double latitude, longitude, tolerance;
 
-    return TRUE;
-  }
-  else
-    g_warning("Location to address failed in provider");
+  g_variant_get(args, "(ddd)", &latitude, &longitude, &tolerance);
+  dbus_message_append_args(message, DBUS_TYPE_DOUBLE, &latitude,
+                           DBUS_TYPE_DOUBLE, &longitude,
+                           DBUS_TYPE_DOUBLE, &tolerance, DBUS_TYPE_INVALID);
 
-  return FALSE;
+  return message;
+}
+
+/* the provider cache is asked through the request queue like any other
+ * request, so it is subject to the same limits and circuit breaker */
+static gboolean
+navigation_provider_location_to_address_cached_full(
+  NavigationProvider *provider, const NavigationLocation *location,
+  gdouble tolerance, NavigationProviderAddressListCallback cb,
+  gpointer userdata, GCancellable *cancellable, GError **error)
+{
+  NavigationProviderRequest *request;
+
+  request = navigation_provider_request_new(REQUEST_LOCATION_TO_ADDRESS_CACHED,
+                                            (GCallback)cb, TRUE, userdata,
+                                            cancellable);
+  request->call = call_location_to_addresses_cached;
+
+  return navigation_provider_request_submit(
+           provider, request, NULL,
+           g_variant_new("(ddd)", location->latitude, location->longitude,
+                         tolerance),
+           error);
 }
 
-/* *INDENT-OFF* */
 gboolean
-navigation_provider_location_to_address_verbose(
-    NavigationProvider *provider, NavigationLocation *location,
-    NavigationProviderLocationToAddressVerboseCallback cb, gpointer userdata,
-    GError **error)
-/* *INDENT-ON* */
+navigation_provider_location_to_address_cached(NavigationProvider *provider,
+                                               NavigationLocation *location,
+                                               gdouble tolerance,
+                                               NavigationAddress **address,
+                                               GError **error)
 {
-  NavigationProviderPrivate *priv;
-  char *object_path = NULL;
+  NavigationProviderPrivate *priv = PRIVATE(provider);
+  NavigationDataset *dataset;
+  DBusMessage *reply;
+  GError *local_error = NULL;
+  GSList *candidates;
+  GVariant *args;
+  gboolean local_only;
+  gboolean probe = FALSE;
+  gint64 issued_at;
 
   g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
 
-  priv = PRIVATE(provider);
+  dataset = navigation_provider_get_dataset(provider, &local_only);
+
+  if (dataset &&
+      (*address = navigation_dataset_lookup(dataset, location, tolerance)))
+  {
+    check_country(*address);
+    return TRUE;
+  }
 
-  if (check_too_many_requests(priv, error))
+  if (local_only)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                "No cached address within tolerance");
     return FALSE;
+  }
 
   if (!navigation_provider_service_init(provider, error))
     return FALSE;
 
-  if (com_nokia_Navigation_MapProvider_location_to_addresses(
-        priv->proxy, location->latitude, location->longitude, TRUE,
-        &object_path, error))
+  /* a blocking call does not take a queue slot, but the circuit breaker
+   * still guards the provider, the outcome settles a probe */
+  issued_at = g_get_monotonic_time();
+
+  if (!health_allow(priv->service, issued_at, &probe))
   {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_UNAVAILABLE,
+                "Provider %s is not responding", priv->service);
+    return FALSE;
+  }
 
-    request->cb = (GCallback)cb;
-    request->verbose = TRUE;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
+  args = g_variant_ref_sink(g_variant_new("(ddd)", location->latitude,
+                                          location->longitude, tolerance));
+  reply = send_to_provider(provider,
+                           call_location_to_addresses_cached(provider, args),
+                           &local_error);
 
-    return TRUE;
+  if (!reply)
+  {
+    health_record(priv->service, health_outcome_from_error(local_error), 0);
+    g_propagate_error(error, local_error);
+    g_variant_unref(args);
+    return FALSE;
+  }
+
+  health_record(priv->service, HEALTH_SUCCESS,
+                g_get_monotonic_time() - issued_at);
+  candidates = get_cached_candidates(reply, args);
+  dbus_message_unref(reply);
+  g_variant_unref(args);
+
+  if (!candidates)
+  {
+    g_set_error(error, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                "No cached address within tolerance");
+    return FALSE;
   }
+
+  *address = candidates->data;
+  navigation_address_list_free(g_slist_delete_link(candidates, candidates));
+
+  return TRUE;
+}
+
+static void
+location_to_address_cached_async_cb(NavigationProvider *provider,
+                                    GSList *addresses, GError *error,
+                                    gpointer userdata)
+{
+  GTask *task = userdata;
+
+  if (error)
+    g_task_return_error(task, error);
   else
-    g_warning("Location to address failed in provider");
+  {
+    g_task_return_pointer(task, addresses,
+                          (GDestroyNotify)navigation_address_list_free);
+  }
 
-  return FALSE;
+  g_object_unref(task);
 }
 
 /* *INDENT-OFF* */
-gboolean
-navigation_provider_address_to_location_verbose(
-    NavigationProvider *provider, const NavigationAddress *address,
-    NavigationProviderAddressToLocationVerboseCallback cb, gpointer userdata,
-    GError **error)
+void
+navigation_provider_location_to_address_cached_async(
+    NavigationProvider *provider, const NavigationLocation *location,
+    gdouble tolerance, int io_priority, GCancellable *cancellable,
+    GAsyncReadyCallback callback, gpointer user_data)
 /* *INDENT-ON* */
 {
-  NavigationProviderPrivate *priv;
-  gchar **array;
-  char *object_path = NULL;
-
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  NavigationDataset *dataset;
+  NavigationAddress *address = NULL;
+  GError *error = NULL;
+  GTask *task;
+  gboolean local_only;
 
-  priv = PRIVATE(provider);
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
 
-  if (check_too_many_requests(priv, error))
-    return FALSE;
+  task = g_task_new(provider, cancellable, callback, user_data);
+  g_task_set_source_tag(task,
+                        navigation_provider_location_to_address_cached_async);
+  g_task_set_priority(task, io_priority);
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+  dataset = navigation_provider_get_dataset(provider, &local_only);
 
-  array = address_to_array(address);
+  if (dataset)
+    address = navigation_dataset_lookup(dataset, location, tolerance);
 
-  if (com_nokia_Navigation_MapProvider_address_to_locations(
-        priv->proxy, (const char **)array, TRUE, &object_path, error))
+  if (g_task_return_error_if_cancelled(task))
   {
-    NavigationProviderRequest *request = g_new0(NavigationProviderRequest, 1);
-
-    request->cb = (GCallback)cb;
-    request->verbose = TRUE;
-    request->user_data = userdata;
-    g_hash_table_insert(priv->requests, object_path, request);
-    g_strfreev(array);
-    return TRUE;
+    navigation_address_free(address);
+    g_object_unref(task);
   }
-  else
+  else if (address)
   {
-    g_warning("Address to locations failed in provider");
-    g_strfreev(array);
+    check_country(address);
+    g_task_return_pointer(task, g_slist_prepend(NULL, address),
+                          (GDestroyNotify)navigation_address_list_free);
+    g_object_unref(task);
+  }
+  else if (local_only)
+  {
+    g_task_return_new_error(task, NAVIGATION_ERROR, NAVIGATION_ERROR_NO_RESULT,
+                            "No cached address within tolerance");
+    g_object_unref(task);
   }
+  else
+  {
+    navigation_priority_push_thread_default(
+      navigation_priority_from_io_priority(io_priority));
 
-  return FALSE;
+    if (!navigation_provider_location_to_address_cached_full(
+          provider, location, tolerance, location_to_address_cached_async_cb,
+          task, cancellable, &error))
+    {
+      g_task_return_error(task, error);
+      g_object_unref(task);
+    }
+
+    navigation_priority_pop_thread_default();
+  }
 }
 
-gboolean
-navigation_provider_location_to_address_cached(NavigationProvider *provider,
-                                               NavigationLocation *location,
-                                               gdouble tolerance,
-                                               NavigationAddress **address,
-                                               GError **error)
+GSList *
+navigation_provider_location_to_address_cached_finish(
+  NavigationProvider *provider, GAsyncResult *result, GError **error)
 {
-  NavigationProviderPrivate *priv;
-  GPtrArray *addresses;
-  gchar **p;
-  int i;
-
-  g_return_val_if_fail(NAVIGATION_IS_PROVIDER(provider), FALSE);
+  g_return_val_if_fail(g_task_is_valid(result, provider), NULL);
 
-  priv = PRIVATE(provider);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
 
-  if (!navigation_provider_service_init(provider, error))
-    return FALSE;
+static void
+get_route_async_cb(NavigationProvider *provider, NavigationRoute *route,
+                   GError *error, gpointer userdata)
+{
+  GTask *task = userdata;
 
-  if (!com_nokia_Navigation_MapProvider_location_to_addresses_cached(
-        priv->proxy, location->latitude, location->longitude, tolerance,
-        &addresses, error))
+  if (error)
+    g_task_return_error(task, error);
+  else
   {
-    return FALSE;
+    g_task_return_pointer(task, route,
+                          (GDestroyNotify)navigation_route_free);
   }
 
-  p = (gchar **)addresses->pdata;
-  *address = g_new0(NavigationAddress, 1);
+  g_object_unref(task);
+}
+
+/* *INDENT-OFF* */
+void
+navigation_provider_get_route_async(
+  NavigationProvider *provider, const NavigationLocation *from,
+  const NavigationLocation *to, unsigned int route_options, int io_priority,
+  GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+/* *INDENT-ON* */
+{
+  GError *error = NULL;
+  GTask *task;
+
+  g_return_if_fail(NAVIGATION_IS_PROVIDER(provider));
+
+  task = g_task_new(provider, cancellable, callback, user_data);
+  g_task_set_source_tag(task, navigation_provider_get_route_async);
+  g_task_set_priority(task, io_priority);
+
+  navigation_priority_push_thread_default(
+    navigation_priority_from_io_priority(io_priority));
 
-  while (*p && (i < 15))
+  if (!navigation_provider_get_route_full(provider, from, to, route_options,
+                                          get_route_async_cb, task,
+                                          cancellable, &error))
   {
-    array_to_address(address, i++, *p);
-    g_free(*p++);
+    g_task_return_error(task, error);
+    g_object_unref(task);
   }
 
-  check_country(*address);
-  g_ptr_array_free(addresses, TRUE);
+  navigation_priority_pop_thread_default();
+}
+
+NavigationRoute *
+navigation_provider_get_route_finish(NavigationProvider *provider,
+                                     GAsyncResult *result, GError **error)
+{
+  g_return_val_if_fail(g_task_is_valid(result, provider), NULL);
 
-  return 1;
+  return g_task_propagate_pointer(G_TASK(result), error);
 }
@@ -18,6 +18,7 @@
 #define __NAVIGATION_MAP_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <navigation/navigation-provider-enums.h>
 
@@ -27,6 +28,13 @@ G_BEGIN_DECLS
 #define NAVIGATION_PROVIDER(o) (G_TYPE_CHECK_INSTANCE_CAST ((o), NAVIGATION_TYPE_PROVIDER, NavigationProvider))
 #define NAVIGATION_IS_PROVIDER(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), NAVIGATION_TYPE_PROVIDER))
 
+/**
+ * NavigationProvider::poi-categories-changed:
+ * @provider: The #NavigationProvider which received the signal
+ *
+ * Emitted when the service announced a new list of POI categories, after the
+ * cached list was replaced.
+ */
 struct _NavigationProvider
 {
   GObject parent;
@@ -65,12 +73,152 @@ GQuark navigation_error_quark (void);
 /**
  * NavigationError:
  * @NAVIGATION_ERROR_TOO_MANY_REQUESTS: Too frequent requests
+ * @NAVIGATION_ERROR_USER_CANCELED_OPERATION: User canceled the operation
+ * @NAVIGATION_ERROR_NO_RESULT: Provider replied without a result
+ * @NAVIGATION_ERROR_INVALID_DATA: Provider replied with malformed data
+ * @NAVIGATION_ERROR_NOT_SUPPORTED: Operation not supported by the provider
+ * @NAVIGATION_ERROR_UNAVAILABLE: Provider is not responding, requests fail
+ * without being sent until it recovers
+ * @NAVIGATION_ERROR_PROVIDER_EXITED: Provider exited before replying
+ * @NAVIGATION_ERROR_TIMED_OUT: Provider did not reply in time
  */
 typedef enum {
         NAVIGATION_ERROR_TOO_MANY_REQUESTS,
         NAVIGATION_ERROR_USER_CANCELED_OPERATION,
+        NAVIGATION_ERROR_NO_RESULT,
+        NAVIGATION_ERROR_INVALID_DATA,
+        NAVIGATION_ERROR_NOT_SUPPORTED,
+        NAVIGATION_ERROR_UNAVAILABLE,
+        NAVIGATION_ERROR_PROVIDER_EXITED,
+        NAVIGATION_ERROR_TIMED_OUT,
 } NavigationError;
 
+/**
+ * NAVIGATION_LOCAL_SERVICE:
+ *
+ * Service name selecting the built-in offline backend. It converts locations
+ * to addresses and addresses to locations from the dataset configured in the
+ * /apps/osso/navigation/dataset GConf key. Requests for maps, POI categories,
+ * routes and streamed address lookups fail with
+ * %NAVIGATION_ERROR_NOT_SUPPORTED. When
+ * a dataset is configured together with a regular service, it is tried first
+ * and the service is only asked when the dataset has no match.
+ */
+#define NAVIGATION_LOCAL_SERVICE "local"
+
+/**
+ * NavigationPriority:
+ * @NAVIGATION_PRIORITY_INTERACTIVE: Work the user is waiting for
+ * @NAVIGATION_PRIORITY_NORMAL: Everything else, the default
+ * @NAVIGATION_PRIORITY_BACKGROUND: Bulk work nobody is waiting for
+ *
+ * Priority classes of provider requests. Only a limited number of requests
+ * can be in flight, requests beyond that wait in a queue and are sent in
+ * priority order. Some slots are kept free for interactive requests, so
+ * background work can never occupy all of them. Requests gain a class for
+ * every two seconds they have waited, so none of them waits forever.
+ *
+ * Requests to the same service are also limited to the rate and burst set in
+ * the /apps/osso/navigation/rate_limit and /apps/osso/navigation/rate_burst
+ * GConf keys, across all providers of the process. Requests over the limit
+ * wait in the queue. The keys are read when the first provider is created.
+ *
+ * When the provider service exits, requests it did not reply to fail with
+ * %NAVIGATION_ERROR_PROVIDER_EXITED. Queued requests wait up to five seconds
+ * for the service to come back before they are sent. Sent requests the
+ * service sends nothing for during a minute fail with
+ * %NAVIGATION_ERROR_TIMED_OUT.
+ *
+ * Replies, the rate limit timer and the reply timeout all run in the default
+ * main context. It must be iterated for queued requests to be sent and sent
+ * ones to finish, even if requests are issued from threads with a context of
+ * their own.
+ */
+typedef enum {
+	NAVIGATION_PRIORITY_INTERACTIVE,
+	NAVIGATION_PRIORITY_NORMAL,
+	NAVIGATION_PRIORITY_BACKGROUND
+} NavigationPriority;
+
+/**
+ * NavigationPriorityStats:
+ * @n_requests: Number of requests sent to the provider so far
+ * @n_queued: Number of requests currently waiting for a slot
+ * @wait_time: Total time the sent requests waited, in microseconds
+ * @max_wait_time: Longest time a sent request waited, in microseconds
+ * @throttle_time: Part of @wait_time the sent requests were held back by the
+ * rate limit of the service or waited for it to restart, in microseconds
+ *
+ * Queueing statistics of a #NavigationPriority class.
+ */
+typedef struct _NavigationPriorityStats {
+	guint  n_requests;
+	guint  n_queued;
+	gint64 wait_time;
+	gint64 max_wait_time;
+	gint64 throttle_time;
+} NavigationPriorityStats;
+
+/**
+ * NavigationHedgeStats:
+ * @n_requests: Number of reverse geocoding requests sent while hedging
+ * @n_hedged: Number of them also sent to the secondary provider
+ * @n_secondary_wins: Number of them the secondary provider answered first
+ * @delay: Current delay before a request is hedged, in microseconds
+ *
+ * Hedging statistics of a #NavigationProvider, see
+ * navigation_provider_enable_hedging().
+ */
+typedef struct _NavigationHedgeStats {
+	guint  n_requests;
+	guint  n_hedged;
+	guint  n_secondary_wins;
+	gint64 delay;
+} NavigationHedgeStats;
+
+/**
+ * NavigationCircuitState:
+ * @NAVIGATION_CIRCUIT_CLOSED: Requests are sent to the service
+ * @NAVIGATION_CIRCUIT_OPEN: Requests fail with
+ * %NAVIGATION_ERROR_UNAVAILABLE without being sent
+ * @NAVIGATION_CIRCUIT_HALF_OPEN: A single request is sent to probe whether
+ * the service recovered
+ *
+ * State of the circuit breaker of a service. It opens after a run of failed
+ * or timed out method calls, or when most recent calls failed. After a
+ * cooldown it turns half open: if the probe succeeds it closes, otherwise it
+ * opens again for twice as long. A service that hangs thus costs a few method
+ * call timeouts instead of one for every request. Requests that time out
+ * waiting for their reply count as timed out calls, a probe that is cancelled
+ * or outlived by its service lets the next request probe again.
+ */
+typedef enum {
+	NAVIGATION_CIRCUIT_CLOSED,
+	NAVIGATION_CIRCUIT_OPEN,
+	NAVIGATION_CIRCUIT_HALF_OPEN
+} NavigationCircuitState;
+
+/**
+ * NavigationServiceHealth:
+ * @state: The #NavigationCircuitState of the service
+ * @n_calls: Number of method calls made to the service
+ * @n_rejected: Number of requests failed because the circuit was open
+ * @error_rate: Moving average of the fraction of failed calls
+ * @timeout_rate: Moving average of the fraction of timed out calls
+ * @latency: Moving average of the time until the reply, in microseconds
+ *
+ * Health of the service of a #NavigationProvider, shared by all providers
+ * of the process talking to the same service.
+ */
+typedef struct _NavigationServiceHealth {
+	NavigationCircuitState state;
+	guint  n_calls;
+	guint  n_rejected;
+	double error_rate;
+	double timeout_rate;
+	double latency;
+} NavigationServiceHealth;
+
 
 /**
  * NavigationProviderDetails:
@@ -147,12 +295,86 @@ typedef struct _NavigationArea {
 	NavigationLocation se;
 } NavigationArea;
 
+/**
+ * NavigationMap:
+ * @area: The area covered by the map
+ * @px_width: Width of the map in pixels
+ * @px_height: Height of the map in pixels
+ *
+ * A struct representing a rendered view of an area
+ */
 typedef struct _NavigationMap {
 	NavigationArea  area;
 	gint            px_width;
 	gint            px_height;
 } NavigationMap;
 
+/**
+ * NavigationRoute:
+ * @points: The vertices of the route geometry
+ * @n_points: Number of entries in @points
+ * @length: Length of the route in meters
+ * @duration: Estimated travel time in seconds
+ *
+ * A struct representing a route between two locations
+ */
+typedef struct _NavigationRoute {
+	NavigationLocation *points;
+	guint               n_points;
+	double              length;
+	double              duration;
+} NavigationRoute;
+
+/**
+ * NAVIGATION_POLYLINE_PRECISION:
+ *
+ * Number of encoded polyline units per degree.
+ */
+#define NAVIGATION_POLYLINE_PRECISION 1000000
+
+/**
+ * NavigationPolylineDecoder:
+ *
+ * Holds the state of an encoded polyline being decoded in pieces. All fields
+ * are private.
+ */
+typedef struct _NavigationPolylineDecoder {
+	/*< private >*/
+	gint32   latitude;
+	gint32   longitude;
+	guint32  value;
+	guint    shift;
+	gboolean have_latitude;
+} NavigationPolylineDecoder;
+
+/**
+ * NAVIGATION_TILE_SIZE:
+ *
+ * Width and height of a map tile in pixels.
+ */
+#define NAVIGATION_TILE_SIZE 256
+
+/**
+ * NAVIGATION_TILE_MAX_ZOOM:
+ *
+ * The highest zoom level a tile key can hold.
+ */
+#define NAVIGATION_TILE_MAX_ZOOM 24
+
+/**
+ * NavigationTile:
+ * @x: Column of the tile, counted eastwards from the antimeridian
+ * @y: Row of the tile, counted southwards from the northern edge
+ * @zoom: Zoom level, the world is 2^@zoom tiles wide and high
+ *
+ * A tile of the web mercator grid used by slippy maps.
+ */
+typedef struct _NavigationTile {
+	guint x;
+	guint y;
+	int   zoom;
+} NavigationTile;
+
 /**
  * navigation_provider_new_default:
  *
@@ -162,6 +384,18 @@ typedef struct _NavigationMap {
  */
 NavigationProvider *navigation_provider_new_default (void);
 
+/**
+ * navigation_provider_prewarm:
+ * @provider: A #NavigationProvider
+ *
+ * Does the setup otherwise done by the first request of @provider: loads the
+ * offline dataset, connects to the session bus and has D-Bus activate the
+ * provider service. The setup runs in the calling thread, only the
+ * activation is not waited for. Call it early from the thread that uses
+ * @provider, for example right after navigation_provider_new_default().
+ */
+void navigation_provider_prewarm (NavigationProvider *provider);
+
 /**
  * navigation_make_resudent
  *
@@ -226,12 +460,47 @@ void navigation_location_free (NavigationLocation *location);
  * @address: Address that will be copied to string array.
  *
  * Creates string array from address. Used internally in DBus communication.
+ *
+ * The array has 15 entries: the 11 #NavigationAddress fields in declaration
+ * order, from house_num to time_zone, followed by 4 reserved entries that are
+ * left empty. In the replies of LocationToAddressesCached, a provider that
+ * knows where a candidate is puts its latitude into reserved entry 11 and its
+ * longitude into entry 12, as decimal degrees in the C locale.
  * 
  * Return value: Newly allocated string array containing all #NavigationAddress
  * structs fields.
  */
 gchar ** address_to_array (const NavigationAddress *address);
 
+/**
+ * navigation_address_to_variant:
+ * @address: A #NavigationAddress
+ *
+ * Encodes @address as a (qa{ys}) #GVariant: %NAVIGATION_ADDRESS_ENCODING_VERSION
+ * followed by the non-empty fields keyed by their NAVIGATION_ADDRESS_FIELD_*
+ * id. Addresses are sent this way to providers that implement the
+ * AddressToLocationsEncoded method, which otherwise takes the same arguments
+ * as AddressToLocations. Providers that implement LocationToAddressesEncoded
+ * send the addresses of its LocationToAddressReply as a(qa{ys}) instead of
+ * aas. Providers without these methods get the string arrays of
+ * address_to_array().
+ *
+ * Return value: A floating #GVariant.
+ */
+GVariant *navigation_address_to_variant (const NavigationAddress *address);
+
+/**
+ * navigation_address_from_variant:
+ * @variant: A (qa{ys}) #GVariant
+ *
+ * Decodes an address encoded by navigation_address_to_variant(). Unknown
+ * field ids, which later versions may add, are ignored.
+ *
+ * Return value: A newly allocated #NavigationAddress to be freed with
+ * navigation_address_free(), or %NULL if @variant is not an encoded address.
+ */
+NavigationAddress *navigation_address_from_variant (GVariant *variant);
+
 /**
  * navigation_address_copy:
  * @address: Address that will be coped
@@ -243,6 +512,43 @@ gchar ** address_to_array (const NavigationAddress *address);
  */
 NavigationAddress * navigation_address_copy (NavigationAddress *address);
 
+/**
+ * navigation_address_normalize:
+ * @address: A #NavigationAddress
+ *
+ * Gets a canonical form of @address for comparing it with others. Case,
+ * accents, punctuation and whitespace are dropped, the time zone is ignored
+ * and the country is resolved to its ISO 3166 alpha-3 code, so "Espoo,
+ * Finland" and "ESPOO FIN" give the same string.
+ *
+ * Return value: A newly allocated string, free it with g_free().
+ */
+gchar *navigation_address_normalize (const NavigationAddress *address);
+
+/**
+ * navigation_address_hash:
+ * @address: A #NavigationAddress
+ *
+ * Gets a hash of @address that is the same for addresses
+ * navigation_address_equal() considers equal, and stable across processes.
+ *
+ * Return value: The 64 bit hash of navigation_address_normalize().
+ */
+guint64 navigation_address_hash (const NavigationAddress *address);
+
+/**
+ * navigation_address_equal:
+ * @a: A #NavigationAddress
+ * @b: A #NavigationAddress
+ *
+ * Compares the normalized forms of @a and @b, see
+ * navigation_address_normalize().
+ *
+ * Return value: TRUE if @a and @b are the same address.
+ */
+gboolean navigation_address_equal (const NavigationAddress *a,
+                                   const NavigationAddress *b);
+
 /**
  * NavigationProviderLocationToAddressCallback:
  * @provider: A #NavigationProvider
@@ -267,6 +573,11 @@ typedef void (* NavigationProviderLocationToAddressCallback) (NavigationProvider
  *
  * Uses @provider object to convert @location to an address string
  *
+ * If the /apps/osso/navigation/geocode_cache_file GConf key names a file,
+ * addresses found are kept there for the time set in
+ * /apps/osso/navigation/geocode_cache_ttl, and later requests for a location
+ * within about a meter are answered from it.
+ *
  * Return value: TRUE on success, FALSE otherwise.
  */
 gboolean
@@ -323,6 +634,9 @@ navigation_provider_location_to_address_verbose (NavigationProvider *provider,
  * Only tries to search location from navigation providers cache so
  * that network connection is not needed. Always returns closest address.
  *
+ * This blocks the calling thread until the provider replies, no main context
+ * is iterated meanwhile. It does not wait for a slot in the request queue.
+ *
  * Return value: TRUE on success, FALSE otherwise.
  */
 gboolean
@@ -332,6 +646,53 @@ navigation_provider_location_to_address_cached (NavigationProvider *provider,
                                                 NavigationAddress  **address,
                                                 GError             **error);
 
+/**
+ * navigation_provider_location_to_address_cached_async:
+ * @provider: A #NavigationProvider object
+ * @location: A #NavigationLocation
+ * @tolerance: A tolerance in meters how far cached values can be from requested
+ * @io_priority: The I/O priority of the request
+ * @cancellable: Optional #GCancellable object, %NULL to ignore
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: The data to pass to @callback
+ *
+ * Asynchronous version of navigation_provider_location_to_address_cached()
+ * that does not block the calling thread. All cached candidates within
+ * @tolerance are returned. You can call
+ * navigation_provider_location_to_address_cached_finish() from @callback to
+ * get the result.
+ */
+void
+navigation_provider_location_to_address_cached_async (NavigationProvider       *provider,
+                                                      const NavigationLocation *location,
+                                                      gdouble                   tolerance,
+                                                      int                       io_priority,
+                                                      GCancellable             *cancellable,
+                                                      GAsyncReadyCallback       callback,
+                                                      gpointer                  user_data);
+
+/**
+ * navigation_provider_location_to_address_cached_finish:
+ * @provider: A #NavigationProvider object
+ * @result: A #GAsyncResult
+ * @error: A #GError for reporting errors
+ *
+ * Finishes an operation started with
+ * navigation_provider_location_to_address_cached_async().
+ *
+ * The candidates are ranked by their distance from the requested location,
+ * closest first. Candidates for which the provider did not report a position,
+ * in the reserved entries 11 and 12 described at address_to_array(), follow in
+ * the order the provider returned them.
+ *
+ * Return value: A #GSList of #NavigationAddress to be freed with
+ * navigation_address_list_free(), or %NULL on error.
+ */
+GSList *
+navigation_provider_location_to_address_cached_finish (NavigationProvider *provider,
+                                                       GAsyncResult       *result,
+                                                       GError            **error);
+
 /**
  * navigation_address_list_free:
  * @addresses: #GSList of #NavigationAddress data types to be freed
@@ -340,6 +701,28 @@ navigation_provider_location_to_address_cached (NavigationProvider *provider,
  */
 void navigation_address_list_free (GSList *addresses);
 
+/**
+ * navigation_provider_complete_address:
+ * @provider: A #NavigationProvider object
+ * @text: Free text the user typed so far, like "main st spring"
+ * @max_results: The maximum number of addresses to return, at most 32
+ * @error: A #GError for reporting errors
+ *
+ * Looks up addresses whose street, town and postal code contain all words of
+ * @text in the offline dataset, without going through the navigation
+ * service. The last word also matches longer words it is a prefix of, unless
+ * @text ends with a separator, so this can be called on every key press.
+ *
+ * Return value: A #GSList of #NavigationAddress, best match first, to be freed
+ * with navigation_address_list_free(). %NULL with @error set if no offline
+ * dataset is configured or nothing matched.
+ */
+GSList *
+navigation_provider_complete_address (NavigationProvider *provider,
+                                      const char         *text,
+                                      guint               max_results,
+                                      GError            **error);
+
 /**
  * NavigationProviderAddressToLocationCallback:
  * @provider: A #NavigationProvider
@@ -364,6 +747,16 @@ typedef void (* NavigationProviderAddressToLocationCallback) (NavigationProvider
  *
  * Uses @provider to convert @address into a #NavigationLocation
  *
+ * Results are cached per service under the normalized address, see
+ * navigation_address_normalize(), for the time set in the
+ * /apps/osso/navigation/geocode_cache_ttl GConf key. Addresses the provider
+ * found nothing for are cached for the time set in
+ * /apps/osso/navigation/geocode_cache_negative_ttl. If
+ * /apps/osso/navigation/geocode_cache_file names a file, results are also
+ * kept there across restarts, up to /apps/osso/navigation/geocode_cache_max_size
+ * KiB. These keys are read when the first provider of the process is
+ * created.
+ *
  * Return value: TRUE on success, FALSE otherwise.
  */
 gboolean
@@ -409,6 +802,66 @@ navigation_provider_address_to_location_verbose (NavigationProvider      *provid
                                          gpointer                userdata,
 			                 GError                  **error);
 
+/**
+ * NavigationProviderAddressToLocationsChunkCallback:
+ * @provider: A #NavigationProvider
+ * @locations: An array of #NavigationLocation owned by the library
+ * @n_locations: Number of entries in @locations
+ * @userdata: The userdata passed into #navigation_provider_address_to_locations_streamed
+ *
+ * Type of the callback function for #navigation_provider_address_to_locations_streamed
+ * which is called every time @provider has sent a batch of results.
+ *
+ * Note: @locations is only valid for the duration of the call, copy what you need.
+ */
+typedef void (* NavigationProviderAddressToLocationsChunkCallback) (NavigationProvider       *provider,
+                                                                    const NavigationLocation *locations,
+                                                                    guint                     n_locations,
+                                                                    gpointer                  userdata);
+
+/**
+ * NavigationProviderAddressToLocationsDoneCallback:
+ * @provider: A #NavigationProvider
+ * @n_locations: Total number of locations delivered through the chunk callback
+ * @error: A possible error that should be freed after use
+ * @userdata: The userdata passed into #navigation_provider_address_to_locations_streamed
+ *
+ * Type of the callback function for #navigation_provider_address_to_locations_streamed
+ * which is called exactly once, after the last chunk or on error.
+ */
+typedef void (* NavigationProviderAddressToLocationsDoneCallback) (NavigationProvider *provider,
+                                                                   guint               n_locations,
+                                                                   GError             *error,
+                                                                   gpointer            userdata);
+
+/**
+ * navigation_provider_address_to_locations_streamed:
+ * @provider: A #NavigationProvider object
+ * @address: A #NavigationAddress object
+ * @chunk_size: Preferred number of locations per chunk, 0 lets @provider decide
+ * @chunk_cb: A #NavigationProviderAddressToLocationsChunkCallback
+ * @done_cb: A #NavigationProviderAddressToLocationsDoneCallback
+ * @userdata: The data to be passed to @chunk_cb and @done_cb
+ * @error: A #GError to return errors
+ *
+ * Uses @provider to convert @address into all matching #NavigationLocation.
+ * Results are handed to @chunk_cb as soon as @provider finds them, followed by
+ * a single call to @done_cb. Providers stream results through the optional
+ * AddressToLocationsStreamed(as address, u chunk_size) method, which returns
+ * the object path of the request like AddressToLocations does. Providers
+ * without it deliver all results in one chunk.
+ *
+ * Return value: TRUE on success, FALSE otherwise.
+ */
+gboolean
+navigation_provider_address_to_locations_streamed (NavigationProvider      *provider,
+                                                   const NavigationAddress *address,
+                                                   guint                    chunk_size,
+                                                   NavigationProviderAddressToLocationsChunkCallback chunk_cb,
+                                                   NavigationProviderAddressToLocationsDoneCallback  done_cb,
+                                                   gpointer                 userdata,
+                                                   GError                 **error);
+
 /**
  * navigation_provider_show_region:
  * @provider: A #NavigationProvider
@@ -508,6 +961,415 @@ gboolean navigation_provider_get_poi_categories (NavigationProvider *provider,
                                                  gpointer                userdata,
 			                         GError                  **error);
 
+/**
+ * NavigationProviderGetSharedPOICategoriesCallback:
+ * @provider: A #NavigationProvider
+ * @categories: A shared %NULL-terminated array of categories, or %NULL
+ * @userdata: The userdata passed into #navigation_provider_get_poi_categories_shared
+ *
+ * Type of the callback function for
+ * #navigation_provider_get_poi_categories_shared which is called whenever
+ * @provider has returned categories.
+ *
+ * Note: @categories must not be modified or freed. It is only valid until the
+ * callback returns, take a reference with navigation_poi_categories_ref() to
+ * keep it longer.
+ */
+typedef void (* NavigationProviderGetSharedPOICategoriesCallback) (NavigationProvider *provider,
+                                                                   const char * const *categories,
+                                                                   gpointer            userdata);
+
+/**
+ * navigation_provider_get_poi_categories_shared:
+ * @provider: A #NavigationProvider
+ * @cb: A #NavigationProviderGetSharedPOICategoriesCallback
+ * @userdata: The data to be passed to @cb
+ * @error: A #GError for reporting errors
+ *
+ * Like navigation_provider_get_poi_categories(), but hands out the cached
+ * list itself instead of a copy.
+ *
+ * The categories of every service are cached for the number of seconds in
+ * the /apps/osso/navigation/poi_categories_ttl GConf key, 0 disables the
+ * cache. The key is read when the first provider is created. A provider
+ * announces a changed list with the POICategoriesChanged signal carrying the
+ * new categories, which replaces the cached one and emits
+ * #NavigationProvider::poi-categories-changed.
+ *
+ * Return value: TRUE on success, FALSE otherwise.
+ */
+gboolean navigation_provider_get_poi_categories_shared (NavigationProvider *provider,
+                                                        NavigationProviderGetSharedPOICategoriesCallback cb,
+                                                        gpointer            userdata,
+                                                        GError            **error);
+
+/**
+ * navigation_poi_categories_ref:
+ * @categories: Categories from a #NavigationProviderGetSharedPOICategoriesCallback
+ *
+ * Takes a reference to a shared category list.
+ *
+ * Return value: @categories
+ */
+const char * const *navigation_poi_categories_ref (const char * const *categories);
+
+/**
+ * navigation_poi_categories_unref:
+ * @categories: Categories from navigation_poi_categories_ref()
+ *
+ * Releases a reference to a shared category list.
+ */
+void navigation_poi_categories_unref (const char * const *categories);
+
+/**
+ * NavigationProviderGetRouteCallback:
+ * @provider: A #NavigationProvider
+ * @route: A #NavigationRoute to be freed with navigation_route_free(), or %NULL
+ * @error: A possible error that should be freed after use
+ * @userdata: The userdata passed into #navigation_provider_get_route
+ *
+ * Type of the callback function for #navigation_provider_get_route which is
+ * called whenever @provider has returned a route or an error.
+ */
+typedef void (* NavigationProviderGetRouteCallback) (NavigationProvider *provider,
+                                                     NavigationRoute    *route,
+                                                     GError             *error,
+                                                     gpointer            userdata);
+
+/**
+ * navigation_provider_get_route:
+ * @provider: A #NavigationProvider
+ * @from: A #NavigationLocation representing the start of the route
+ * @to: A #NavigationLocation representing the end of the route
+ * @route_options: A combination of NAVIGATION_ROUTE_*, NAVIGATION_MODE_* and
+ * NAVIGATION_ALLOW_* options
+ * @cb: A #NavigationProviderGetRouteCallback
+ * @userdata: The data to be passed to @cb
+ * @error: A #GError for reporting errors
+ *
+ * Requests the geometry, length and duration of the route starting at @from
+ * and ending at @to. The geometry is transferred as an encoded polyline and
+ * decoded before @cb is called. Providers implement routing through the
+ * optional GetRoute(d, d, d, d, u route_options) method, which returns the
+ * object path of the request.
+ *
+ * Return value: TRUE on success, FALSE otherwise
+ */
+gboolean navigation_provider_get_route (NavigationProvider                *provider,
+                                        const NavigationLocation          *from,
+                                        const NavigationLocation          *to,
+                                        unsigned int                       route_options,
+                                        NavigationProviderGetRouteCallback cb,
+                                        gpointer                           userdata,
+                                        GError                           **error);
+
+/**
+ * NavigationProviderRouteMatrixCallback:
+ * @provider: A #NavigationProvider
+ * @first_row: Index of the first source in this tile
+ * @n_rows: Number of sources in this tile
+ * @first_col: Index of the first destination in this tile
+ * @n_cols: Number of destinations in this tile
+ * @durations: Row-major @n_rows x @n_cols travel times in seconds
+ * @lengths: Row-major @n_rows x @n_cols route lengths in meters
+ * @userdata: The userdata passed into #navigation_provider_get_route_matrix
+ *
+ * Type of the callback function for #navigation_provider_get_route_matrix
+ * which is called for every tile of the matrix. Unreachable destinations are
+ * reported as infinity.
+ *
+ * Note: @durations and @lengths are only valid for the duration of the call.
+ */
+typedef void (* NavigationProviderRouteMatrixCallback) (NavigationProvider *provider,
+                                                        guint               first_row,
+                                                        guint               n_rows,
+                                                        guint               first_col,
+                                                        guint               n_cols,
+                                                        const double       *durations,
+                                                        const double       *lengths,
+                                                        gpointer            userdata);
+
+/**
+ * NavigationProviderRouteMatrixDoneCallback:
+ * @provider: A #NavigationProvider
+ * @error: A possible error that should be freed after use
+ * @userdata: The userdata passed into #navigation_provider_get_route_matrix
+ *
+ * Type of the callback function for #navigation_provider_get_route_matrix
+ * which is called exactly once, after the last tile or on error.
+ */
+typedef void (* NavigationProviderRouteMatrixDoneCallback) (NavigationProvider *provider,
+                                                            GError             *error,
+                                                            gpointer            userdata);
+
+/**
+ * navigation_provider_get_route_matrix:
+ * @provider: A #NavigationProvider
+ * @sources: An array of #NavigationLocation the routes start at
+ * @n_sources: Number of entries in @sources
+ * @destinations: An array of #NavigationLocation the routes end at
+ * @n_destinations: Number of entries in @destinations
+ * @route_options: A combination of NAVIGATION_ROUTE_*, NAVIGATION_MODE_* and
+ * NAVIGATION_ALLOW_* options
+ * @cb: A #NavigationProviderRouteMatrixCallback
+ * @done_cb: A #NavigationProviderRouteMatrixDoneCallback
+ * @userdata: The data to be passed to @cb and @done_cb
+ * @error: A #GError for reporting errors
+ *
+ * Requests travel time and length of the routes from every source to every
+ * destination. The matrix is split into tiles of bounded size which are
+ * requested one after another and handed to @cb as they arrive, so only one
+ * provider request is used at any time. Every tile is requested from the
+ * optional GetRouteMatrix(ad sources, ad destinations, u route_options)
+ * method of the provider, with the coordinates as latitude, longitude pairs.
+ *
+ * Return value: TRUE on success, FALSE otherwise
+ */
+gboolean navigation_provider_get_route_matrix (NavigationProvider                       *provider,
+                                               const NavigationLocation                 *sources,
+                                               guint                                     n_sources,
+                                               const NavigationLocation                 *destinations,
+                                               guint                                     n_destinations,
+                                               unsigned int                              route_options,
+                                               NavigationProviderRouteMatrixCallback     cb,
+                                               NavigationProviderRouteMatrixDoneCallback done_cb,
+                                               gpointer                                  userdata,
+                                               GError                                  **error);
+
+/**
+ * navigation_route_free:
+ * @route: A #NavigationRoute
+ *
+ * Frees @route and its points.
+ */
+void navigation_route_free (NavigationRoute *route);
+
+/**
+ * navigation_polyline_encode:
+ * @locations: An array of #NavigationLocation
+ * @n_locations: Number of entries in @locations
+ *
+ * Encodes @locations as a delta and varint compressed polyline, the format
+ * providers use for route geometry.
+ *
+ * Return value: A #GBytes to be unreferenced after use.
+ */
+GBytes *navigation_polyline_encode (const NavigationLocation *locations,
+                                    guint                     n_locations);
+
+/**
+ * navigation_polyline_decode:
+ * @data: An encoded polyline
+ * @len: Length of @data
+ * @n_locations: Return location for the number of decoded locations
+ * @error: A #GError for reporting errors
+ *
+ * Decodes a polyline created by navigation_polyline_encode().
+ *
+ * Return value: An array of #NavigationLocation to be freed with g_free(), or
+ * %NULL on error.
+ */
+NavigationLocation *navigation_polyline_decode (const guint8 *data,
+                                                gsize         len,
+                                                guint        *n_locations,
+                                                GError      **error);
+
+/**
+ * navigation_polyline_decoder_init:
+ * @decoder: A #NavigationPolylineDecoder
+ *
+ * Prepares @decoder for a new polyline.
+ */
+void navigation_polyline_decoder_init (NavigationPolylineDecoder *decoder);
+
+/**
+ * navigation_polyline_decoder_feed:
+ * @decoder: A #NavigationPolylineDecoder
+ * @data: The next piece of the encoded polyline
+ * @len: Length of @data
+ * @locations: A #GArray of #NavigationLocation to append decoded vertices to
+ * @error: A #GError for reporting errors
+ *
+ * Decodes @data, which can be split at any byte, appending every completed
+ * vertex to @locations.
+ *
+ * Return value: TRUE on success, FALSE if @data is malformed.
+ */
+gboolean navigation_polyline_decoder_feed (NavigationPolylineDecoder *decoder,
+                                           const guint8              *data,
+                                           gsize                      len,
+                                           GArray                    *locations,
+                                           GError                   **error);
+
+/**
+ * navigation_polyline_decoder_finish:
+ * @decoder: A #NavigationPolylineDecoder
+ * @error: A #GError for reporting errors
+ *
+ * Checks that the polyline fed to @decoder ended on a vertex boundary.
+ *
+ * Return value: TRUE on success, FALSE if the polyline was truncated.
+ */
+gboolean navigation_polyline_decoder_finish (NavigationPolylineDecoder *decoder,
+                                             GError                   **error);
+
+/**
+ * navigation_geo_distances:
+ * @from: A #NavigationLocation
+ * @latitudes: Latitudes of @n points in degrees
+ * @longitudes: Longitudes of @n points in degrees
+ * @n: Number of points
+ * @distances: Return location for @n distances in meters
+ *
+ * Computes the great circle distance from @from to every point, several
+ * points at a time with the widest vector instructions the CPU offers.
+ * Coordinates are passed as separate arrays rather than #NavigationLocation
+ * so they can be loaded straight into vector registers.
+ */
+void navigation_geo_distances (const NavigationLocation *from,
+                               const double             *latitudes,
+                               const double             *longitudes,
+                               guint                     n,
+                               double                   *distances);
+
+/**
+ * navigation_geo_nearest:
+ * @from: A #NavigationLocation
+ * @latitudes: Latitudes of @n points in degrees
+ * @longitudes: Longitudes of @n points in degrees
+ * @n: Number of points
+ * @distance: Optional return location for the distance in meters
+ *
+ * Finds the point closest to @from, the first one if several are equally
+ * close.
+ *
+ * Return value: The index of the nearest point, or %G_MAXUINT if @n is 0.
+ */
+guint navigation_geo_nearest (const NavigationLocation *from,
+                              const double             *latitudes,
+                              const double             *longitudes,
+                              guint                     n,
+                              double                   *distance);
+
+/**
+ * navigation_geo_area_contains:
+ * @area: A #NavigationArea
+ * @latitudes: Latitudes of @n points in degrees
+ * @longitudes: Longitudes of @n points in degrees
+ * @n: Number of points
+ * @inside: Optional return location for @n flags, 1 if the point is inside
+ *
+ * Tests which points lie within @area, edges included. An area whose
+ * northwest corner is east of its southeast corner crosses the antimeridian.
+ *
+ * Return value: The number of points inside @area.
+ */
+guint navigation_geo_area_contains (const NavigationArea *area,
+                                    const double         *latitudes,
+                                    const double         *longitudes,
+                                    guint                 n,
+                                    guint8               *inside);
+
+/**
+ * navigation_tile_from_location:
+ * @location: A #NavigationLocation
+ * @zoom: Zoom level, between 0 and %NAVIGATION_TILE_MAX_ZOOM
+ * @tile: Return location for the tile
+ *
+ * Finds the tile containing @location. Locations beyond the grid, like the
+ * poles, map to the nearest tile on its edge.
+ */
+void navigation_tile_from_location (const NavigationLocation *location,
+                                    int                       zoom,
+                                    NavigationTile           *tile);
+
+/**
+ * navigation_tile_get_area:
+ * @tile: A #NavigationTile
+ * @area: Return location for the area covered by @tile
+ *
+ * Computes the corners of @tile.
+ */
+void navigation_tile_get_area (const NavigationTile *tile,
+                               NavigationArea       *area);
+
+/**
+ * navigation_tile_get_center:
+ * @tile: A #NavigationTile
+ * @location: Return location for the center of @tile
+ *
+ * Computes the location to pass to
+ * navigation_provider_request_pixbuf_from_map() to get exactly @tile, with a
+ * map of %NAVIGATION_TILE_SIZE pixels square.
+ */
+void navigation_tile_get_center (const NavigationTile *tile,
+                                 NavigationLocation   *location);
+
+/**
+ * navigation_tile_get_key:
+ * @tile: A #NavigationTile
+ * @map_options: A combination of NAVIGATION_MAP_* options
+ *
+ * Packs @tile and the colour, type and format of @map_options into a single
+ * integer, suitable as a hash table key. Other bits of @map_options are
+ * ignored.
+ *
+ * Return value: The key of @tile.
+ */
+guint64 navigation_tile_get_key (const NavigationTile *tile,
+                                 unsigned int          map_options);
+
+/**
+ * navigation_tile_from_key:
+ * @key: A key returned by navigation_tile_get_key()
+ * @tile: Return location for the tile
+ *
+ * Unpacks a tile key.
+ *
+ * Return value: The map options stored in @key.
+ */
+unsigned int navigation_tile_from_key (guint64         key,
+                                       NavigationTile *tile);
+
+/**
+ * navigation_tile_keys:
+ * @latitudes: Latitudes of @n points in degrees
+ * @longitudes: Longitudes of @n points in degrees
+ * @n: Number of points
+ * @zoom: Zoom level, between 0 and %NAVIGATION_TILE_MAX_ZOOM
+ * @map_options: A combination of NAVIGATION_MAP_* options
+ * @keys: Return location for @n tile keys
+ *
+ * Computes the key of the tile containing each point, several points at a
+ * time like navigation_geo_distances(). Gives the same tiles as
+ * navigation_tile_from_location().
+ */
+void navigation_tile_keys (const double *latitudes,
+                           const double *longitudes,
+                           guint         n,
+                           int           zoom,
+                           unsigned int  map_options,
+                           guint64      *keys);
+
+/**
+ * navigation_map_snap_location:
+ * @location: Center of a map
+ * @zoom: Zoom level of the map
+ * @map_width: Width of the map in pixels
+ * @map_height: Height of the map in pixels
+ * @snapped: Return location for the new center
+ *
+ * Moves the center of a map by at most half a tile, so its northwest corner
+ * falls on the nearest tile corner. Maps snapped this way line up with the
+ * tile grid, so views that differ only slightly become identical requests
+ * and are made of whole tiles.
+ */
+void navigation_map_snap_location (const NavigationLocation *location,
+                                   int                       zoom,
+                                   int                       map_width,
+                                   int                       map_height,
+                                   NavigationLocation       *snapped);
+
 /**
  * navigation_provider_show_route:
  * @provider: A #NavigationProvider
@@ -609,6 +1471,449 @@ navigation_provider_request_pixbuf_from_map (NavigationProvider       *provider,
 					     gpointer                  userdata,
 					     GError                  **error);
 
+/**
+ * navigation_provider_location_to_address_async:
+ * @provider: A #NavigationProvider object
+ * @location: A #NavigationLocation
+ * @io_priority: The I/O priority of the request
+ * @cancellable: Optional #GCancellable object, %NULL to ignore
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: The data to pass to @callback
+ *
+ * Asynchronously converts @location to an address. When the operation is
+ * finished, @callback will be called in the thread-default main context of
+ * the calling thread. You can then call
+ * navigation_provider_location_to_address_finish() to get the result.
+ *
+ * Cancelling @cancellable releases the pending request slot immediately.
+ */
+void
+navigation_provider_location_to_address_async (NavigationProvider       *provider,
+                                               const NavigationLocation *location,
+                                               int                       io_priority,
+                                               GCancellable             *cancellable,
+                                               GAsyncReadyCallback       callback,
+                                               gpointer                  user_data);
+
+/**
+ * navigation_provider_location_to_address_finish:
+ * @provider: A #NavigationProvider object
+ * @result: A #GAsyncResult
+ * @error: A #GError for reporting errors
+ *
+ * Finishes an operation started with
+ * navigation_provider_location_to_address_async().
+ *
+ * Return value: A #NavigationAddress to be freed with navigation_address_free(),
+ * or %NULL on error.
+ */
+NavigationAddress *
+navigation_provider_location_to_address_finish (NavigationProvider *provider,
+                                                GAsyncResult       *result,
+                                                GError            **error);
+
+/**
+ * navigation_provider_address_to_location_async:
+ * @provider: A #NavigationProvider object
+ * @address: A #NavigationAddress object
+ * @io_priority: The I/O priority of the request
+ * @cancellable: Optional #GCancellable object, %NULL to ignore
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: The data to pass to @callback
+ *
+ * Asynchronously converts @address into a #NavigationLocation. When the
+ * operation is finished, @callback will be called. You can then call
+ * navigation_provider_address_to_location_finish() to get the result.
+ */
+void
+navigation_provider_address_to_location_async (NavigationProvider      *provider,
+                                               const NavigationAddress *address,
+                                               int                      io_priority,
+                                               GCancellable            *cancellable,
+                                               GAsyncReadyCallback      callback,
+                                               gpointer                 user_data);
+
+/**
+ * navigation_provider_address_to_location_finish:
+ * @provider: A #NavigationProvider object
+ * @result: A #GAsyncResult
+ * @error: A #GError for reporting errors
+ *
+ * Finishes an operation started with
+ * navigation_provider_address_to_location_async().
+ *
+ * Return value: A #NavigationLocation to be freed with
+ * navigation_location_free(), or %NULL on error.
+ */
+NavigationLocation *
+navigation_provider_address_to_location_finish (NavigationProvider *provider,
+                                                GAsyncResult       *result,
+                                                GError            **error);
+
+/**
+ * NavigationProviderGetTileBytesCallback:
+ * @provider: A #NavigationProvider
+ * @tile: The encoded tile, or %NULL on failure
+ * @area: Area of returned tile
+ * @userdata: The userdata passed into #navigation_provider_request_tile_bytes
+ *
+ * Type of the callback function for #navigation_provider_request_tile_bytes
+ * which is called whenever @provider has returned a tile.
+ *
+ * Note: Make sure you unref tile and free area after use.
+ */
+typedef void (* NavigationProviderGetTileBytesCallback) (NavigationProvider *provider,
+                                                         GBytes             *tile,
+                                                         NavigationArea     *area,
+                                                         gpointer            userdata);
+
+/**
+ * navigation_provider_request_tile_bytes:
+ * @provider: A #NavigationProvider
+ * @location: Location to render
+ * @zoom: Zoom level, usually something between 0 and 18
+ * @map_width: Requested map bitmap width
+ * @map_height: Requested map bitmap height
+ * @map_options: A combination of NAVIGATION_MAP_* options
+ * @cb: A #NavigationProviderGetTileBytesCallback
+ * @userdata: The data to be passed to @cb
+ * @error: A #GError for reporting errors
+ *
+ * Like navigation_provider_request_pixbuf_from_map(), but hands the tile to
+ * @cb as received from @provider, without decoding it. The preferred encoding
+ * is selected with one of the NAVIGATION_MAP_FORMAT_* options, providers that
+ * do not support it fall back to pixdata. Use navigation_map_tile_decode() to
+ * get a #GdkPixbuf when needed.
+ *
+ * Return value: TRUE on success, FALSE otherwise.
+ */
+gboolean
+navigation_provider_request_tile_bytes (NavigationProvider       *provider,
+                                        const NavigationLocation *location,
+                                        int                       zoom,
+                                        int                       map_width,
+                                        int                       map_height,
+                                        unsigned int              map_options,
+                                        NavigationProviderGetTileBytesCallback cb,
+                                        gpointer                  userdata,
+                                        GError                  **error);
+
+/**
+ * navigation_map_tile_get_format:
+ * @tile: A tile returned by navigation_provider_request_tile_bytes()
+ *
+ * Detects the encoding of @tile from its contents.
+ *
+ * Return value: One of the NAVIGATION_MAP_FORMAT_* values.
+ */
+unsigned int navigation_map_tile_get_format (GBytes *tile);
+
+/**
+ * navigation_map_tile_decode:
+ * @tile: A tile returned by navigation_provider_request_tile_bytes()
+ * @error: A #GError for reporting errors
+ *
+ * Decodes @tile, whatever its encoding.
+ *
+ * Return value: A #GdkPixbuf to be unreferenced after use, or %NULL on error.
+ */
+GdkPixbuf *navigation_map_tile_decode (GBytes *tile, GError **error);
+
+/**
+ * NavigationProviderMapProgressCallback:
+ * @provider: A #NavigationProvider
+ * @pixbuf: The map being composed, owned by the library
+ * @x: Left edge of the updated region
+ * @y: Top edge of the updated region
+ * @width: Width of the updated region
+ * @height: Height of the updated region
+ * @n_done: Number of tiles processed so far
+ * @n_total: Total number of tiles of the map
+ * @userdata: The userdata passed into #navigation_provider_request_map
+ *
+ * Type of the callback function for #navigation_provider_request_map which is
+ * called every time a tile has been drawn into @pixbuf.
+ */
+typedef void (* NavigationProviderMapProgressCallback) (NavigationProvider *provider,
+                                                        GdkPixbuf          *pixbuf,
+                                                        int                 x,
+                                                        int                 y,
+                                                        int                 width,
+                                                        int                 height,
+                                                        guint               n_done,
+                                                        guint               n_total,
+                                                        gpointer            userdata);
+
+/**
+ * NavigationProviderMapCallback:
+ * @provider: A #NavigationProvider
+ * @pixbuf: The composed map, or %NULL on error
+ * @error: A possible error that should be freed after use
+ * @userdata: The userdata passed into #navigation_provider_request_map
+ *
+ * Type of the callback function for #navigation_provider_request_map which is
+ * called once all tiles have been processed.
+ *
+ * Note: Make sure you remove reference to pixbuf after use.
+ */
+typedef void (* NavigationProviderMapCallback) (NavigationProvider *provider,
+                                                GdkPixbuf          *pixbuf,
+                                                GError             *error,
+                                                gpointer            userdata);
+
+/**
+ * navigation_provider_request_map:
+ * @provider: A #NavigationProvider
+ * @map: The #NavigationMap to render
+ * @map_options: A combination of NAVIGATION_MAP_* options
+ * @progress_cb: A #NavigationProviderMapProgressCallback, or %NULL
+ * @cb: A #NavigationProviderMapCallback
+ * @userdata: The data to be passed to @progress_cb and @cb
+ * @error: A #GError for reporting errors
+ *
+ * Renders @map into a single #GdkPixbuf of @map->px_width x @map->px_height
+ * pixels. The area is split into tiles that are fetched from @provider a few
+ * at a time, recently fetched tiles are reused. Areas @provider has no tiles
+ * for are left transparent.
+ *
+ * Return value: TRUE on success, FALSE otherwise.
+ */
+gboolean
+navigation_provider_request_map (NavigationProvider                   *provider,
+                                 const NavigationMap                  *map,
+                                 unsigned int                          map_options,
+                                 NavigationProviderMapProgressCallback progress_cb,
+                                 NavigationProviderMapCallback         cb,
+                                 gpointer                              userdata,
+                                 GError                              **error);
+
+/**
+ * navigation_provider_request_pixbuf_async:
+ * @provider: A #NavigationProvider
+ * @location: Location to render
+ * @zoom: Zoom level, usually something between 0 and 18
+ * @map_width: Requested map bitmap width
+ * @map_height: Requested map bitmap height
+ * @map_options: A combination of NAVIGATION_MAP_* options
+ * @io_priority: The I/O priority of the request
+ * @cancellable: Optional #GCancellable object, %NULL to ignore
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: The data to pass to @callback
+ *
+ * Asynchronous version of navigation_provider_request_pixbuf_from_map(). You
+ * can call navigation_provider_request_pixbuf_finish() from @callback to get
+ * the result.
+ */
+void
+navigation_provider_request_pixbuf_async (NavigationProvider       *provider,
+                                          const NavigationLocation *location,
+                                          int                       zoom,
+                                          int                       map_width,
+                                          int                       map_height,
+                                          unsigned int              map_options,
+                                          int                       io_priority,
+                                          GCancellable             *cancellable,
+                                          GAsyncReadyCallback       callback,
+                                          gpointer                  user_data);
+
+/**
+ * navigation_provider_request_pixbuf_finish:
+ * @provider: A #NavigationProvider
+ * @result: A #GAsyncResult
+ * @area: Return location for the area of the returned pixbuf, or %NULL
+ * @error: A #GError for reporting errors
+ *
+ * Finishes an operation started with navigation_provider_request_pixbuf_async().
+ *
+ * Return value: A #GdkPixbuf to be unreferenced after use, or %NULL on error.
+ */
+GdkPixbuf *
+navigation_provider_request_pixbuf_finish (NavigationProvider *provider,
+                                           GAsyncResult       *result,
+                                           NavigationArea     *area,
+                                           GError            **error);
+
+/**
+ * navigation_provider_get_poi_categories_async:
+ * @provider: A #NavigationProvider
+ * @io_priority: The I/O priority of the request
+ * @cancellable: Optional #GCancellable object, %NULL to ignore
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: The data to pass to @callback
+ *
+ * Asynchronous version of navigation_provider_get_poi_categories(). You can
+ * call navigation_provider_get_poi_categories_finish() from @callback to get
+ * the result.
+ */
+void
+navigation_provider_get_poi_categories_async (NavigationProvider *provider,
+                                              int                 io_priority,
+                                              GCancellable       *cancellable,
+                                              GAsyncReadyCallback callback,
+                                              gpointer            user_data);
+
+/**
+ * navigation_provider_get_poi_categories_finish:
+ * @provider: A #NavigationProvider
+ * @result: A #GAsyncResult
+ * @error: A #GError for reporting errors
+ *
+ * Finishes an operation started with
+ * navigation_provider_get_poi_categories_async().
+ *
+ * Return value: A %NULL-terminated array of categories to be freed with
+ * g_strfreev(), or %NULL on error.
+ */
+char **
+navigation_provider_get_poi_categories_finish (NavigationProvider *provider,
+                                               GAsyncResult       *result,
+                                               GError            **error);
+
+/**
+ * navigation_provider_get_route_async:
+ * @provider: A #NavigationProvider
+ * @from: A #NavigationLocation representing the start of the route
+ * @to: A #NavigationLocation representing the end of the route
+ * @route_options: A combination of NAVIGATION_ROUTE_*, NAVIGATION_MODE_* and
+ * NAVIGATION_ALLOW_* options
+ * @io_priority: The I/O priority of the request
+ * @cancellable: Optional #GCancellable object, %NULL to ignore
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: The data to pass to @callback
+ *
+ * Asynchronous version of navigation_provider_get_route(). You can call
+ * navigation_provider_get_route_finish() from @callback to get the result.
+ */
+void
+navigation_provider_get_route_async (NavigationProvider       *provider,
+                                     const NavigationLocation *from,
+                                     const NavigationLocation *to,
+                                     unsigned int              route_options,
+                                     int                       io_priority,
+                                     GCancellable             *cancellable,
+                                     GAsyncReadyCallback       callback,
+                                     gpointer                  user_data);
+
+/**
+ * navigation_provider_get_route_finish:
+ * @provider: A #NavigationProvider
+ * @result: A #GAsyncResult
+ * @error: A #GError for reporting errors
+ *
+ * Finishes an operation started with navigation_provider_get_route_async().
+ *
+ * Return value: A #NavigationRoute to be freed with navigation_route_free(),
+ * or %NULL on error.
+ */
+NavigationRoute *
+navigation_provider_get_route_finish (NavigationProvider *provider,
+                                      GAsyncResult       *result,
+                                      GError            **error);
+
+/**
+ * navigation_priority_push_thread_default:
+ * @priority: A #NavigationPriority
+ *
+ * Makes @priority the class of requests issued from the calling thread until
+ * the matching navigation_priority_pop_thread_default(). Calls can be
+ * nested. The _async functions take the class from their io_priority
+ * instead, see navigation_priority_from_io_priority().
+ */
+void navigation_priority_push_thread_default (NavigationPriority priority);
+
+/**
+ * navigation_priority_pop_thread_default:
+ *
+ * Restores the class in effect before the last
+ * navigation_priority_push_thread_default() of the calling thread.
+ */
+void navigation_priority_pop_thread_default (void);
+
+/**
+ * navigation_priority_get_thread_default:
+ *
+ * Gets the class of requests issued from the calling thread.
+ *
+ * Return value: The #NavigationPriority last pushed by the calling thread, or
+ * %NAVIGATION_PRIORITY_NORMAL.
+ */
+NavigationPriority navigation_priority_get_thread_default (void);
+
+/**
+ * navigation_priority_from_io_priority:
+ * @io_priority: An I/O priority like %G_PRIORITY_DEFAULT
+ *
+ * Maps an I/O priority to a request class: priorities more urgent than
+ * %G_PRIORITY_DEFAULT are interactive, less urgent ones background.
+ *
+ * Return value: A #NavigationPriority.
+ */
+NavigationPriority navigation_priority_from_io_priority (int io_priority);
+
+/**
+ * navigation_provider_get_priority_stats:
+ * @provider: A #NavigationProvider
+ * @priority: A #NavigationPriority
+ * @stats: Return location for the statistics of @priority
+ *
+ * Gets how long requests of class @priority waited for a free slot.
+ */
+void navigation_provider_get_priority_stats (NavigationProvider      *provider,
+                                             NavigationPriority       priority,
+                                             NavigationPriorityStats *stats);
+
+/**
+ * navigation_provider_enable_hedging:
+ * @provider: A #NavigationProvider
+ * @service: The D-Bus service of the secondary provider, or %NULL for the
+ * first other one navigation_provider_list_all() finds
+ * @error: Return location for a #GError, or %NULL
+ *
+ * Hedges the reverse geocoding requests of @provider: a request the provider
+ * did not answer within the 95th percentile of its recent latencies, or
+ * failed, is sent to the secondary provider as well. The first address
+ * returned is passed to the callback and the other request is cancelled.
+ * Until enough latencies are known, requests are hedged after a second.
+ *
+ * Return value: TRUE on success, FALSE otherwise.
+ */
+gboolean navigation_provider_enable_hedging (NavigationProvider *provider,
+                                             const char         *service,
+                                             GError            **error);
+
+/**
+ * navigation_provider_disable_hedging:
+ * @provider: A #NavigationProvider
+ *
+ * Stops hedging new requests of @provider, requests in flight are not
+ * affected.
+ */
+void navigation_provider_disable_hedging (NavigationProvider *provider);
+
+/**
+ * navigation_provider_get_hedge_stats:
+ * @provider: A #NavigationProvider
+ * @stats: Return location for the statistics
+ *
+ * Gets how often requests of @provider were hedged and who won.
+ */
+void navigation_provider_get_hedge_stats (NavigationProvider   *provider,
+                                          NavigationHedgeStats *stats);
+
+/**
+ * navigation_provider_get_health:
+ * @provider: A #NavigationProvider
+ * @health: Return location for the health of the service
+ *
+ * Gets the health of the service of @provider. With hedging enabled, reverse
+ * geocoding fails over to the secondary provider while the circuit of the
+ * primary is open, see navigation_provider_enable_hedging().
+ *
+ * Return value: TRUE on success, FALSE if the service is not known yet.
+ */
+gboolean navigation_provider_get_health (NavigationProvider      *provider,
+                                         NavigationServiceHealth *health);
+
 G_END_DECLS
 
 #endif
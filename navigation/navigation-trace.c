@@ -0,0 +1,333 @@
+/*
+ * navigation-trace.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "navigation-trace.h"
+
+G_STATIC_ASSERT(sizeof(NavigationTraceHeader) == 16);
+G_STATIC_ASSERT(sizeof(NavigationTraceRecord) == 16);
+
+struct _NavigationTrace
+{
+  GMutex lock;
+  FILE *file;
+  gint64 started;
+};
+
+NavigationTrace *
+navigation_trace_new(const char *path, GError **error)
+{
+  NavigationTrace *trace;
+  NavigationTraceHeader header;
+  FILE *file = g_fopen(path, "wb");
+
+  if (!file)
+  {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Unable to create %s: %s", path, g_strerror(errno));
+    return NULL;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NAVIGATION_TRACE_MAGIC, sizeof(header.magic));
+  header.version = GUINT32_TO_LE(NAVIGATION_TRACE_VERSION);
+
+  if (fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Unable to write %s: %s", path, g_strerror(errno));
+    fclose(file);
+
+    return NULL;
+  }
+
+  trace = g_new0(NavigationTrace, 1);
+  g_mutex_init(&trace->lock);
+  trace->file = file;
+  trace->started = g_get_monotonic_time();
+
+  return trace;
+}
+
+void
+navigation_trace_free(NavigationTrace *trace)
+{
+  if (trace)
+  {
+    fclose(trace->file);
+    g_mutex_clear(&trace->lock);
+    g_free(trace);
+  }
+}
+
+static void
+add_record(NavigationTrace *trace, NavigationTraceType type,
+           const void *payload, gsize size)
+{
+  NavigationTraceRecord record;
+
+  memset(&record, 0, sizeof(record));
+  record.size = GUINT32_TO_LE(size);
+  record.type = type;
+
+  g_mutex_lock(&trace->lock);
+
+  /* stamped under the lock, so records are in time order */
+  record.time = GINT64_TO_LE(g_get_monotonic_time() - trace->started);
+
+  if (fwrite(&record, sizeof(record), 1, trace->file) != 1 ||
+      fwrite(payload, 1, size, trace->file) != size)
+  {
+    g_warning("Unable to write trace: %s", g_strerror(errno));
+  }
+
+  g_mutex_unlock(&trace->lock);
+}
+
+void
+navigation_trace_add_request(NavigationTrace *trace, const char *service,
+                             const char *method, const char *object_path,
+                             GVariant *args)
+{
+  GString *payload = g_string_new(service);
+  GVariant *normal;
+
+  g_return_if_fail(trace != NULL);
+
+  if (!args)
+    args = g_variant_new("()");
+
+  g_variant_ref_sink(args);
+  normal = g_variant_get_normal_form(args);
+
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+  {
+    GVariant *swapped = g_variant_byteswap(normal);
+
+    g_variant_unref(normal);
+    normal = swapped;
+  }
+
+  g_string_append_len(payload, "", 1);
+  g_string_append(payload, method);
+  g_string_append_len(payload, "", 1);
+  g_string_append(payload, object_path);
+  g_string_append_len(payload, "", 1);
+  g_string_append(payload, g_variant_get_type_string(normal));
+  g_string_append_len(payload, "", 1);
+  g_string_append_len(payload, g_variant_get_data(normal),
+                      g_variant_get_size(normal));
+
+  add_record(trace, NAVIGATION_TRACE_REQUEST, payload->str, payload->len);
+
+  g_variant_unref(normal);
+  g_variant_unref(args);
+  g_string_free(payload, TRUE);
+}
+
+void
+navigation_trace_add_reply(NavigationTrace *trace, const char *service,
+                           DBusMessage *message)
+{
+  GString *payload;
+  char *data;
+  int len;
+
+  g_return_if_fail(trace != NULL);
+
+  if (!dbus_message_marshal(message, &data, &len))
+    return;
+
+  payload = g_string_sized_new(strlen(service) + 1 + len);
+  g_string_append_len(payload, service, strlen(service) + 1);
+  g_string_append_len(payload, data, len);
+  add_record(trace, NAVIGATION_TRACE_REPLY, payload->str, payload->len);
+
+  g_string_free(payload, TRUE);
+  dbus_free(data);
+}
+
+static const gchar *
+get_string(const gchar **p, const gchar *end)
+{
+  const gchar *s = *p;
+  gsize len;
+
+  if (s >= end || (len = strnlen(s, end - s)) == (gsize)(end - s))
+    return NULL;
+
+  *p = s + len + 1;
+
+  return s;
+}
+
+static NavigationTraceEvent *
+parse_request(const gchar *data, gsize size)
+{
+  const gchar *end = data + size;
+  const gchar *service = get_string(&data, end);
+  const gchar *method = get_string(&data, end);
+  const gchar *object_path = get_string(&data, end);
+  const gchar *type = get_string(&data, end);
+  NavigationTraceEvent *event;
+  GBytes *bytes;
+  GVariant *args;
+
+  if (!type || !g_variant_type_string_is_valid(type))
+    return NULL;
+
+  bytes = g_bytes_new(data, end - data);
+  args = g_variant_new_from_bytes(G_VARIANT_TYPE(type), bytes, FALSE);
+  g_bytes_unref(bytes);
+
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+  {
+    GVariant *swapped = g_variant_byteswap(args);
+
+    g_variant_unref(args);
+    args = swapped;
+  }
+
+  event = g_new0(NavigationTraceEvent, 1);
+  event->type = NAVIGATION_TRACE_REQUEST;
+  event->service = g_strdup(service);
+  event->method = g_strdup(method);
+  event->object_path = g_strdup(object_path);
+  event->args = g_variant_ref_sink(args);
+
+  return event;
+}
+
+static NavigationTraceEvent *
+parse_reply(const gchar *data, gsize size)
+{
+  const gchar *end = data + size;
+  const gchar *service = get_string(&data, end);
+  NavigationTraceEvent *event;
+  DBusMessage *message;
+
+  if (!service ||
+      !(message = dbus_message_demarshal(data, end - data, NULL)))
+  {
+    return NULL;
+  }
+
+  event = g_new0(NavigationTraceEvent, 1);
+  event->type = NAVIGATION_TRACE_REPLY;
+  event->service = g_strdup(service);
+  event->message = message;
+
+  return event;
+}
+
+GPtrArray *
+navigation_trace_load(const char *path, GError **error)
+{
+  GMappedFile *file = g_mapped_file_new(path, FALSE, error);
+  GPtrArray *events;
+  NavigationTraceHeader header;
+  const gchar *data;
+  gsize len;
+  gsize offset = sizeof(header);
+
+  if (!file)
+    return NULL;
+
+  data = g_mapped_file_get_contents(file);
+  len = g_mapped_file_get_length(file);
+
+  if (len >= sizeof(header))
+    memcpy(&header, data, sizeof(header));
+
+  if (len < sizeof(header) ||
+      memcmp(header.magic, NAVIGATION_TRACE_MAGIC, sizeof(header.magic)) ||
+      GUINT32_FROM_LE(header.version) != NAVIGATION_TRACE_VERSION)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not a trace of version %d", path,
+                NAVIGATION_TRACE_VERSION);
+    g_mapped_file_unref(file);
+
+    return NULL;
+  }
+
+  events = g_ptr_array_new_with_free_func(
+      (GDestroyNotify)navigation_trace_event_free);
+
+  while (len - offset >= sizeof(NavigationTraceRecord))
+  {
+    NavigationTraceRecord record;
+    NavigationTraceEvent *event = NULL;
+    const gchar *payload = data + offset + sizeof(record);
+    gsize size;
+
+    memcpy(&record, data + offset, sizeof(record));
+    size = GUINT32_FROM_LE(record.size);
+
+    if (size > len - offset - sizeof(record))
+      break;
+
+    if (record.type == NAVIGATION_TRACE_REQUEST)
+      event = parse_request(payload, size);
+    else if (record.type == NAVIGATION_TRACE_REPLY)
+      event = parse_reply(payload, size);
+
+    if (event)
+    {
+      event->time = GINT64_FROM_LE(record.time);
+      g_ptr_array_add(events, event);
+    }
+    else
+      g_warning("%s: skipping malformed record at %" G_GSIZE_FORMAT, path,
+                offset);
+
+    offset += sizeof(record) + size;
+  }
+
+  g_mapped_file_unref(file);
+
+  return events;
+}
+
+void
+navigation_trace_event_free(NavigationTraceEvent *event)
+{
+  if (event)
+  {
+    g_free(event->service);
+    g_free(event->method);
+    g_free(event->object_path);
+
+    if (event->args)
+      g_variant_unref(event->args);
+
+    if (event->message)
+      dbus_message_unref(event->message);
+
+    g_free(event);
+  }
+}
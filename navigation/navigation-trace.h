@@ -0,0 +1,109 @@
+/*
+ * navigation-trace.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __NAVIGATION_TRACE_H__
+#define __NAVIGATION_TRACE_H__
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Layout of a trace of the traffic between providers and their service, with
+ * all integers little endian:
+ *
+ *   NavigationTraceHeader
+ *   NavigationTraceRecord followed by size bytes of payload, repeated
+ *
+ * The payload of a request is the service it was sent to, the method, the
+ * object path the service replied with and the GVariant type of the
+ * arguments, all NUL terminated, followed by the arguments serialized in
+ * little endian. The payload of a reply is the service it was received from,
+ * NUL terminated, followed by the signal as marshalled by
+ * dbus_message_marshal(). Requests and replies of several services, as with
+ * hedging, are told apart by the service. A trace ends at the first record
+ * that is cut short.
+ */
+
+#define NAVIGATION_TRACE_MAGIC "NAVTRACE"
+#define NAVIGATION_TRACE_VERSION 2
+
+typedef enum {
+	NAVIGATION_TRACE_REQUEST,
+	NAVIGATION_TRACE_REPLY
+} NavigationTraceType;
+
+typedef struct _NavigationTraceHeader {
+	char    magic[8];
+	guint32 version;
+	guint32 reserved;
+} NavigationTraceHeader;
+
+typedef struct _NavigationTraceRecord {
+	guint32 size;
+	guint8  type;
+	guint8  reserved[3];
+	/* microseconds since the trace was started */
+	gint64  time;
+} NavigationTraceRecord;
+
+typedef struct _NavigationTraceEvent {
+	NavigationTraceType type;
+	gint64              time;
+	gchar              *service;
+	/* requests only */
+	gchar              *method;
+	gchar              *object_path;
+	GVariant           *args;
+	/* replies only */
+	DBusMessage        *message;
+} NavigationTraceEvent;
+
+typedef struct _NavigationTrace NavigationTrace;
+
+G_GNUC_INTERNAL
+NavigationTrace *navigation_trace_new (const char *path,
+                                       GError    **error);
+
+G_GNUC_INTERNAL
+void navigation_trace_free (NavigationTrace *trace);
+
+G_GNUC_INTERNAL
+void navigation_trace_add_request (NavigationTrace *trace,
+                                   const char      *service,
+                                   const char      *method,
+                                   const char      *object_path,
+                                   GVariant        *args);
+
+G_GNUC_INTERNAL
+void navigation_trace_add_reply (NavigationTrace *trace,
+                                 const char      *service,
+                                 DBusMessage     *message);
+
+G_GNUC_INTERNAL
+GPtrArray *navigation_trace_load (const char *path,
+                                  GError    **error);
+
+G_GNUC_INTERNAL
+void navigation_trace_event_free (NavigationTraceEvent *event);
+
+G_END_DECLS
+
+#endif
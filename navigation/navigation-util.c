@@ -0,0 +1,78 @@
+/*
+ * navigation-util.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "navigation-util.h"
+
+/* 7 bits per byte, least significant group first, with the high bit set on
+ * all but the last byte */
+void
+navigation_put_varint(GByteArray *array, guint32 v)
+{
+  guint8 buf[5];
+  guint len = 0;
+
+  while (v >= 0x80)
+  {
+    buf[len++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+
+  buf[len++] = v;
+  g_byte_array_append(array, buf, len);
+}
+
+/* Splits a line of comma separated fields, which may be quoted with "" for a
+ * literal quote. Returns a NULL terminated array of the unquoted fields. */
+gchar **
+navigation_split_csv_line(const gchar *line)
+{
+  GPtrArray *fields = g_ptr_array_new();
+  GString *field = g_string_new(NULL);
+  gboolean quoted = FALSE;
+  const gchar *p;
+
+  for (p = line; *p; p++)
+  {
+    if (quoted)
+    {
+      if (*p != '"')
+        g_string_append_c(field, *p);
+      else if (p[1] == '"')
+        g_string_append_c(field, *p++);
+      else
+        quoted = FALSE;
+    }
+    else if (*p == '"')
+      quoted = TRUE;
+    else if (*p == ',')
+    {
+      g_ptr_array_add(fields, g_string_free(field, FALSE));
+      field = g_string_new(NULL);
+    }
+    else if (*p != '\r' && *p != '\n')
+      g_string_append_c(field, *p);
+  }
+
+  g_ptr_array_add(fields, g_string_free(field, FALSE));
+  g_ptr_array_add(fields, NULL);
+
+  return (gchar **)g_ptr_array_free(fields, FALSE);
+}
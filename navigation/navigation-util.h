@@ -0,0 +1,46 @@
+/*
+ * navigation-util.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __NAVIGATION_UTIL_H__
+#define __NAVIGATION_UTIL_H__
+
+#include <glib.h>
+
+#include "navigation-provider-enums.h"
+
+G_BEGIN_DECLS
+
+/* Helpers shared by the library and the tools, not part of the API. */
+
+/* address_to_array() fields up to the time zone, the rest are reserved */
+#define NAVIGATION_N_ADDRESS_FIELDS (NAVIGATION_ADDRESS_FIELD_TIME_ZONE + 1)
+
+/* the web mercator grid ends where it is as high as wide */
+#define NAVIGATION_MAX_LATITUDE 85.05112878
+
+G_GNUC_INTERNAL
+void navigation_put_varint (GByteArray *array,
+                            guint32     v);
+
+G_GNUC_INTERNAL
+gchar **navigation_split_csv_line (const gchar *line);
+
+G_END_DECLS
+
+#endif
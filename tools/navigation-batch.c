@@ -0,0 +1,957 @@
+/*
+ * navigation-batch.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Geocodes rows read from stdin with the default navigation service and
+ * writes the results to stdout, in the order of the input. In CSV, a row to
+ * reverse geocode holds
+ *
+ *   latitude,longitude
+ *
+ * and a row to geocode holds
+ *
+ *   house number,house name,street,suburb,town,municipality,province,
+ *   postal code,country,country code,time zone
+ *
+ * Results are written as latitude, longitude and the address fields, the
+ * format navigation-compile-dataset reads, with empty fields for what was not
+ * found. Empty lines and lines starting with # are ignored. In NDJSON, every
+ * line is an object with the latitude and longitude members, or with members
+ * named like the #NavigationAddress fields, results are objects of the same
+ * kind with an error member added for failed rows. Rows the library has no
+ * room for in its request queue wait until earlier ones are answered, so -j
+ * may exceed what the library keeps in flight.
+ *
+ * With a checkpoint file, the number of input lines whose results were
+ * written is saved there every 1000 rows and at the end, a later run with the
+ * same file skips those lines. Its output is meant to be appended to that of
+ * the earlier run. If the earlier run did not finish, its output may already
+ * hold up to 999 of the rows after the last checkpoint, which are then
+ * written again.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "navigation-provider.h"
+#include "navigation-util.h"
+
+/* rows written between checkpoints */
+#define CHECKPOINT_INTERVAL 1000
+
+/* NDJSON member names, in address_to_array() order */
+static const gchar *address_members[NAVIGATION_N_ADDRESS_FIELDS] =
+{
+  "house_num",
+  "house_name",
+  "street",
+  "suburb",
+  "town",
+  "municipality",
+  "province",
+  "postal_code",
+  "country",
+  "country_code",
+  "time_zone"
+};
+
+struct _BatchRow
+{
+  /* input line the row was read from */
+  gsize line;
+  gint64 started;
+  /* the formatted result, once there is one */
+  gchar *output;
+};
+
+typedef struct _BatchRow BatchRow;
+
+struct _BatchContext
+{
+  NavigationProvider *provider;
+  GMainLoop *loop;
+  GIOChannel *input;
+  gboolean eof;
+  gboolean pumping;
+  /* reorder buffer, row n is kept in rows[n % in_flight] */
+  BatchRow *rows;
+  /* requests the provider has not answered yet */
+  guint n_sent;
+  /* BatchRequest the provider had no room for, sent again in order as
+   * others are answered */
+  GQueue waiting;
+  guint64 n_read;
+  guint64 n_written;
+  guint64 n_failed;
+  guint64 n_not_found;
+  gsize line;
+  gsize skip_lines;
+  GArray *latencies;
+  gint64 started;
+};
+
+typedef struct _BatchContext BatchContext;
+
+struct _BatchRequest
+{
+  BatchContext *ctx;
+  guint64 row;
+  NavigationLocation location;
+  NavigationAddress *address;
+};
+
+typedef struct _BatchRequest BatchRequest;
+
+static gboolean reverse = FALSE;
+static gchar *format = NULL;
+static gint in_flight = 16;
+static gchar *checkpoint = NULL;
+
+static GOptionEntry entries[] =
+{
+  {
+    "reverse", 'r', 0, G_OPTION_ARG_NONE, &reverse,
+    "Convert locations to addresses instead of addresses to locations", NULL
+  },
+  {
+    "format", 'f', 0, G_OPTION_ARG_STRING, &format,
+    "Read and write csv or ndjson (default csv)", "FORMAT"
+  },
+  {
+    "in-flight", 'j', 0, G_OPTION_ARG_INT, &in_flight,
+    "Number of requests sent at a time (default 16)", "N"
+  },
+  {
+    "checkpoint", 'c', 0, G_OPTION_ARG_FILENAME, &checkpoint,
+    "Resume from and save progress to FILE", "FILE"
+  },
+  { NULL }
+};
+
+static gboolean
+is_ndjson()
+{
+  return !g_strcmp0(format, "ndjson");
+}
+
+static const gchar *
+skip_space(const gchar *p)
+{
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    p++;
+
+  return p;
+}
+
+static gboolean
+parse_json_string(const gchar **p, GString *s)
+{
+  const gchar *q = *p + 1;
+
+  while (*q != '"')
+  {
+    if (!*q || (guchar)*q < 0x20)
+      return FALSE;
+
+    if (*q != '\\')
+    {
+      g_string_append_c(s, *q++);
+      continue;
+    }
+
+    switch (*++q)
+    {
+      case '"':
+      case '\\':
+      case '/':
+      {
+        g_string_append_c(s, *q);
+        break;
+      }
+      case 'b':
+      {
+        g_string_append_c(s, '\b');
+        break;
+      }
+      case 'f':
+      {
+        g_string_append_c(s, '\f');
+        break;
+      }
+      case 'n':
+      {
+        g_string_append_c(s, '\n');
+        break;
+      }
+      case 'r':
+      {
+        g_string_append_c(s, '\r');
+        break;
+      }
+      case 't':
+      {
+        g_string_append_c(s, '\t');
+        break;
+      }
+      case 'u':
+      {
+        gunichar c = 0;
+        int i;
+
+        for (i = 1; i <= 4; i++)
+        {
+          if (!g_ascii_isxdigit(q[i]))
+            return FALSE;
+
+          c = c << 4 | g_ascii_xdigit_value(q[i]);
+        }
+
+        q += 4;
+
+        /* a surrogate pair */
+        if (c >= 0xd800 && c < 0xdc00 && q[1] == '\\' && q[2] == 'u')
+        {
+          gunichar low = 0;
+
+          for (i = 3; i <= 6; i++)
+          {
+            if (!g_ascii_isxdigit(q[i]))
+              return FALSE;
+
+            low = low << 4 | g_ascii_xdigit_value(q[i]);
+          }
+
+          if (low >= 0xdc00 && low < 0xe000)
+          {
+            c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            q += 6;
+          }
+        }
+
+        if (!c || (c >= 0xd800 && c < 0xe000))
+          return FALSE;
+
+        g_string_append_unichar(s, c);
+        break;
+      }
+      default:
+        return FALSE;
+    }
+
+    q++;
+  }
+
+  *p = q + 1;
+
+  return TRUE;
+}
+
+/* Parses a single line JSON object whose members are all strings, numbers,
+ * booleans or null. Returns the members as text, null ones are left out. */
+static GHashTable *
+parse_json_object(const gchar *line)
+{
+  GHashTable *members = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, g_free);
+  const gchar *p = skip_space(line);
+
+  if (*p++ != '{')
+    goto fail;
+
+  p = skip_space(p);
+
+  if (*p == '}')
+    p++;
+  else
+  {
+    while (TRUE)
+    {
+      GString *key = g_string_new(NULL);
+      GString *value = g_string_new(NULL);
+
+      if (*p != '"' || !parse_json_string(&p, key))
+        goto fail_member;
+
+      p = skip_space(p);
+
+      if (*p++ != ':')
+        goto fail_member;
+
+      p = skip_space(p);
+
+      if (*p == '"')
+      {
+        if (!parse_json_string(&p, value))
+          goto fail_member;
+      }
+      else
+      {
+        const gchar *end = p;
+
+        while (g_ascii_isalnum(*end) || *end == '-' || *end == '+' ||
+               *end == '.')
+        {
+          end++;
+        }
+
+        if (end == p)
+          goto fail_member;
+
+        g_string_append_len(value, p, end - p);
+        p = end;
+      }
+
+      if (strcmp(value->str, "null"))
+      {
+        g_hash_table_replace(members, g_string_free(key, FALSE),
+                             g_string_free(value, FALSE));
+      }
+      else
+      {
+        g_string_free(key, TRUE);
+        g_string_free(value, TRUE);
+      }
+
+      p = skip_space(p);
+
+      if (*p == '}')
+      {
+        p++;
+        break;
+      }
+
+      if (*p++ != ',')
+        goto fail;
+
+      p = skip_space(p);
+      continue;
+
+fail_member:
+      g_string_free(key, TRUE);
+      g_string_free(value, TRUE);
+      goto fail;
+    }
+  }
+
+  if (!*skip_space(p))
+    return members;
+
+fail:
+  g_hash_table_destroy(members);
+
+  return NULL;
+}
+
+static gboolean
+parse_coordinate(const gchar *s, double limit, double *v)
+{
+  gchar *end;
+
+  if (!s)
+    return FALSE;
+
+  *v = g_ascii_strtod(s, &end);
+
+  return end != s && !*end && fabs(*v) <= limit;
+}
+
+static gchar **
+address_fields(const NavigationAddress *address)
+{
+  gchar **array = address_to_array(address);
+  int i;
+
+  /* the reserved fields are not written */
+  for (i = NAVIGATION_N_ADDRESS_FIELDS; array[i]; i++)
+    g_clear_pointer(&array[i], g_free);
+
+  return array;
+}
+
+static NavigationAddress *
+address_from_fields(const gchar * const *fields)
+{
+  NavigationAddress *address = g_new0(NavigationAddress, 1);
+  gchar **p[NAVIGATION_N_ADDRESS_FIELDS] =
+  {
+    &address->house_num, &address->house_name, &address->street,
+    &address->suburb, &address->town, &address->municipality,
+    &address->province, &address->postal_code, &address->country,
+    &address->country_code, &address->time_zone
+  };
+  int i;
+
+  for (i = 0; i < NAVIGATION_N_ADDRESS_FIELDS; i++)
+  {
+    if (fields[i] && *fields[i])
+      *p[i] = g_strdup(fields[i]);
+  }
+
+  return address;
+}
+
+/* Parses an input line into a location to reverse geocode or an address to
+ * geocode. */
+static gboolean
+parse_row(const gchar *line, NavigationLocation *location,
+          NavigationAddress **address)
+{
+  const gchar *fields[NAVIGATION_N_ADDRESS_FIELDS] = { NULL };
+  GHashTable *members = NULL;
+  gchar **columns = NULL;
+  gboolean rv = FALSE;
+  int i;
+
+  if (is_ndjson())
+  {
+    if (!(members = parse_json_object(line)))
+      return FALSE;
+
+    if (reverse)
+    {
+      rv = parse_coordinate(g_hash_table_lookup(members, "latitude"), 90.0,
+                            &location->latitude) &&
+        parse_coordinate(g_hash_table_lookup(members, "longitude"), 180.0,
+                         &location->longitude);
+    }
+    else
+    {
+      for (i = 0; i < NAVIGATION_N_ADDRESS_FIELDS; i++)
+        fields[i] = g_hash_table_lookup(members, address_members[i]);
+
+      *address = address_from_fields(fields);
+      rv = TRUE;
+    }
+
+    g_hash_table_destroy(members);
+  }
+  else
+  {
+    columns = navigation_split_csv_line(line);
+
+    if (reverse)
+    {
+      rv = g_strv_length(columns) == 2 &&
+        parse_coordinate(columns[0], 90.0, &location->latitude) &&
+        parse_coordinate(columns[1], 180.0, &location->longitude);
+    }
+    else if (g_strv_length(columns) == NAVIGATION_N_ADDRESS_FIELDS)
+    {
+      *address = address_from_fields((const gchar * const *)columns);
+      rv = TRUE;
+    }
+
+    g_strfreev(columns);
+  }
+
+  return rv;
+}
+
+static void
+append_csv_field(GString *s, const gchar *field)
+{
+  if (!field[strcspn(field, ",\"\r\n")])
+  {
+    g_string_append(s, field);
+    return;
+  }
+
+  g_string_append_c(s, '"');
+
+  for (; *field; field++)
+  {
+    if (*field == '"')
+      g_string_append_c(s, '"');
+
+    g_string_append_c(s, *field);
+  }
+
+  g_string_append_c(s, '"');
+}
+
+static void
+append_json_string(GString *s, const gchar *str)
+{
+  g_string_append_c(s, '"');
+
+  for (; *str; str++)
+  {
+    if (*str == '"' || *str == '\\')
+      g_string_append_printf(s, "\\%c", *str);
+    else if ((guchar)*str < 0x20)
+      g_string_append_printf(s, "\\u%04x", (guchar)*str);
+    else
+      g_string_append_c(s, *str);
+  }
+
+  g_string_append_c(s, '"');
+}
+
+/* Formats the result of a row, location and address are NULL for what is
+ * not known. */
+static gchar *
+format_row(const NavigationLocation *location,
+           const NavigationAddress *address, const GError *error)
+{
+  GString *s = g_string_new(NULL);
+  gchar lat[G_ASCII_DTOSTR_BUF_SIZE] = "";
+  gchar lon[G_ASCII_DTOSTR_BUF_SIZE] = "";
+  NavigationAddress empty = { NULL };
+  gchar **fields = address_fields(address ? address : &empty);
+  int i;
+
+  if (location)
+  {
+    g_ascii_dtostr(lat, sizeof(lat), location->latitude);
+    g_ascii_dtostr(lon, sizeof(lon), location->longitude);
+  }
+
+  if (is_ndjson())
+  {
+    g_string_append_c(s, '{');
+
+    if (location)
+    {
+      g_string_append_printf(s, "\"latitude\":%s,\"longitude\":%s", lat,
+                             lon);
+    }
+    else
+      g_string_append(s, "\"latitude\":null,\"longitude\":null");
+
+    for (i = 0; i < NAVIGATION_N_ADDRESS_FIELDS; i++)
+    {
+      if (*fields[i])
+      {
+        g_string_append_printf(s, ",\"%s\":", address_members[i]);
+        append_json_string(s, fields[i]);
+      }
+    }
+
+    if (error)
+    {
+      g_string_append(s, ",\"error\":");
+      append_json_string(s, error->message);
+    }
+
+    g_string_append(s, "}\n");
+  }
+  else
+  {
+    g_string_append_printf(s, "%s,%s", lat, lon);
+
+    for (i = 0; i < NAVIGATION_N_ADDRESS_FIELDS; i++)
+    {
+      g_string_append_c(s, ',');
+      append_csv_field(s, fields[i]);
+    }
+
+    g_string_append_c(s, '\n');
+  }
+
+  g_strfreev(fields);
+
+  return g_string_free(s, FALSE);
+}
+
+static void
+save_checkpoint(gsize line)
+{
+  GError *error = NULL;
+  gchar *contents;
+
+  /* the results must be on disk before the checkpoint passes them */
+  fflush(stdout);
+  fsync(fileno(stdout));
+
+  contents = g_strdup_printf("%" G_GSIZE_FORMAT "\n", line);
+
+  if (!g_file_set_contents(checkpoint, contents, -1, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(contents);
+}
+
+static void pump(BatchContext *ctx);
+static void send_request(BatchRequest *request);
+
+static void
+complete_row(BatchContext *ctx, guint64 n, gchar *output)
+{
+  BatchRow *row = &ctx->rows[n % in_flight];
+  gint64 latency = g_get_monotonic_time() - row->started;
+  BatchRequest *waiting;
+
+  g_array_append_val(ctx->latencies, latency);
+  row->output = output;
+
+  /* a reply makes room for one of the held back requests */
+  if ((waiting = g_queue_pop_head(&ctx->waiting)))
+    send_request(waiting);
+
+  pump(ctx);
+}
+
+/* Holds request back if the provider queue was full and other requests are
+ * still to be answered, it is sent again once one of them is. */
+static gboolean
+hold_back(BatchRequest *request, GError *error)
+{
+  BatchContext *ctx = request->ctx;
+
+  ctx->n_sent--;
+
+  if (!ctx->n_sent ||
+      !g_error_matches(error, NAVIGATION_ERROR,
+                       NAVIGATION_ERROR_TOO_MANY_REQUESTS))
+  {
+    return FALSE;
+  }
+
+  g_queue_push_tail(&ctx->waiting, request);
+  g_error_free(error);
+
+  return TRUE;
+}
+
+static void
+location_to_address_cb(NavigationProvider *provider,
+                       NavigationAddress *address, GError *error,
+                       gpointer userdata)
+{
+  BatchRequest *request = userdata;
+
+  if (hold_back(request, error))
+    return;
+
+  if (error)
+    request->ctx->n_failed++;
+  else if (!address)
+    request->ctx->n_not_found++;
+
+  complete_row(request->ctx, request->row,
+               format_row(&request->location, address, error));
+
+  navigation_address_free(address);
+
+  if (error)
+    g_error_free(error);
+
+  g_free(request);
+}
+
+static void
+address_to_location_cb(NavigationProvider *provider,
+                       NavigationLocation *location, GError *error,
+                       gpointer userdata)
+{
+  BatchRequest *request = userdata;
+
+  if (hold_back(request, error))
+    return;
+
+  if (error)
+    request->ctx->n_failed++;
+  else if (!location)
+    request->ctx->n_not_found++;
+
+  complete_row(request->ctx, request->row,
+               format_row(location, request->address, error));
+
+  navigation_location_free(location);
+  navigation_address_free(request->address);
+
+  if (error)
+    g_error_free(error);
+
+  g_free(request);
+}
+
+/* Sends request, failures are handed to its callback right away. */
+static void
+send_request(BatchRequest *request)
+{
+  BatchContext *ctx = request->ctx;
+  GError *error = NULL;
+  gboolean rv;
+
+  ctx->n_sent++;
+
+  if (reverse)
+  {
+    rv = navigation_provider_location_to_address_verbose(
+          ctx->provider, &request->location, location_to_address_cb,
+          request, &error);
+  }
+  else
+  {
+    rv = navigation_provider_address_to_location_verbose(
+          ctx->provider, request->address, address_to_location_cb, request,
+          &error);
+  }
+
+  if (!rv)
+  {
+    if (reverse)
+      location_to_address_cb(ctx->provider, NULL, error, request);
+    else
+      address_to_location_cb(ctx->provider, NULL, error, request);
+  }
+}
+
+/* Reads the next row and sends its request. Returns FALSE at the end of the
+ * input. */
+static gboolean
+read_row(BatchContext *ctx)
+{
+  BatchRequest *request;
+  BatchRow *row;
+  GError *error = NULL;
+  GIOStatus status;
+  gchar *line;
+
+  while (TRUE)
+  {
+    status = g_io_channel_read_line(ctx->input, &line, NULL, NULL, &error);
+
+    if (status != G_IO_STATUS_NORMAL)
+    {
+      if (error)
+      {
+        g_printerr("stdin: %s\n", error->message);
+        g_error_free(error);
+      }
+
+      return FALSE;
+    }
+
+    ctx->line++;
+
+    if (ctx->line <= ctx->skip_lines || !*g_strstrip(line) ||
+        (*line == '#' && !is_ndjson()))
+    {
+      g_free(line);
+      continue;
+    }
+
+    break;
+  }
+
+  request = g_new0(BatchRequest, 1);
+  request->ctx = ctx;
+  request->row = ctx->n_read++;
+  row = &ctx->rows[request->row % in_flight];
+  row->line = ctx->line;
+  row->started = g_get_monotonic_time();
+
+  if (!parse_row(line, &request->location, &request->address))
+  {
+    g_printerr("stdin:%" G_GSIZE_FORMAT ": malformed row\n", ctx->line);
+    g_free(line);
+    navigation_address_free(request->address);
+    ctx->n_failed++;
+    complete_row(ctx, request->row, format_row(NULL, NULL, NULL));
+    g_free(request);
+
+    return TRUE;
+  }
+
+  g_free(line);
+
+  /* rows go in order, after the ones already held back */
+  if (ctx->waiting.length)
+    g_queue_push_tail(&ctx->waiting, request);
+  else
+    send_request(request);
+
+  return TRUE;
+}
+
+/* Writes the rows that are done in input order and keeps in_flight requests
+ * going. Results of requests that fail right away come back in here. */
+static void
+pump(BatchContext *ctx)
+{
+  gboolean progress = TRUE;
+
+  if (ctx->pumping)
+    return;
+
+  ctx->pumping = TRUE;
+
+  while (progress)
+  {
+    progress = FALSE;
+
+    while (ctx->n_written < ctx->n_read)
+    {
+      BatchRow *row = &ctx->rows[ctx->n_written % in_flight];
+
+      if (!row->output)
+        break;
+
+      fputs(row->output, stdout);
+      g_clear_pointer(&row->output, g_free);
+      ctx->n_written++;
+
+      if (checkpoint && !(ctx->n_written % CHECKPOINT_INTERVAL))
+        save_checkpoint(row->line);
+
+      progress = TRUE;
+    }
+
+    if (!ctx->eof && ctx->n_read - ctx->n_written < (guint64)in_flight)
+    {
+      if (read_row(ctx))
+        progress = TRUE;
+      else
+        ctx->eof = TRUE;
+    }
+  }
+
+  ctx->pumping = FALSE;
+
+  if (ctx->eof && ctx->n_written == ctx->n_read)
+    g_main_loop_quit(ctx->loop);
+}
+
+static gboolean
+start_idle(gpointer user_data)
+{
+  pump(user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static int
+compare_latencies(const void *a, const void *b)
+{
+  gint64 la = *(const gint64 *)a;
+  gint64 lb = *(const gint64 *)b;
+
+  return (la > lb) - (la < lb);
+}
+
+static double
+percentile(GArray *latencies, double p)
+{
+  guint i = MIN(latencies->len - 1, (guint)(p * latencies->len));
+
+  return g_array_index(latencies, gint64, i) / 1000.0;
+}
+
+static void
+print_stats(BatchContext *ctx)
+{
+  double elapsed = (g_get_monotonic_time() - ctx->started) /
+    (double)G_TIME_SPAN_SECOND;
+
+  g_printerr("%" G_GUINT64_FORMAT " rows, %" G_GUINT64_FORMAT " not found, %"
+             G_GUINT64_FORMAT " failed in %.1f s, %.1f rows/s\n",
+             ctx->n_written, ctx->n_not_found, ctx->n_failed, elapsed,
+             elapsed > 0 ? ctx->n_written / elapsed : 0);
+
+  if (!ctx->latencies->len)
+    return;
+
+  qsort(ctx->latencies->data, ctx->latencies->len, sizeof(gint64),
+        compare_latencies);
+  g_printerr("latency ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+             percentile(ctx->latencies, 0.5),
+             percentile(ctx->latencies, 0.9),
+             percentile(ctx->latencies, 0.99),
+             percentile(ctx->latencies, 1.0));
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  BatchContext ctx;
+  GError *error = NULL;
+
+  context = g_option_context_new("- geocode rows from stdin to stdout");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (argc > 1 || in_flight < 1 || in_flight > 4096 ||
+      (format && strcmp(format, "csv") && strcmp(format, "ndjson")))
+  {
+    g_printerr("Usage: %s [-r] [-f csv|ndjson] [-j N] [-c FILE]\n",
+               g_get_prgname());
+    return 1;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+
+  if (checkpoint)
+  {
+    gchar *contents;
+
+    if (g_file_get_contents(checkpoint, &contents, NULL, NULL))
+    {
+      ctx.skip_lines = g_ascii_strtoull(contents, NULL, 10);
+      g_free(contents);
+    }
+  }
+
+  ctx.provider = navigation_provider_new_default();
+  ctx.loop = g_main_loop_new(NULL, FALSE);
+  ctx.input = g_io_channel_unix_new(fileno(stdin));
+  ctx.rows = g_new0(BatchRow, in_flight);
+  ctx.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+  ctx.started = g_get_monotonic_time();
+
+  /* bulk work, interactive users of the service go first */
+  navigation_priority_push_thread_default(NAVIGATION_PRIORITY_BACKGROUND);
+
+  g_idle_add(start_idle, &ctx);
+  g_main_loop_run(ctx.loop);
+
+  navigation_priority_pop_thread_default();
+
+  if (checkpoint)
+    save_checkpoint(ctx.line);
+  else
+    fflush(stdout);
+
+  print_stats(&ctx);
+
+  g_array_free(ctx.latencies, TRUE);
+  g_free(ctx.rows);
+  g_io_channel_unref(ctx.input);
+  g_main_loop_unref(ctx.loop);
+  g_object_unref(ctx.provider);
+
+  return 0;
+}
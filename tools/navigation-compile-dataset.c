@@ -0,0 +1,447 @@
+/*
+ * navigation-compile-dataset.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Compiles a CSV file into an offline address dataset for the local
+ * navigation service. Every line holds
+ *
+ *   latitude,longitude,house number,house name,street,suburb,town,
+ *   municipality,province,postal code,country,country code,time zone
+ *
+ * Fields may be quoted with ", a literal " inside quotes is written as "".
+ * Empty lines and lines starting with # are ignored.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "navigation-dataset.h"
+#include "navigation-util.h"
+
+#define N_COLUMNS (2 + NAVIGATION_DATASET_N_FIELDS)
+
+/* indexed record fields, see address_to_array() */
+static const struct
+{
+  guint index;
+  NavigationDatasetField field;
+} indexed_fields[] =
+{
+  { 2, NAVIGATION_DATASET_FIELD_STREET },
+  { 4, NAVIGATION_DATASET_FIELD_TOWN },
+  { 7, NAVIGATION_DATASET_FIELD_POSTAL_CODE }
+};
+
+struct _CompileContext
+{
+  GArray *records;
+  GString *strings;
+  GHashTable *offsets;
+};
+
+typedef struct _CompileContext CompileContext;
+
+static gchar *output = NULL;
+static gint max_distance = 1000;
+
+static GOptionEntry entries[] =
+{
+  {
+    "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+    "Write the dataset to FILE", "FILE"
+  },
+  {
+    "max-distance", 'd', 0, G_OPTION_ARG_INT, &max_distance,
+    "Farthest distance in meters an address is reported at (default 1000)",
+    "METERS"
+  },
+  { NULL }
+};
+
+static guint32
+add_string(CompileContext *ctx, const gchar *s)
+{
+  gpointer offset;
+
+  if (!s || !*s)
+    return 0;
+
+  if (!g_hash_table_lookup_extended(ctx->offsets, s, NULL, &offset))
+  {
+    offset = GUINT_TO_POINTER(ctx->strings->len);
+    g_string_append_len(ctx->strings, s, strlen(s) + 1);
+    g_hash_table_insert(ctx->offsets, g_strdup(s), offset);
+  }
+
+  return GUINT32_TO_LE(GPOINTER_TO_UINT(offset));
+}
+
+static gboolean
+parse_coordinate(const gchar *s, double limit, gint32 *v)
+{
+  gchar *end;
+  double d = g_ascii_strtod(s, &end);
+
+  if (end == s || *end || !(fabs(d) <= limit))
+    return FALSE;
+
+  *v = lround(d * NAVIGATION_DATASET_PRECISION);
+
+  return TRUE;
+}
+
+static gboolean
+parse_csv(CompileContext *ctx, const gchar *path, GError **error)
+{
+  GIOChannel *channel = g_io_channel_new_file(path, "r", error);
+  gchar *line;
+  gsize n = 0;
+  GIOStatus status;
+
+  if (!channel)
+    return FALSE;
+
+  while ((status = g_io_channel_read_line(channel, &line, NULL, NULL,
+                                          error)) == G_IO_STATUS_NORMAL)
+  {
+    NavigationDatasetRecord record;
+    gchar **fields;
+    int i;
+
+    n++;
+
+    if (*line == '#' || !*g_strstrip(line))
+    {
+      g_free(line);
+      continue;
+    }
+
+    fields = navigation_split_csv_line(line);
+    g_free(line);
+
+    if (g_strv_length(fields) != N_COLUMNS ||
+        !parse_coordinate(fields[0], 90.0, &record.latitude) ||
+        !parse_coordinate(fields[1], 180.0, &record.longitude))
+    {
+      g_strfreev(fields);
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                  "%s:%" G_GSIZE_FORMAT ": malformed record", path, n);
+      g_io_channel_unref(channel);
+
+      return FALSE;
+    }
+
+    for (i = 0; i < NAVIGATION_DATASET_N_FIELDS; i++)
+      record.fields[i] = add_string(ctx, fields[i + 2]);
+
+    g_strfreev(fields);
+    g_array_append_val(ctx->records, record);
+  }
+
+  g_io_channel_unref(channel);
+
+  return status == G_IO_STATUS_EOF;
+}
+
+static int
+compare_latitude(gconstpointer a, gconstpointer b)
+{
+  gint32 la = ((const NavigationDatasetRecord *)a)->latitude;
+  gint32 lb = ((const NavigationDatasetRecord *)b)->latitude;
+
+  return (la > lb) - (la < lb);
+}
+
+static int
+compare_longitude(gconstpointer a, gconstpointer b)
+{
+  gint32 la = ((const NavigationDatasetRecord *)a)->longitude;
+  gint32 lb = ((const NavigationDatasetRecord *)b)->longitude;
+
+  return (la > lb) - (la < lb);
+}
+
+static void
+add_token_postings(GHashTable *index, const gchar *text, guint32 posting)
+{
+  gchar token[NAVIGATION_DATASET_MAX_TOKEN + 1];
+
+  if (!g_utf8_validate(text, -1, NULL))
+    return;
+
+  while (navigation_dataset_next_token(&text, token))
+  {
+    GArray *postings = g_hash_table_lookup(index, token);
+
+    if (!postings)
+    {
+      postings = g_array_new(FALSE, FALSE, sizeof(guint32));
+      g_hash_table_insert(index, g_strdup(token), postings);
+    }
+
+    /* records are visited in order, so postings stay sorted */
+    if (!postings->len ||
+        g_array_index(postings, guint32, postings->len - 1) != posting)
+    {
+      g_array_append_val(postings, posting);
+    }
+  }
+}
+
+static int
+compare_tokens(gconstpointer a, gconstpointer b)
+{
+  return strcmp(*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+/* front-coded token dictionary, see navigation-dataset.h */
+static guint
+build_index(CompileContext *ctx, GArray *blocks, GByteArray *tokens,
+            GArray *postings)
+{
+  GHashTable *index = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_array_unref);
+  const gchar **keys;
+  const gchar *previous = "";
+  guint n_keys;
+  guint32 i;
+  guint j;
+
+  for (i = 0; i < ctx->records->len; i++)
+  {
+    NavigationDatasetRecord *record =
+      &g_array_index(ctx->records, NavigationDatasetRecord, i);
+
+    for (j = 0; j < G_N_ELEMENTS(indexed_fields); j++)
+    {
+      guint32 offset =
+        GUINT32_FROM_LE(record->fields[indexed_fields[j].index]);
+
+      if (offset)
+      {
+        add_token_postings(index, ctx->strings->str + offset,
+                           i << 2 | indexed_fields[j].field);
+      }
+    }
+  }
+
+  keys = (const gchar **)g_hash_table_get_keys_as_array(index, &n_keys);
+  qsort(keys, n_keys, sizeof(*keys), compare_tokens);
+
+  for (j = 0; j < n_keys; j++)
+  {
+    GArray *list = g_hash_table_lookup(index, keys[j]);
+    gsize len = strlen(keys[j]);
+    guint8 entry[3];
+    gsize prefix = 0;
+    guint32 k;
+
+    if (j % NAVIGATION_DATASET_BLOCK_SIZE == 0)
+    {
+      guint32 offset = GUINT32_TO_LE(tokens->len);
+
+      g_array_append_val(blocks, offset);
+    }
+    else
+    {
+      while (previous[prefix] && previous[prefix] == keys[j][prefix])
+        prefix++;
+    }
+
+    entry[0] = prefix;
+    entry[1] = len - prefix;
+    entry[2] = 0;
+
+    for (k = 0; k < list->len; k++)
+      entry[2] |= 1 << (g_array_index(list, guint32, k) & 3);
+
+    g_byte_array_append(tokens, entry, sizeof(entry));
+    g_byte_array_append(tokens, (const guint8 *)keys[j] + prefix,
+                        len - prefix);
+    navigation_put_varint(tokens, postings->len);
+    navigation_put_varint(tokens, list->len);
+
+    for (k = 0; k < list->len; k++)
+    {
+      guint32 posting = GUINT32_TO_LE(g_array_index(list, guint32, k));
+
+      g_array_append_val(postings, posting);
+    }
+
+    previous = keys[j];
+  }
+
+  g_free(keys);
+  g_hash_table_destroy(index);
+
+  return n_keys;
+}
+
+/* must split exactly like kd_tree_nearest() in the library walks */
+static void
+build_kd_tree(NavigationDatasetRecord *records, guint lo, guint hi,
+              guint depth)
+{
+  guint mid;
+
+  if (hi - lo < 2)
+    return;
+
+  qsort(records + lo, hi - lo, sizeof(*records),
+        depth & 1 ? compare_longitude : compare_latitude);
+
+  mid = lo + (hi - lo) / 2;
+  build_kd_tree(records, lo, mid, depth + 1);
+  build_kd_tree(records, mid + 1, hi, depth + 1);
+}
+
+static gboolean
+write_dataset(CompileContext *ctx, const gchar *path, GError **error)
+{
+  NavigationDatasetHeader header;
+  GByteArray *data;
+  GArray *blocks;
+  GByteArray *tokens;
+  GArray *postings;
+  guint32 offset;
+  guint n_tokens;
+  guint i;
+  gboolean rv;
+
+  /* postings keep the field in the low 2 bits of the record index */
+  if (ctx->records->len > G_MAXUINT32 >> 2)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Too many records");
+    return FALSE;
+  }
+
+  build_kd_tree((NavigationDatasetRecord *)ctx->records->data, 0,
+                ctx->records->len, 0);
+
+  /* record indices are final now */
+  blocks = g_array_new(FALSE, FALSE, sizeof(guint32));
+  tokens = g_byte_array_new();
+  postings = g_array_new(FALSE, FALSE, sizeof(guint32));
+  n_tokens = build_index(ctx, blocks, tokens, postings);
+
+  for (i = 0; i < ctx->records->len; i++)
+  {
+    NavigationDatasetRecord *record =
+      &g_array_index(ctx->records, NavigationDatasetRecord, i);
+
+    record->latitude = GINT32_TO_LE(record->latitude);
+    record->longitude = GINT32_TO_LE(record->longitude);
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NAVIGATION_DATASET_MAGIC,
+         sizeof(NAVIGATION_DATASET_MAGIC));
+  header.version = GUINT32_TO_LE(NAVIGATION_DATASET_VERSION);
+  header.n_records = GUINT32_TO_LE(ctx->records->len);
+  offset = sizeof(header);
+  header.records_offset = GUINT32_TO_LE(offset);
+  offset += ctx->records->len * sizeof(NavigationDatasetRecord);
+  header.postings_offset = GUINT32_TO_LE(offset);
+  header.n_postings = GUINT32_TO_LE(postings->len);
+  offset += postings->len * sizeof(guint32);
+  header.blocks_offset = GUINT32_TO_LE(offset);
+  header.n_tokens = GUINT32_TO_LE(n_tokens);
+  offset += blocks->len * sizeof(guint32);
+  header.strings_offset = GUINT32_TO_LE(offset);
+  header.strings_size = GUINT32_TO_LE(ctx->strings->len);
+  offset += ctx->strings->len;
+  header.tokens_offset = GUINT32_TO_LE(offset);
+  header.tokens_size = GUINT32_TO_LE(tokens->len);
+  header.max_distance = GUINT32_TO_LE(max_distance);
+
+  data = g_byte_array_new();
+  g_byte_array_append(data, (const guint8 *)&header, sizeof(header));
+  g_byte_array_append(data, (const guint8 *)ctx->records->data,
+                      ctx->records->len * sizeof(NavigationDatasetRecord));
+  g_byte_array_append(data, (const guint8 *)postings->data,
+                      postings->len * sizeof(guint32));
+  g_byte_array_append(data, (const guint8 *)blocks->data,
+                      blocks->len * sizeof(guint32));
+  g_byte_array_append(data, (const guint8 *)ctx->strings->str,
+                      ctx->strings->len);
+  g_byte_array_append(data, tokens->data, tokens->len);
+
+  rv = g_file_set_contents(path, (const gchar *)data->data, data->len, error);
+  g_byte_array_free(data, TRUE);
+  g_byte_array_free(tokens, TRUE);
+  g_array_free(blocks, TRUE);
+  g_array_free(postings, TRUE);
+
+  return rv;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  CompileContext ctx;
+  GError *error = NULL;
+  int i;
+
+  context = g_option_context_new("CSV... - compile an offline address dataset");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!output || argc < 2 || max_distance < 0)
+  {
+    g_printerr("Usage: %s -o FILE CSV...\n", g_get_prgname());
+    return 1;
+  }
+
+  ctx.records = g_array_new(FALSE, FALSE, sizeof(NavigationDatasetRecord));
+  /* offset 0 is the empty string, meaning not set */
+  ctx.strings = g_string_new_len("", 1);
+  ctx.offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  for (i = 1; i < argc && !error; i++)
+    parse_csv(&ctx, argv[i], &error);
+
+  if (!error)
+    write_dataset(&ctx, output, &error);
+
+  if (error)
+    g_printerr("%s\n", error->message);
+  else
+  {
+    g_print("%u records, %" G_GSIZE_FORMAT " bytes of strings\n",
+            ctx.records->len, ctx.strings->len);
+  }
+
+  g_hash_table_destroy(ctx.offsets);
+  g_string_free(ctx.strings, TRUE);
+  g_array_free(ctx.records, TRUE);
+
+  return error ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * navigation-geo-bench.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Times the batch geometry kernels against plain loops over libm doing the
+ * same work, and prints the nanoseconds per point of both. The default
+ * batch fits the first level caches, so the arithmetic is measured rather
+ * than memory.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "navigation-provider.h"
+#include "navigation-util.h"
+
+/* the same radius as navigation-geo.c */
+#define EARTH_RADIUS 6371008.8
+#define DEG_TO_RAD (G_PI / 180.0)
+
+static gint n_points = 1024;
+static gint n_rounds = 10000;
+
+static GOptionEntry entries[] =
+{
+  {
+    "points", 'n', 0, G_OPTION_ARG_INT, &n_points,
+    "Number of points in a batch (default 1024)", "N"
+  },
+  {
+    "rounds", 'r', 0, G_OPTION_ARG_INT, &n_rounds,
+    "Number of times every batch is run (default 10000)", "N"
+  },
+  { NULL }
+};
+
+struct _Bench
+{
+  NavigationLocation from;
+  NavigationArea area;
+  double *latitudes;
+  double *longitudes;
+  double *distances;
+  guint8 *inside;
+  guint64 *keys;
+};
+
+typedef struct _Bench Bench;
+
+typedef void (*BenchFunc)(Bench *bench);
+
+/* keeps the compiler from dropping the libm loops */
+static volatile double sink;
+
+static void
+distances_kernel(Bench *bench)
+{
+  navigation_geo_distances(&bench->from, bench->latitudes, bench->longitudes,
+                           n_points, bench->distances);
+}
+
+static void
+distances_libm(Bench *bench)
+{
+  double cos_latitude = cos(bench->from.latitude * DEG_TO_RAD);
+  int i;
+
+  for (i = 0; i < n_points; i++)
+  {
+    double s_lat = sin((bench->latitudes[i] - bench->from.latitude) *
+                       DEG_TO_RAD * 0.5);
+    double s_lon = sin((bench->longitudes[i] - bench->from.longitude) *
+                       DEG_TO_RAD * 0.5);
+    double a = s_lat * s_lat + cos_latitude *
+      cos(bench->latitudes[i] * DEG_TO_RAD) * s_lon * s_lon;
+
+    bench->distances[i] = 2 * EARTH_RADIUS * asin(sqrt(MIN(a, 1.0)));
+  }
+}
+
+static void
+nearest_kernel(Bench *bench)
+{
+  sink = navigation_geo_nearest(&bench->from, bench->latitudes,
+                                bench->longitudes, n_points, NULL);
+}
+
+static void
+nearest_libm(Bench *bench)
+{
+  double cos_latitude = cos(bench->from.latitude * DEG_TO_RAD);
+  double best = G_MAXDOUBLE;
+  int nearest = -1;
+  int i;
+
+  /* the haversine grows with the distance, asin is only needed once */
+  for (i = 0; i < n_points; i++)
+  {
+    double s_lat = sin((bench->latitudes[i] - bench->from.latitude) *
+                       DEG_TO_RAD * 0.5);
+    double s_lon = sin((bench->longitudes[i] - bench->from.longitude) *
+                       DEG_TO_RAD * 0.5);
+    double a = s_lat * s_lat + cos_latitude *
+      cos(bench->latitudes[i] * DEG_TO_RAD) * s_lon * s_lon;
+
+    if (a < best)
+    {
+      best = a;
+      nearest = i;
+    }
+  }
+
+  sink = nearest;
+}
+
+static void
+area_contains_kernel(Bench *bench)
+{
+  sink = navigation_geo_area_contains(&bench->area, bench->latitudes,
+                                      bench->longitudes, n_points,
+                                      bench->inside);
+}
+
+static void
+area_contains_libm(Bench *bench)
+{
+  const NavigationArea *area = &bench->area;
+  guint count = 0;
+  int i;
+
+  for (i = 0; i < n_points; i++)
+  {
+    double latitude = bench->latitudes[i];
+    double longitude = bench->longitudes[i];
+
+    bench->inside[i] = latitude <= area->nw.latitude &&
+      latitude >= area->se.latitude &&
+      longitude >= area->nw.longitude && longitude <= area->se.longitude;
+    count += bench->inside[i];
+  }
+
+  sink = count;
+}
+
+static void
+tile_keys_kernel(Bench *bench)
+{
+  navigation_tile_keys(bench->latitudes, bench->longitudes, n_points, 15, 0,
+                       bench->keys);
+}
+
+static void
+tile_keys_libm(Bench *bench)
+{
+  double scale = 1 << 15;
+  int i;
+
+  for (i = 0; i < n_points; i++)
+  {
+    double latitude = CLAMP(bench->latitudes[i], -NAVIGATION_MAX_LATITUDE,
+                            NAVIGATION_MAX_LATITUDE);
+    double s = sin(latitude * DEG_TO_RAD);
+    double x = (bench->longitudes[i] + 180.0) / 360.0 * scale;
+    double y = (0.5 - log((1.0 + s) / (1.0 - s)) / (4.0 * G_PI)) * scale;
+
+    x = CLAMP(x, 0.0, scale - 1.0);
+    y = CLAMP(y, 0.0, scale - 1.0);
+    bench->keys[i] = (guint64)y << 24 | (guint64)x;
+  }
+}
+
+/* nanoseconds per point */
+static double
+run(Bench *bench, BenchFunc func)
+{
+  gint64 start;
+  int i;
+
+  /* warm up the caches and the branch predictors */
+  func(bench);
+
+  start = g_get_monotonic_time();
+
+  for (i = 0; i < n_rounds; i++)
+    func(bench);
+
+  return (g_get_monotonic_time() - start) * 1000.0 /
+         ((double)n_rounds * n_points);
+}
+
+static void
+compare(Bench *bench, const char *name, BenchFunc kernel, BenchFunc libm)
+{
+  double kernel_ns = run(bench, kernel);
+  double libm_ns = run(bench, libm);
+
+  printf("%-16s %8.2f %8.2f %7.2fx\n", name, kernel_ns, libm_ns,
+         libm_ns / kernel_ns);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  Bench bench;
+  GRand *rand;
+  int i;
+
+  context = g_option_context_new("- time the geometry kernels against libm");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (argc > 1 || n_points < 1 || n_rounds < 1)
+  {
+    g_printerr("Usage: %s [-n N] [-r N]\n", g_get_prgname());
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(1);
+  bench.latitudes = g_new(double, n_points);
+  bench.longitudes = g_new(double, n_points);
+  bench.distances = g_new(double, n_points);
+  bench.inside = g_new(guint8, n_points);
+  bench.keys = g_new(guint64, n_points);
+
+  for (i = 0; i < n_points; i++)
+  {
+    bench.latitudes[i] = g_rand_double_range(rand, -90.0, 90.0);
+    bench.longitudes[i] = g_rand_double_range(rand, -180.0, 180.0);
+  }
+
+  bench.from.latitude = 42.6977;
+  bench.from.longitude = 23.3219;
+  bench.area.nw.latitude = 60.0;
+  bench.area.nw.longitude = -30.0;
+  bench.area.se.latitude = 30.0;
+  bench.area.se.longitude = 45.0;
+
+  printf("%d points, %d rounds, ns per point\n", n_points, n_rounds);
+  printf("%-16s %8s %8s %8s\n", "", "kernel", "libm", "speedup");
+  compare(&bench, "distances", distances_kernel, distances_libm);
+  compare(&bench, "nearest", nearest_kernel, nearest_libm);
+  compare(&bench, "area contains", area_contains_kernel,
+          area_contains_libm);
+  compare(&bench, "tile keys", tile_keys_kernel, tile_keys_libm);
+
+  g_free(bench.keys);
+  g_free(bench.inside);
+  g_free(bench.distances);
+  g_free(bench.longitudes);
+  g_free(bench.latitudes);
+  g_rand_free(rand);
+
+  return 0;
+}
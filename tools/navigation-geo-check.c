@@ -0,0 +1,249 @@
+/*
+ * navigation-geo-check.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Checks the batch geometry kernels against libm. Distances go through the
+ * polynomial sin and asin and the Newton step sqrt, tile keys through the
+ * polynomial log. Random points are mixed with the edge cases of those
+ * kernels: equal points, points a millimeter apart and antipodes.
+ *
+ * Fails if a distance is off by 1e-5 m or more, or if a tile key differs
+ * for a point not within 1e-9 tiles of a tile edge. Within 100 km of the
+ * antipode the haversine formula itself, in libm as well, turns rounding of
+ * the last bit into tenths of a meter, distances there may be off by up to
+ * 1 m.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "navigation-provider.h"
+#include "navigation-util.h"
+
+/* the same radius as navigation-geo.c */
+#define EARTH_RADIUS 6371008.8
+#define DEG_TO_RAD (G_PI / 180.0)
+
+#define MAX_DISTANCE_ERROR 1e-5
+#define MAX_ANTIPODAL_ERROR 1.0
+#define ANTIPODAL_BAND 100000.0
+/* points closer to a tile edge may fall on either side */
+#define TILE_EDGE_MARGIN 1e-9
+
+static gint n_points = 1000000;
+static gint seed = 1;
+
+static GOptionEntry entries[] =
+{
+  {
+    "points", 'n', 0, G_OPTION_ARG_INT, &n_points,
+    "Number of points to check (default 1000000)", "N"
+  },
+  {
+    "seed", 's', 0, G_OPTION_ARG_INT, &seed,
+    "Seed of the random points (default 1)", "SEED"
+  },
+  { NULL }
+};
+
+static double
+libm_distance(const NavigationLocation *from, double latitude,
+              double longitude)
+{
+  double s_lat = sin((latitude - from->latitude) * DEG_TO_RAD * 0.5);
+  double s_lon = sin((longitude - from->longitude) * DEG_TO_RAD * 0.5);
+  double a = s_lat * s_lat + cos(from->latitude * DEG_TO_RAD) *
+    cos(latitude * DEG_TO_RAD) * s_lon * s_lon;
+
+  return 2 * EARTH_RADIUS * asin(sqrt(MIN(a, 1.0)));
+}
+
+/* the position on the tile grid, in tiles */
+static void
+libm_tile(double latitude, double longitude, int zoom, double *x, double *y)
+{
+  double s;
+
+  latitude = CLAMP(latitude, -NAVIGATION_MAX_LATITUDE,
+                   NAVIGATION_MAX_LATITUDE);
+  s = sin(latitude * DEG_TO_RAD);
+  *x = (longitude + 180.0) / 360.0 * (1 << zoom);
+  *y = (0.5 - log((1.0 + s) / (1.0 - s)) / (4.0 * G_PI)) * (1 << zoom);
+}
+
+static gboolean
+near_edge(double v)
+{
+  return fabs(v - round(v)) < TILE_EDGE_MARGIN;
+}
+
+/* fills the points, three in every sixteen are edge cases of the kernels
+ * relative to from */
+static void
+make_points(GRand *rand, const NavigationLocation *from, double *latitudes,
+            double *longitudes, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+  {
+    switch (i % 16)
+    {
+      case 3:
+      {
+        latitudes[i] = from->latitude;
+        longitudes[i] = from->longitude;
+        break;
+      }
+      case 7:
+      {
+        latitudes[i] = from->latitude + g_rand_double_range(rand, -1e-8, 1e-8);
+        longitudes[i] = from->longitude +
+          g_rand_double_range(rand, -1e-8, 1e-8);
+        break;
+      }
+      case 11:
+      {
+        latitudes[i] = -from->latitude;
+        longitudes[i] = from->longitude > 0.0 ?
+          from->longitude - 180.0 : from->longitude + 180.0;
+        break;
+      }
+      default:
+      {
+        latitudes[i] = g_rand_double_range(rand, -90.0, 90.0);
+        longitudes[i] = g_rand_double_range(rand, -180.0, 180.0);
+      }
+    }
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GRand *rand;
+  double *latitudes;
+  double *longitudes;
+  double *distances;
+  guint64 *keys;
+  double max_error = 0.0;
+  double max_antipodal_error = 0.0;
+  guint n_tiles = 0;
+  guint n_wrong_tiles = 0;
+  guint i;
+  gboolean ok;
+
+  context = g_option_context_new("- check the geometry kernels against libm");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (argc > 1 || n_points < 1)
+  {
+    g_printerr("Usage: %s [-n N] [-s SEED]\n", g_get_prgname());
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(seed);
+  latitudes = g_new(double, n_points);
+  longitudes = g_new(double, n_points);
+  distances = g_new(double, n_points);
+  keys = g_new(guint64, n_points);
+
+  /* a new origin for every block, so both far and near points are common */
+  for (i = 0; i < (guint)n_points; i += 1024)
+  {
+    guint n = MIN(1024, n_points - i);
+    NavigationLocation from;
+    guint j;
+
+    from.latitude = g_rand_double_range(rand, -90.0, 90.0);
+    from.longitude = g_rand_double_range(rand, -180.0, 180.0);
+    make_points(rand, &from, latitudes + i, longitudes + i, n);
+    navigation_geo_distances(&from, latitudes + i, longitudes + i, n,
+                             distances + i);
+
+    for (j = i; j < i + n; j++)
+    {
+      double d = libm_distance(&from, latitudes[j], longitudes[j]);
+      double e = fabs(distances[j] - d);
+
+      if (d > G_PI * EARTH_RADIUS - ANTIPODAL_BAND)
+        max_antipodal_error = MAX(max_antipodal_error, e);
+      else
+        max_error = MAX(max_error, e);
+    }
+  }
+
+  for (i = 0; i <= NAVIGATION_TILE_MAX_ZOOM; i++)
+  {
+    guint j;
+
+    navigation_tile_keys(latitudes, longitudes, n_points, i, 0, keys);
+
+    for (j = 0; j < (guint)n_points; j++)
+    {
+      NavigationTile tile;
+      double x, y;
+
+      libm_tile(latitudes[j], longitudes[j], i, &x, &y);
+
+      if (near_edge(x) || near_edge(y))
+        continue;
+
+      navigation_tile_from_key(keys[j], &tile);
+      n_tiles++;
+
+      /* beyond the grid is clamped to its edge */
+      if (tile.x != CLAMP((int)floor(x), 0, (1 << i) - 1) ||
+          tile.y != CLAMP((int)floor(y), 0, (1 << i) - 1))
+      {
+        n_wrong_tiles++;
+      }
+    }
+  }
+
+  ok = max_error < MAX_DISTANCE_ERROR &&
+    max_antipodal_error < MAX_ANTIPODAL_ERROR && !n_wrong_tiles;
+
+  printf("distances: %d points, largest error %.3g m, %.3g m near the "
+         "antipode\n", n_points, max_error, max_antipodal_error);
+  printf("tile keys: %u points, %u in the wrong tile\n", n_tiles,
+         n_wrong_tiles);
+  printf("%s\n", ok ? "ok" : "FAILED");
+
+  g_free(keys);
+  g_free(distances);
+  g_free(longitudes);
+  g_free(latitudes);
+  g_rand_free(rand);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,657 @@
+/*
+ * navigation-replay.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Serves a trace back as a navigation service, so clients can be benchmarked
+ * on a recorded workload without the real service. A trace is recorded by
+ * running a client with the NAVIGATION_TRACE environment variable set to the
+ * file to write it to.
+ *
+ * Every request is answered with the recorded request that has the same
+ * method and arguments, or failing that with the oldest unused request of the
+ * same method, and its recorded replies follow with their original delays,
+ * or right away with --fast. Methods that are not recorded in traces, the
+ * Show* ones and LocationToAddressesCached, get empty replies.
+ *
+ * Point the client at the replay by setting the /apps/osso/navigation/service
+ * GConf key to the name given with --name. A trace recorded with hedging on
+ * holds the requests of several services; --service picks the ones of a
+ * single service to serve, by default all of them are.
+ */
+
+#include "config.h"
+
+#include <signal.h>
+#include <string.h>
+
+#include <dbus/dbus-glib-lowlevel.h>
+#include <dbus/dbus.h>
+#include <glib-unix.h>
+
+#include "navigation-provider.h"
+#include "navigation-trace.h"
+#include "navigation-util.h"
+
+#define MAP_PROVIDER_INTERFACE "com.nokia.Navigation.MapProvider"
+#define MAP_PROVIDER_PATH "/Provider"
+
+struct _ReplayRequest
+{
+  NavigationTraceEvent *event;
+  /* NavigationTraceEvent replies, in the order they were received */
+  GPtrArray *replies;
+  gboolean used;
+};
+
+typedef struct _ReplayRequest ReplayRequest;
+
+struct _ReplayContext
+{
+  DBusConnection *dbus;
+  GMainLoop *loop;
+  GPtrArray *events;
+  /* GQueue of ReplayRequest by method and arguments */
+  GHashTable *by_args;
+  /* GQueue of ReplayRequest by method */
+  GHashTable *by_method;
+  guint n_requests;
+  guint n_served;
+  guint n_inexact;
+  guint n_missing;
+  guint n_pending;
+};
+
+typedef struct _ReplayContext ReplayContext;
+
+struct _ReplaySignal
+{
+  ReplayContext *ctx;
+  DBusMessage *message;
+  gchar *path;
+  gchar *destination;
+};
+
+typedef struct _ReplaySignal ReplaySignal;
+
+static gchar *name = NULL;
+static gchar *service = NULL;
+static gboolean fast = FALSE;
+static gboolean plain = FALSE;
+static gboolean exit_when_done = FALSE;
+
+static GOptionEntry entries[] =
+{
+  {
+    "name", 'n', 0, G_OPTION_ARG_STRING, &name,
+    "Serve the trace under the D-Bus name NAME", "NAME"
+  },
+  {
+    "service", 's', 0, G_OPTION_ARG_STRING, &service,
+    "Serve only the requests sent to SERVICE", "SERVICE"
+  },
+  {
+    "fast", 'f', 0, G_OPTION_ARG_NONE, &fast,
+    "Send replies right away instead of with their recorded delays", NULL
+  },
+  {
+    "plain", 'p', 0, G_OPTION_ARG_NONE, &plain,
+    "Do not take encoded addresses, like services that predate them", NULL
+  },
+  {
+    "exit", 'x', 0, G_OPTION_ARG_NONE, &exit_when_done,
+    "Exit once every recorded request was served", NULL
+  },
+  { NULL }
+};
+
+static void
+replay_request_free(ReplayRequest *request)
+{
+  g_ptr_array_free(request->replies, TRUE);
+  g_free(request);
+}
+
+static gchar *
+request_key(const gchar *method, GVariant *args)
+{
+  gchar *printed = g_variant_print(args, FALSE);
+  gchar *key = g_strconcat(method, " ", printed, NULL);
+
+  g_free(printed);
+
+  return key;
+}
+
+static void
+queue_push(GHashTable *table, const gchar *key, ReplayRequest *request)
+{
+  GQueue *queue = g_hash_table_lookup(table, key);
+
+  if (!queue)
+  {
+    queue = g_queue_new();
+    g_hash_table_insert(table, g_strdup(key), queue);
+  }
+
+  g_queue_push_tail(queue, request);
+}
+
+static ReplayRequest *
+queue_pop(GHashTable *table, const gchar *key)
+{
+  GQueue *queue = g_hash_table_lookup(table, key);
+  ReplayRequest *request;
+
+  /* requests also sit in the queue of their method */
+  while (queue && (request = g_queue_pop_head(queue)))
+  {
+    if (!request->used)
+      return request;
+  }
+
+  return NULL;
+}
+
+static void
+load_requests(ReplayContext *ctx, GPtrArray *requests)
+{
+  /* both by service and object path, several services can share paths */
+  GHashTable *by_path = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                              NULL);
+  /* GPtrArray of replies that overtook the request they belong to */
+  GHashTable *early = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify)g_ptr_array_unref);
+  guint i;
+
+  for (i = 0; i < ctx->events->len; i++)
+  {
+    NavigationTraceEvent *event = g_ptr_array_index(ctx->events, i);
+    ReplayRequest *request;
+    gchar *path;
+
+    if (service && g_strcmp0(event->service, service))
+      continue;
+
+    if (event->type == NAVIGATION_TRACE_REQUEST)
+    {
+      gchar *key = request_key(event->method, event->args);
+
+      path = g_strconcat(event->service, " ", event->object_path, NULL);
+      request = g_new0(ReplayRequest, 1);
+      request->event = event;
+
+      if (!g_hash_table_steal_extended(early, path, NULL,
+                                       (gpointer *)&request->replies))
+      {
+        request->replies = g_ptr_array_new();
+      }
+
+      g_ptr_array_add(requests, request);
+      g_hash_table_replace(by_path, path, request);
+      queue_push(ctx->by_args, key, request);
+      queue_push(ctx->by_method, event->method, request);
+      g_free(key);
+    }
+    else
+    {
+      GPtrArray *replies;
+
+      path = g_strconcat(event->service, " ",
+                         dbus_message_get_path(event->message), NULL);
+      replies = g_hash_table_lookup(early, path);
+
+      /* a reply may be recorded before the request it overtook */
+      if (!replies && (request = g_hash_table_lookup(by_path, path)))
+        replies = request->replies;
+
+      if (!replies)
+      {
+        replies = g_ptr_array_new();
+        g_hash_table_insert(early, path, replies);
+      }
+      else
+        g_free(path);
+
+      g_ptr_array_add(replies, event);
+    }
+  }
+
+  ctx->n_requests = requests->len;
+  g_hash_table_destroy(early);
+  g_hash_table_destroy(by_path);
+}
+
+static GVariant *
+iter_to_variant(DBusMessageIter *iter)
+{
+  int type = dbus_message_iter_get_arg_type(iter);
+  DBusMessageIter sub;
+
+  if (dbus_type_is_basic(type))
+  {
+    union
+    {
+      dbus_bool_t b;
+      guchar y;
+      gint16 n;
+      guint16 q;
+      gint32 i;
+      guint32 u;
+      gint64 x;
+      guint64 t;
+      double d;
+      const char *s;
+    } v;
+
+    dbus_message_iter_get_basic(iter, &v);
+
+    switch (type)
+    {
+      case DBUS_TYPE_BOOLEAN:
+        return g_variant_new_boolean(v.b);
+      case DBUS_TYPE_BYTE:
+        return g_variant_new_byte(v.y);
+      case DBUS_TYPE_INT16:
+        return g_variant_new_int16(v.n);
+      case DBUS_TYPE_UINT16:
+        return g_variant_new_uint16(v.q);
+      case DBUS_TYPE_INT32:
+        return g_variant_new_int32(v.i);
+      case DBUS_TYPE_UINT32:
+        return g_variant_new_uint32(v.u);
+      case DBUS_TYPE_INT64:
+        return g_variant_new_int64(v.x);
+      case DBUS_TYPE_UINT64:
+        return g_variant_new_uint64(v.t);
+      case DBUS_TYPE_DOUBLE:
+        return g_variant_new_double(v.d);
+      case DBUS_TYPE_OBJECT_PATH:
+        return g_variant_new_object_path(v.s);
+      case DBUS_TYPE_SIGNATURE:
+        return g_variant_new_signature(v.s);
+      default:
+        return g_variant_new_string(v.s);
+    }
+  }
+
+  dbus_message_iter_recurse(iter, &sub);
+
+  if (type == DBUS_TYPE_VARIANT)
+    return g_variant_new_variant(iter_to_variant(&sub));
+  else if (type == DBUS_TYPE_ARRAY)
+  {
+    char *signature = dbus_message_iter_get_signature(iter);
+    GVariantBuilder builder;
+
+    /* D-Bus and GVariant share the signatures of these types */
+    g_variant_builder_init(&builder, G_VARIANT_TYPE(signature));
+    dbus_free(signature);
+
+    while (dbus_message_iter_get_arg_type(&sub) != DBUS_TYPE_INVALID)
+    {
+      g_variant_builder_add_value(&builder, iter_to_variant(&sub));
+      dbus_message_iter_next(&sub);
+    }
+
+    return g_variant_builder_end(&builder);
+  }
+  else
+  {
+    GPtrArray *children = g_ptr_array_new();
+    GVariant *v;
+
+    while (dbus_message_iter_get_arg_type(&sub) != DBUS_TYPE_INVALID)
+    {
+      g_ptr_array_add(children, iter_to_variant(&sub));
+      dbus_message_iter_next(&sub);
+    }
+
+    if (type == DBUS_TYPE_DICT_ENTRY && children->len == 2)
+    {
+      v = g_variant_new_dict_entry(g_ptr_array_index(children, 0),
+                                   g_ptr_array_index(children, 1));
+    }
+    else
+    {
+      v = g_variant_new_tuple((GVariant **)children->pdata, children->len);
+    }
+
+    g_ptr_array_free(children, TRUE);
+
+    return v;
+  }
+}
+
+/* the address of an AddressToLocations call, as the client recorded it */
+static GVariant *
+strv_to_encoded_address(GVariant *strv)
+{
+  GVariantBuilder fields;
+  GVariantIter iter;
+  const gchar *s;
+  guchar id = 0;
+
+  g_variant_builder_init(&fields, G_VARIANT_TYPE("a{ys}"));
+  g_variant_iter_init(&iter, strv);
+
+  while (g_variant_iter_next(&iter, "&s", &s) && id < NAVIGATION_N_ADDRESS_FIELDS)
+  {
+    if (*s)
+      g_variant_builder_add(&fields, "{ys}", id, s);
+
+    id++;
+  }
+
+  return g_variant_new("(qa{ys})", NAVIGATION_ADDRESS_ENCODING_VERSION,
+                       &fields);
+}
+
+/* Gets the method and arguments of a call the way requests are recorded, the
+ * plain method and the arguments before they were laid out for it. */
+static GVariant *
+call_args(DBusMessage *message, const gchar **method)
+{
+  GPtrArray *children = g_ptr_array_new();
+  DBusMessageIter iter;
+  GVariant *args;
+
+  *method = dbus_message_get_member(message);
+
+  if (dbus_message_iter_init(message, &iter))
+  {
+    do
+      g_ptr_array_add(children, iter_to_variant(&iter));
+    while (dbus_message_iter_next(&iter));
+  }
+
+  if (!strcmp(*method, "LocationToAddressesEncoded"))
+    *method = "LocationToAddresses";
+  else if (!strcmp(*method, "AddressToLocationsEncoded"))
+    *method = "AddressToLocations";
+  else if ((!strcmp(*method, "AddressToLocations") ||
+            !strcmp(*method, "AddressToLocationsStreamed")) &&
+           children->len &&
+           g_variant_is_of_type(g_ptr_array_index(children, 0),
+                                G_VARIANT_TYPE_STRING_ARRAY))
+  {
+    GVariant *strv = g_variant_ref_sink(g_ptr_array_index(children, 0));
+
+    children->pdata[0] = strv_to_encoded_address(strv);
+    g_variant_unref(strv);
+  }
+
+  args = g_variant_ref_sink(
+      g_variant_new_tuple((GVariant **)children->pdata, children->len));
+  g_ptr_array_free(children, TRUE);
+
+  return args;
+}
+
+static void
+check_done(ReplayContext *ctx)
+{
+  if (exit_when_done && ctx->n_served == ctx->n_requests && !ctx->n_pending)
+    g_main_loop_quit(ctx->loop);
+}
+
+static void
+replay_signal_free(gpointer data)
+{
+  ReplaySignal *signal = data;
+
+  dbus_message_unref(signal->message);
+  g_free(signal->path);
+  g_free(signal->destination);
+  g_free(signal);
+}
+
+static gboolean
+send_signal_cb(gpointer data)
+{
+  ReplaySignal *signal = data;
+  DBusMessage *message = dbus_message_copy(signal->message);
+
+  /* the request got a new object path */
+  dbus_message_set_path(message, signal->path);
+  dbus_message_set_sender(message, NULL);
+
+  if (dbus_message_get_destination(message))
+    dbus_message_set_destination(message, signal->destination);
+
+  dbus_connection_send(signal->ctx->dbus, message, NULL);
+  dbus_message_unref(message);
+
+  signal->ctx->n_pending--;
+  check_done(signal->ctx);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+serve_request(ReplayContext *ctx, DBusMessage *call, ReplayRequest *request)
+{
+  gchar *path = g_strdup_printf(MAP_PROVIDER_PATH "/Request/%u",
+                                ++ctx->n_served);
+  DBusMessage *reply = dbus_message_new_method_return(call);
+  guint i;
+
+  dbus_message_append_args(reply, DBUS_TYPE_OBJECT_PATH, &path,
+                           DBUS_TYPE_INVALID);
+  dbus_connection_send(ctx->dbus, reply, NULL);
+  dbus_message_unref(reply);
+
+  for (i = 0; i < request->replies->len; i++)
+  {
+    NavigationTraceEvent *event = g_ptr_array_index(request->replies, i);
+    ReplaySignal *signal = g_new0(ReplaySignal, 1);
+    gint64 delay = event->time - request->event->time;
+
+    signal->ctx = ctx;
+    signal->message = dbus_message_ref(event->message);
+    signal->path = g_strdup(path);
+    signal->destination = g_strdup(dbus_message_get_sender(call));
+    ctx->n_pending++;
+
+    /* sources of the same priority run in the order they were added */
+    if (fast)
+    {
+      g_idle_add_full(G_PRIORITY_DEFAULT, send_signal_cb, signal,
+                      replay_signal_free);
+    }
+    else
+    {
+      g_timeout_add_full(G_PRIORITY_DEFAULT, MAX(delay, 0) / 1000,
+                         send_signal_cb, signal, replay_signal_free);
+    }
+  }
+
+  g_free(path);
+}
+
+static DBusHandlerResult
+replay_message(DBusConnection *connection, DBusMessage *message,
+               void *user_data)
+{
+  ReplayContext *ctx = user_data;
+  ReplayRequest *request;
+  DBusMessage *reply = NULL;
+  const gchar *method;
+  GVariant *args;
+  gchar *key;
+
+  if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+      !dbus_message_has_interface(message, MAP_PROVIDER_INTERFACE))
+  {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  if (plain && g_str_has_suffix(dbus_message_get_member(message), "Encoded"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  args = call_args(message, &method);
+
+  if (!g_hash_table_contains(ctx->by_method, method))
+  {
+    reply = dbus_message_new_method_return(message);
+
+    if (!strcmp(method, "LocationToAddressesCached"))
+    {
+      DBusMessageIter iter;
+      DBusMessageIter sub;
+
+      dbus_message_iter_init_append(reply, &iter);
+      dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "as", &sub);
+      dbus_message_iter_close_container(&iter, &sub);
+    }
+  }
+  else
+  {
+    key = request_key(method, args);
+
+    if (!(request = queue_pop(ctx->by_args, key)) &&
+        (request = queue_pop(ctx->by_method, method)))
+    {
+      ctx->n_inexact++;
+    }
+
+    g_free(key);
+
+    if (request)
+    {
+      request->used = TRUE;
+      serve_request(ctx, message, request);
+    }
+    else
+    {
+      ctx->n_missing++;
+      reply = dbus_message_new_error(message, DBUS_ERROR_FAILED,
+                                     "No recorded request left");
+    }
+  }
+
+  if (reply)
+  {
+    dbus_connection_send(connection, reply, NULL);
+    dbus_message_unref(reply);
+  }
+
+  g_variant_unref(args);
+  check_done(ctx);
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static gboolean
+quit_cb(gpointer user_data)
+{
+  g_main_loop_quit(user_data);
+
+  return G_SOURCE_CONTINUE;
+}
+
+int
+main(int argc, char **argv)
+{
+  static const DBusObjectPathVTable vtable = { NULL, replay_message };
+  GOptionContext *context;
+  ReplayContext ctx;
+  GPtrArray *requests;
+  GError *error = NULL;
+  DBusError derror;
+  int rv = 1;
+
+  context = g_option_context_new("TRACE - serve a trace as navigation service");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!name || argc != 2)
+  {
+    g_printerr("Usage: %s -n NAME [-s SERVICE] [-f] [-p] [-x] TRACE\n", g_get_prgname());
+    return 1;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+
+  if (!(ctx.events = navigation_trace_load(argv[1], &error)))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+
+    return 1;
+  }
+
+  ctx.by_args = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify)g_queue_free);
+  ctx.by_method = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)g_queue_free);
+  requests = g_ptr_array_new_with_free_func(
+      (GDestroyNotify)replay_request_free);
+  load_requests(&ctx, requests);
+
+  dbus_error_init(&derror);
+  ctx.dbus = dbus_bus_get(DBUS_BUS_SESSION, &derror);
+
+  if (!ctx.dbus)
+    g_printerr("%s\n", derror.message);
+  else
+  {
+    ctx.loop = g_main_loop_new(NULL, FALSE);
+    dbus_connection_setup_with_g_main(ctx.dbus, NULL);
+    dbus_connection_register_object_path(ctx.dbus, MAP_PROVIDER_PATH,
+                                         &vtable, &ctx);
+
+    if (dbus_bus_request_name(ctx.dbus, name, DBUS_NAME_FLAG_DO_NOT_QUEUE,
+                              &derror) != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
+    {
+      g_printerr("Unable to own %s: %s\n", name,
+                 dbus_error_is_set(&derror) ? derror.message : "name taken");
+    }
+    else
+    {
+      g_unix_signal_add(SIGINT, quit_cb, ctx.loop);
+      g_unix_signal_add(SIGTERM, quit_cb, ctx.loop);
+      g_print("Serving %u requests as %s\n", ctx.n_requests, name);
+      g_main_loop_run(ctx.loop);
+      dbus_connection_flush(ctx.dbus);
+
+      g_print("%u of %u requests served, %u without a matching request, %u "
+              "unknown\n", ctx.n_served, ctx.n_requests, ctx.n_inexact,
+              ctx.n_missing);
+      rv = 0;
+    }
+
+    dbus_connection_unref(ctx.dbus);
+    g_main_loop_unref(ctx.loop);
+  }
+
+  dbus_error_free(&derror);
+  g_ptr_array_free(requests, TRUE);
+  g_hash_table_destroy(ctx.by_method);
+  g_hash_table_destroy(ctx.by_args);
+  g_ptr_array_free(ctx.events, TRUE);
+
+  return rv;
+}